@@ -0,0 +1,112 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+// Linear allocators for memory with a known lifetime: a frame, a job or a load.
+// Allocating bumps a pointer and nothing is freed individually; arenaReset() frees everything at once.
+// When the current block is full, another one is chained. arenaReset() replaces a chain with one block
+// of the combined size, so an arena settles into a single block after its first busy use.
+#define ARENA_ALIGNMENT 64 // Cache line, so arrays written by different threads don't share lines at their ends.
+
+typedef struct ArenaBlock
+{
+    struct ArenaBlock* previous;
+    size_t capacity; // Bytes after the header.
+    size_t used;
+} ArenaBlock;
+
+typedef struct
+{
+    ArenaBlock* block; // Newest block.
+    size_t blockSize;  // Minimum capacity of chained blocks.
+} Arena;
+
+// Position to return to with arenaRelease().
+typedef struct
+{
+    ArenaBlock* block;
+    size_t used;
+} ArenaMark;
+
+static ArenaBlock* arenaNewBlock( size_t capacity, ArenaBlock* previous )
+{
+    ArenaBlock* block = malloc( sizeof( ArenaBlock ) + capacity );
+    assert( block && "out of memory" );
+    block->previous = previous;
+    block->capacity = capacity;
+    block->used = 0;
+    return block;
+}
+
+void arenaInit( Arena* arena, size_t capacity )
+{
+    arena->blockSize = capacity;
+    arena->block = arenaNewBlock( capacity, NULL );
+}
+
+void arenaFree( Arena* arena )
+{
+    while (arena->block)
+    {
+        ArenaBlock* previous = arena->block->previous;
+        free( arena->block );
+        arena->block = previous;
+    }
+}
+
+// Returns ARENA_ALIGNMENT aligned, uninitialized memory that stays valid until the arena is reset or released past it.
+void* arenaAlloc( Arena* arena, size_t size )
+{
+    ArenaBlock* block = arena->block;
+    uintptr_t base = (uintptr_t)(block + 1);
+    uintptr_t start = (base + block->used + ARENA_ALIGNMENT - 1) & ~(uintptr_t)(ARENA_ALIGNMENT - 1);
+
+    if (start + size > base + block->capacity)
+    {
+        const size_t capacity = size + ARENA_ALIGNMENT > arena->blockSize ? size + ARENA_ALIGNMENT : arena->blockSize;
+        block = arenaNewBlock( capacity, block );
+        arena->block = block;
+        base = (uintptr_t)(block + 1);
+        start = (base + ARENA_ALIGNMENT - 1) & ~(uintptr_t)(ARENA_ALIGNMENT - 1);
+    }
+
+    block->used = start + size - base;
+    return (void*)start;
+}
+
+// Frees all allocations.
+void arenaReset( Arena* arena )
+{
+    if (arena->block->previous)
+    {
+        size_t capacity = 0;
+
+        for (const ArenaBlock* block = arena->block; block; block = block->previous)
+        {
+            capacity += block->capacity;
+        }
+
+        arenaFree( arena );
+        arena->block = arenaNewBlock( capacity, NULL );
+    }
+
+    arena->block->used = 0;
+}
+
+ArenaMark arenaMark( const Arena* arena )
+{
+    const ArenaMark mark = { arena->block, arena->block->used };
+    return mark;
+}
+
+// Frees the allocations made after mark.
+void arenaRelease( Arena* arena, ArenaMark mark )
+{
+    while (arena->block != mark.block)
+    {
+        ArenaBlock* previous = arena->block->previous;
+        free( arena->block );
+        arena->block = previous;
+    }
+
+    arena->block->used = mark.used;
+}
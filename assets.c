@@ -0,0 +1,206 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+// Background asset loading. Requests are queued and parsed on a loader thread of their own, not on the job system,
+// whose threads the frame waits for. A finished asset is published by setting its state last, so once the render
+// thread sees AssetReady every field is complete, and it's never written again until assetLoaderShutdown().
+// Until then the renderer draws placeholders or skips the asset.
+#define MAX_ASSETS 64
+
+typedef enum
+{
+    AssetLoading = 0,
+    AssetReady,
+    AssetFailed // The reason was printed by the loader.
+} AssetState;
+
+typedef enum
+{
+    AssetMesh,
+    AssetTexture
+} AssetType;
+
+typedef struct
+{
+    AssetType type;
+    char path[ 256 ];
+    SDL_atomic_t state; // AssetState, read with assetState().
+
+    // Mesh, one per object in the file with LOD chains built.
+    Mesh* meshes;
+    MeshLods* lods;
+    int meshCount;
+    Vec3 aabbMin; // Bounds of all meshes.
+    Vec3 aabbMax;
+
+    // Texture, square as the rasterizer requires.
+    int* pixels;
+    int texDim;
+} Asset;
+
+typedef struct
+{
+    Asset* assets[ MAX_ASSETS ]; // Queued in request order.
+    int assetCount;
+    int nextToLoad; // Only touched by the loader thread.
+    SDL_SpinLock lock; // Guards assetCount.
+    SDL_sem* pending; // Posted once per request.
+    SDL_Thread* thread;
+    SDL_atomic_t quit;
+} AssetLoader;
+
+static void assetLoad( Asset* asset )
+{
+    bool loaded = false;
+
+    if (asset->type == AssetMesh)
+    {
+        loaded = loadObj( asset->path, &asset->meshes, &asset->meshCount );
+
+        if (loaded)
+        {
+            asset->lods = malloc( asset->meshCount * sizeof( MeshLods ) );
+            asset->aabbMin = asset->meshes[ 0 ].aabbMin;
+            asset->aabbMax = asset->meshes[ 0 ].aabbMax;
+        }
+
+        for (int m = 0; loaded && m < asset->meshCount; ++m)
+        {
+            meshBuildLods( &asset->meshes[ m ], MAX_MESH_LODS, &asset->lods[ m ] );
+
+            const Vec3 corners[ 4 ] = { asset->aabbMin, asset->aabbMax, asset->meshes[ m ].aabbMin, asset->meshes[ m ].aabbMax };
+            getMinMax( corners, 4, &asset->aabbMin, &asset->aabbMax );
+        }
+    }
+    else
+    {
+        int width = 0;
+        int height = 0;
+        asset->pixels = loadBMP( asset->path, &width, &height );
+        loaded = asset->pixels != NULL;
+
+        if (loaded && width != height)
+        {
+            printf( "%s must be square, it's %dx%d.\n", asset->path, width, height );
+            free( asset->pixels );
+            asset->pixels = NULL;
+            loaded = false;
+        }
+
+        asset->texDim = width;
+    }
+
+    if (!loaded)
+    {
+        printf( "Could not load %s\n", asset->path );
+    }
+
+    // Publishes the fields above to the render thread.
+    SDL_AtomicSet( &asset->state, loaded ? AssetReady : AssetFailed );
+}
+
+static int assetLoaderThread( void* data )
+{
+    AssetLoader* loader = (AssetLoader*)data;
+    traceSetThreadName( "asset loader" );
+
+    while (1)
+    {
+        SDL_SemWait( loader->pending );
+
+        if (SDL_AtomicGet( &loader->quit ))
+        {
+            break;
+        }
+
+        SDL_AtomicLock( &loader->lock );
+        Asset* asset = loader->assets[ loader->nextToLoad++ ];
+        SDL_AtomicUnlock( &loader->lock );
+
+        TRACE_BEGIN( "load asset" );
+        assetLoad( asset );
+        TRACE_END( "load asset" );
+    }
+
+    return 0;
+}
+
+void assetLoaderInit( AssetLoader* loader )
+{
+    loader->assetCount = 0;
+    loader->nextToLoad = 0;
+    loader->lock = 0;
+    loader->pending = SDL_CreateSemaphore( 0 );
+    SDL_AtomicSet( &loader->quit, 0 );
+    loader->thread = SDL_CreateThread( assetLoaderThread, "asset loader", loader );
+}
+
+// Finishes the asset being loaded, drops the queued ones and frees all assets.
+void assetLoaderShutdown( AssetLoader* loader )
+{
+    SDL_AtomicSet( &loader->quit, 1 );
+    SDL_SemPost( loader->pending );
+    SDL_WaitThread( loader->thread, NULL );
+    SDL_DestroySemaphore( loader->pending );
+
+    for (int i = 0; i < loader->assetCount; ++i)
+    {
+        Asset* asset = loader->assets[ i ];
+
+        if (SDL_AtomicGet( &asset->state ) == AssetReady)
+        {
+            for (int m = 0; m < asset->meshCount; ++m)
+            {
+                meshLodsFree( &asset->lods[ m ] );
+                meshFree( &asset->meshes[ m ] );
+            }
+
+            free( asset->meshes );
+            free( asset->lods );
+            free( asset->pixels );
+        }
+
+        free( asset );
+    }
+
+    loader->assetCount = 0;
+}
+
+// Queues path for loading and returns immediately. The asset stays valid until assetLoaderShutdown().
+// Returns NULL if MAX_ASSETS assets were already requested.
+static Asset* assetRequest( AssetLoader* loader, AssetType type, const char* path )
+{
+    if (loader->assetCount == MAX_ASSETS)
+    {
+        printf( "Could not load %s: too many assets.\n", path );
+        return NULL;
+    }
+
+    Asset* asset = calloc( 1, sizeof( Asset ) );
+    asset->type = type;
+    snprintf( asset->path, sizeof( asset->path ), "%s", path );
+    SDL_AtomicSet( &asset->state, AssetLoading );
+
+    SDL_AtomicLock( &loader->lock );
+    loader->assets[ loader->assetCount++ ] = asset;
+    SDL_AtomicUnlock( &loader->lock );
+
+    SDL_SemPost( loader->pending );
+    return asset;
+}
+
+Asset* assetLoadMesh( AssetLoader* loader, const char* path )
+{
+    return assetRequest( loader, AssetMesh, path );
+}
+
+Asset* assetLoadTexture( AssetLoader* loader, const char* path )
+{
+    return assetRequest( loader, AssetTexture, path );
+}
+
+// Fields of an asset may only be read once this returns AssetReady. asset can be NULL, it never loads.
+AssetState assetState( const Asset* asset )
+{
+    return asset ? (AssetState)SDL_AtomicGet( (SDL_atomic_t*)&asset->state ) : AssetFailed;
+}
@@ -0,0 +1,601 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+// Rasterizer microbenchmark. Standalone unity build, doesn't open a window: make bench && ./bench
+//
+// Every variant draws the same synthetic triangle sets into its own buffers. Sets cover the size and shape
+// classes a real scene mixes: tiny (under 4 px), small, full-screen, slivers (extreme getRatio()) and a mix.
+// Reports triangles and covered pixels per second, and checks each variant's output against drawTriangle().
+//
+// To add a variant, write a BenchDrawFunc or BenchDrawBatchFunc wrapper and add it to benchVariants.
+#ifdef __linux__
+#define _GNU_SOURCE // pthread_setaffinity_np() in jobs.c
+#endif
+#include <assert.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <float.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#ifndef ARCH_ARM64
+#include <pmmintrin.h>
+#endif
+#if _MSC_VER
+#include "SDL.h"
+#include <intrin.h>
+#include <malloc.h>
+#else
+#include <stdalign.h>
+#include <SDL2/SDL.h>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+#ifdef ARCH_X64
+#include <x86intrin.h>
+#endif
+#ifdef ARCH_ARM64
+#include <arm_neon.h>
+#endif
+#endif
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h> // SetThreadAffinityMask() in jobs.c
+#endif
+
+const int WIDTH = 1920 / 2;
+const int HEIGHT = 1080 / 2;
+
+#include "vec3.c"
+#include "mymath.c"
+#include "srgb.c"
+#include "frustum.c"
+#include "stats.c"
+#include "trace.c"
+#include "arena.c"
+#include "jobs.c"
+#include "framebuffer.c"
+#include "lighting.c"
+#include "debugview.c"
+#include "renderer.c"
+
+#define BENCH_TEX_DIM 64
+#define BENCH_CHECK_TRIANGLES 64   // Triangles per set that are compared against the reference one at a time.
+#define BENCH_MIN_SECONDS 0.25     // Each variant repeats a set until this much time has been measured.
+#define BENCH_MISMATCH_LIMIT 0.02f // Fraction of pixels covered by both that may differ in color, because texel rounding differs.
+#define BENCH_COVERAGE_LIMIT 0.01f // Fraction of the reference's pixels that may be covered by only one, because edge rules differ.
+
+typedef struct
+{
+    int* color;
+    int pitch; // Bytes.
+    DepthBuffer depth;
+} BenchTarget;
+
+// Vertices are in drawTriangle2()'s winding.
+typedef void (*BenchDrawFunc)( Vertex* v1, Vertex* v2, Vertex* v3, BenchTarget* target );
+// Draws triangleCount triangles, 3 vertices each, in one call.
+typedef void (*BenchDrawBatchFunc)( Vertex* vertices, int triangleCount, BenchTarget* target );
+
+typedef struct
+{
+    const char* name;
+    BenchDrawFunc draw;
+    bool mustMatch;                // Exit with an error if coverage or colors differ from the reference.
+    BenchDrawBatchFunc drawBatch;  // Used instead of draw if set.
+} BenchVariant;
+
+typedef struct
+{
+    const char* name;
+    Vertex* vertices; // 3 per triangle.
+    int triangleCount;
+    uint64_t coveredPixels; // Per pass, with the rasterizers' coverage rules.
+} BenchSet;
+
+static int benchTexture[ BENCH_TEX_DIM * BENCH_TEX_DIM ];
+
+static void benchDrawReference( Vertex* v1, Vertex* v2, Vertex* v3, BenchTarget* target )
+{
+    // drawTriangle() tests the edges in the opposite direction.
+    drawTriangle( v1, v3, v2, target->pitch, benchTexture, BENCH_TEX_DIM, &target->depth, target->color );
+}
+
+static void benchDrawTriangle2( Vertex* v1, Vertex* v2, Vertex* v3, BenchTarget* target )
+{
+    drawTriangle2( v1, v2, v3, target->pitch, benchTexture, BENCH_TEX_DIM, 0, &target->depth, target->color );
+}
+
+// Single-sampled view of target and a depth-writing draw state, like drawTriangle2() builds.
+static void benchBeginDraw( BenchTarget* target, ShadeMode shadeMode, DrawState* outState, Framebuffer* outFb )
+{
+    memset( outState, 0, sizeof( DrawState ) );
+    outState->shadeMode = shadeMode;
+    outState->depthWrite = true;
+    outState->texture = benchTexture;
+    outState->texDim = BENCH_TEX_DIM;
+
+    memset( outFb, 0, sizeof( Framebuffer ) );
+    outFb->colorBuffer = target->color;
+    outFb->colorPitch = target->pitch;
+    outFb->depth = target->depth;
+    outFb->sampleCount = 1;
+    outFb->width = target->depth.width;
+    outFb->height = target->depth.height;
+}
+
+static void benchDrawTriangle2Bilinear( Vertex* v1, Vertex* v2, Vertex* v3, BenchTarget* target )
+{
+    DrawState state;
+    Framebuffer fb;
+    benchBeginDraw( target, ShadeTextureBilinear, &state, &fb );
+
+    selectDrawTriangle2( target->depth.format, ShadeTextureBilinear, RasterDepthWrite )( v1, v2, v3, &state, &fb );
+}
+
+// Rasterizes setup with the rasterizer renderMesh() picks for it, see classifyTriangle().
+static void benchRasterDispatch( const TriangleSetup* setup, const DrawState* state, Framebuffer* fb )
+{
+    const DepthFormat depthFormat = fb->depth.format;
+
+    switch (classifyTriangle( setup ))
+    {
+    case RasterPathSmall:  selectRasterSmallTriangles( depthFormat, state->shadeMode, RasterDepthWrite )( setup, 1, state, fb ); break;
+    case RasterPathSliver: selectRasterSpans( depthFormat, state->shadeMode, RasterDepthWrite )( setup, state, fb ); break;
+    default:               selectRasterTriangle( depthFormat, state->shadeMode, RasterDepthWrite )( setup, state, fb ); break;
+    }
+}
+
+// Per-triangle setup, then stamps, spans or rasterTriangle like renderMesh()'s tiles.
+static void benchDrawDispatch( Vertex* v1, Vertex* v2, Vertex* v3, BenchTarget* target )
+{
+    DrawState state;
+    Framebuffer fb;
+    benchBeginDraw( target, ShadeTextureNearest, &state, &fb );
+
+    TriangleSetup setup;
+
+    if (setupTriangle( v1, v2, v3, fb.width, fb.height, false, setupTexScale( &state, ShadeTextureNearest ), false, &setup ))
+    {
+        benchRasterDispatch( &setup, &state, &fb );
+    }
+}
+
+// Span rasterizer for every triangle, not only slivers.
+static void benchDrawSpans( Vertex* v1, Vertex* v2, Vertex* v3, BenchTarget* target )
+{
+    DrawState state;
+    Framebuffer fb;
+    benchBeginDraw( target, ShadeTextureNearest, &state, &fb );
+
+    TriangleSetup setup;
+
+    if (setupTriangle( v1, v2, v3, fb.width, fb.height, false, setupTexScale( &state, ShadeTextureNearest ), false, &setup ))
+    {
+        selectRasterSpans( target->depth.format, ShadeTextureNearest, RasterDepthWrite )( &setup, &state, &fb );
+    }
+}
+
+// renderMesh()'s setup: setupMeshTriangles() on batches of SETUP_BATCH_SIZE faces, then dispatch like benchDrawDispatch().
+static void benchDrawBatched( Vertex* vertices, int triangleCount, BenchTarget* target )
+{
+    DrawState state;
+    Framebuffer fb;
+    benchBeginDraw( target, ShadeTextureNearest, &state, &fb );
+
+    VertexInd faces[ SETUP_BATCH_SIZE ];
+    TriangleSetup setups[ SETUP_BATCH_SIZE ];
+    unsigned setupFaces[ SETUP_BATCH_SIZE ];
+    Mesh mesh;
+    memset( &mesh, 0, sizeof( Mesh ) );
+    mesh.faces = faces;
+
+    for (int first = 0; first < triangleCount; first += SETUP_BATCH_SIZE)
+    {
+        const int faceCount = mini( triangleCount - first, SETUP_BATCH_SIZE );
+
+        // Faces index the batch's vertices. Setup's vertex order a, c, b is drawTriangle2()'s v1, v2, v3.
+        for (int i = 0; i < faceCount; ++i)
+        {
+            faces[ i ].a = (unsigned short)(i * 3);
+            faces[ i ].b = (unsigned short)(i * 3 + 2);
+            faces[ i ].c = (unsigned short)(i * 3 + 1);
+        }
+
+        mesh.faceCount = (unsigned)faceCount;
+        const unsigned setupCount = setupMeshTriangles( &mesh, &vertices[ first * 3 ], 0, (unsigned)faceCount, fb.width, fb.height, false,
+                                                        setupTexScale( &state, ShadeTextureNearest ), false, setups, setupFaces );
+
+        for (unsigned t = 0; t < setupCount; ++t)
+        {
+            benchRasterDispatch( &setups[ t ], &state, &fb );
+        }
+    }
+}
+
+static void benchDrawTriangle3( Vertex* v1, Vertex* v2, Vertex* v3, BenchTarget* target )
+{
+    drawTriangle3( v1, v2, v3, target->pitch, benchTexture, BENCH_TEX_DIM, 0, &target->depth, target->color );
+}
+
+static const BenchVariant benchVariants[] =
+{
+    { "drawTriangle (reference)", benchDrawReference, true, NULL },
+    { "drawTriangle2 nearest", benchDrawTriangle2, true, NULL },
+    { "drawTriangle2 bilinear", benchDrawTriangle2Bilinear, false, NULL }, // Filtering changes the colors.
+    { "nearest, dispatch", benchDrawDispatch, true, NULL },
+    { "nearest, spans", benchDrawSpans, true, NULL },
+    { "nearest, batched setup", NULL, true, benchDrawBatched },
+    { "drawTriangle3 (WIP)", benchDrawTriangle3, false, NULL },
+};
+
+#define BENCH_VARIANT_COUNT (int)(sizeof( benchVariants ) / sizeof( benchVariants[ 0 ] ))
+
+// xorshift32, so that every run draws the same triangles.
+static Uint32 benchRandomState = 0x2545F491u;
+
+static float benchRandom( float minValue, float maxValue )
+{
+    benchRandomState ^= benchRandomState << 13;
+    benchRandomState ^= benchRandomState >> 17;
+    benchRandomState ^= benchRandomState << 5;
+    return minValue + (maxValue - minValue) * (float)(benchRandomState >> 8) * (1.0f / 16777216.0f);
+}
+
+static Vertex benchVertex( float x, float y )
+{
+    Vertex v;
+    v.x = x;
+    v.y = y;
+    v.z = benchRandom( 1.0f, 10.0f );
+    // Texture mapped over the screen like a mesh with constant texel density. drawTriangle() doesn't clamp UVs.
+    v.u = fminf( fmaxf( x / WIDTH, 0.0f ), 1.0f );
+    v.v = fminf( fmaxf( y / HEIGHT, 0.0f ), 1.0f );
+    v.r = 1;
+    v.g = 1;
+    v.b = 1;
+    return v;
+}
+
+// Stores the triangle in drawTriangle2()'s winding. Returns false for degenerate triangles.
+static bool benchAddTriangle( BenchSet* set, Vertex a, Vertex b, Vertex c )
+{
+    const float area = orient2D( a.x, a.y, b.x, b.y, c.x, c.y );
+
+    if (fabsf( area ) < 0.01f)
+    {
+        return false;
+    }
+
+    Vertex* out = &set->vertices[ set->triangleCount * 3 ];
+    out[ 0 ] = a;
+    out[ 1 ] = area > 0 ? b : c;
+    out[ 2 ] = area > 0 ? c : b;
+    ++set->triangleCount;
+    return true;
+}
+
+// Random triangle whose vertices are within size pixels of a random point on the screen.
+static void benchAddRandomTriangle( BenchSet* set, float size )
+{
+    for (;;)
+    {
+        const float cx = benchRandom( size, WIDTH - size );
+        const float cy = benchRandom( size, HEIGHT - size );
+
+        const Vertex a = benchVertex( cx + benchRandom( -size, size ), cy + benchRandom( -size, size ) );
+        const Vertex b = benchVertex( cx + benchRandom( -size, size ), cy + benchRandom( -size, size ) );
+        const Vertex c = benchVertex( cx + benchRandom( -size, size ), cy + benchRandom( -size, size ) );
+
+        if (benchAddTriangle( set, a, b, c ))
+        {
+            return;
+        }
+    }
+}
+
+// Half of a screen-covering quad, with the corners slightly outside the screen.
+static void benchAddFullscreenTriangle( BenchSet* set )
+{
+    const float j = benchRandom( 0.0f, 8.0f );
+    const Vertex topLeft = benchVertex( -j, -j );
+    const Vertex topRight = benchVertex( WIDTH + j, -j );
+    const Vertex bottomLeft = benchVertex( -j, HEIGHT + j );
+    const Vertex bottomRight = benchVertex( WIDTH + j, HEIGHT + j );
+
+    if (set->triangleCount % 2 == 0)
+    {
+        benchAddTriangle( set, topLeft, topRight, bottomRight );
+    }
+    else
+    {
+        benchAddTriangle( set, topLeft, bottomRight, bottomLeft );
+    }
+}
+
+// Long, 1-3 pixels thick triangle. Its bounding box's getRatio() is below 1/16 or above 16.
+static void benchAddSliverTriangle( BenchSet* set )
+{
+    for (;;)
+    {
+        const bool horizontal = benchRandom( 0.0f, 1.0f ) < 0.5f;
+        const float length = benchRandom( 100.0f, horizontal ? WIDTH - 8.0f : HEIGHT - 8.0f );
+        const float thickness = benchRandom( 1.0f, 3.0f );
+        const float along = benchRandom( 4.0f, (horizontal ? WIDTH : HEIGHT) - length - 4.0f );
+        const float across = benchRandom( 4.0f, (horizontal ? HEIGHT : WIDTH) - thickness - 4.0f );
+        const float tip = benchRandom( 0.0f, thickness );
+
+        Vertex a, b, c;
+
+        if (horizontal)
+        {
+            a = benchVertex( along, across );
+            b = benchVertex( along, across + thickness );
+            c = benchVertex( along + length, across + tip );
+        }
+        else
+        {
+            a = benchVertex( across, along );
+            b = benchVertex( across + thickness, along );
+            c = benchVertex( across + tip, along + length );
+        }
+
+        const Vec3 aabbMin = { fminf( a.x, fminf( b.x, c.x ) ), fminf( a.y, fminf( b.y, c.y ) ), 0 };
+        const Vec3 aabbMax = { fmaxf( a.x, fmaxf( b.x, c.x ) ), fmaxf( a.y, fmaxf( b.y, c.y ) ), 0 };
+        const float ratio = getRatio( aabbMin, aabbMax );
+        assert( ratio > 16.0f || ratio < 1.0f / 16.0f );
+        (void)ratio;
+
+        if (benchAddTriangle( set, a, b, c ))
+        {
+            return;
+        }
+    }
+}
+
+typedef enum
+{
+    BenchSetTiny = 0,
+    BenchSetSmall,
+    BenchSetLarge,
+    BenchSetSliver,
+    BenchSetMixed,
+    BenchSetCount
+} BenchSetType;
+
+static void benchAddTriangleOfType( BenchSet* set, BenchSetType type )
+{
+    switch (type)
+    {
+    case BenchSetTiny:   benchAddRandomTriangle( set, 2.0f ); break;
+    case BenchSetSmall:  benchAddRandomTriangle( set, benchRandom( 4.0f, 16.0f ) ); break;
+    case BenchSetLarge:  benchAddFullscreenTriangle( set ); break;
+    case BenchSetSliver: benchAddSliverTriangle( set ); break;
+    default:             assert( !"Unhandled set type" ); break;
+    }
+}
+
+static void benchSetInit( BenchSet* set, BenchSetType type, int triangleCount )
+{
+    static const char* names[ BenchSetCount ] = { "tiny", "small", "large", "sliver", "mixed" };
+
+    set->name = names[ type ];
+    set->vertices = malloc( triangleCount * 3 * sizeof( Vertex ) );
+    set->triangleCount = 0;
+
+    while (set->triangleCount < triangleCount)
+    {
+        if (type == BenchSetMixed)
+        {
+            // Roughly what a scene submits: mostly small triangles, a few slivers and the odd big one.
+            const float r = benchRandom( 0.0f, 1.0f );
+            benchAddTriangleOfType( set, r < 0.4f ? BenchSetTiny : (r < 0.9f ? BenchSetSmall : (r < 0.999f ? BenchSetSliver : BenchSetLarge)) );
+        }
+        else
+        {
+            benchAddTriangleOfType( set, type );
+        }
+    }
+
+    // The overdraw view counts coverage of the single-sampled setups like the rasterizers test it.
+    DebugViews coverage;
+    debugViewsInit( &coverage, WIDTH, HEIGHT );
+    coverage.view = DebugViewOverdraw;
+    debugViewsBeginFrame( &coverage );
+
+    for (int i = 0; i < set->triangleCount; ++i)
+    {
+        const Vertex* v = &set->vertices[ i * 3 ];
+        TriangleSetup setup;
+
+        if (setupTriangle( &v[ 0 ], &v[ 1 ], &v[ 2 ], WIDTH, HEIGHT, false, 0, false, &setup ))
+        {
+            debugViewsAddTriangle( &coverage, &setup, 1, 0 );
+        }
+    }
+
+    set->coveredPixels = 0;
+
+    for (int i = 0; i < WIDTH * HEIGHT; ++i)
+    {
+        set->coveredPixels += coverage.depthTests[ i ];
+    }
+
+    debugViewsFree( &coverage );
+}
+
+static void benchTargetClear( BenchTarget* target )
+{
+    memset( target->color, 0, HEIGHT * target->pitch );
+    depthBufferFill( &target->depth, 0, 0, WIDTH, HEIGHT, 0.0f );
+}
+
+typedef struct
+{
+    uint64_t referencePixels;
+    uint64_t coverageMismatches; // Pixels covered by only one of the rasterizers.
+    uint64_t colorMismatches;    // Pixels covered by both with different colors.
+} BenchComparison;
+
+// Draws count triangles of vertices with the variant.
+static void benchDraw( const BenchVariant* variant, Vertex* vertices, int count, BenchTarget* target )
+{
+    if (variant->drawBatch)
+    {
+        variant->drawBatch( vertices, count, target );
+        return;
+    }
+
+    for (int i = 0; i < count; ++i)
+    {
+        Vertex* v = &vertices[ i * 3 ];
+        variant->draw( &v[ 0 ], &v[ 1 ], &v[ 2 ], target );
+    }
+}
+
+// Compares the variant's output against drawTriangle() one triangle at a time, because drawTriangle() doesn't test depth.
+// drawTriangle() excludes all edges while drawTriangle2() follows a top-left rule, so pixels exactly on an
+// edge may differ, up to BENCH_COVERAGE_LIMIT. Tiny triangles are the most sensitive, edge pixels are the majority there.
+static BenchComparison benchCompare( const BenchSet* set, const BenchVariant* variant, BenchTarget* reference, BenchTarget* target )
+{
+    BenchComparison result = { 0 };
+
+    for (int i = 0; i < set->triangleCount && i < BENCH_CHECK_TRIANGLES; ++i)
+    {
+        Vertex* v = &set->vertices[ i * 3 ];
+        Vertex r[ 3 ] = { v[ 0 ], v[ 1 ], v[ 2 ] };
+        Vertex t[ 4 * 3 ];
+
+        // Batches get 4 copies so that setupMeshTriangles() takes its SIMD path. The copies fail the depth test.
+        const int copies = variant->drawBatch ? 4 : 1;
+
+        for (int c = 0; c < copies * 3; ++c)
+        {
+            t[ c ] = v[ c % 3 ];
+        }
+
+        benchTargetClear( reference );
+        benchTargetClear( target );
+        benchDrawReference( &r[ 0 ], &r[ 1 ], &r[ 2 ], reference );
+        benchDraw( variant, t, copies, target );
+
+        for (int y = 0; y < HEIGHT; ++y)
+        {
+            const int* referenceRow = (const int*)((const Uint8*)reference->color + y * reference->pitch);
+            const int* targetRow = (const int*)((const Uint8*)target->color + y * target->pitch);
+
+            for (int x = 0; x < WIDTH; ++x)
+            {
+                // Texels are never 0, so 0 is an uncovered pixel.
+                const bool referenceCovered = referenceRow[ x ] != 0;
+                const bool targetCovered = targetRow[ x ] != 0;
+
+                result.referencePixels += referenceCovered;
+                result.coverageMismatches += referenceCovered != targetCovered;
+                result.colorMismatches += referenceCovered && targetCovered && referenceRow[ x ] != targetRow[ x ];
+            }
+        }
+    }
+
+    return result;
+}
+
+// Returns seconds per pass over the set. Depth is cleared between passes, outside the timed region.
+static double benchTime( const BenchSet* set, const BenchVariant* variant, BenchTarget* target )
+{
+    const Uint64 frequency = SDL_GetPerformanceFrequency();
+    Uint64 ticks = 0;
+    int passes = 0;
+
+    while (passes < 3 || ticks < BENCH_MIN_SECONDS * frequency)
+    {
+        depthBufferFill( &target->depth, 0, 0, WIDTH, HEIGHT, 0.0f );
+
+        const Uint64 start = SDL_GetPerformanceCounter();
+        benchDraw( variant, set->vertices, set->triangleCount, target );
+
+        ticks += SDL_GetPerformanceCounter() - start;
+        ++passes;
+    }
+
+    return (double)ticks / frequency / passes;
+}
+
+int main( int argc, char* argv[] )
+{
+    (void)argc;
+    (void)argv;
+    (void)debugViewNames;
+
+    initSRGBTables();
+
+    // Checker of 8x8 texel cells with distinct colors so that sampling errors show up as mismatches.
+    for (int y = 0; y < BENCH_TEX_DIM; ++y)
+    {
+        for (int x = 0; x < BENCH_TEX_DIM; ++x)
+        {
+            const int cell = (y / 8) * (BENCH_TEX_DIM / 8) + x / 8;
+            benchTexture[ y * BENCH_TEX_DIM + x ] = (int)(0xFF000000u | ((cell * 0x9E3779B1u) & 0x00FFFFFFu) | 0x00010101u);
+        }
+    }
+
+    static const int triangleCounts[ BenchSetCount ] = { 100000, 20000, 64, 4000, 20000 };
+    BenchSet sets[ BenchSetCount ];
+
+    for (int s = 0; s < BenchSetCount; ++s)
+    {
+        benchSetInit( &sets[ s ], (BenchSetType)s, triangleCounts[ s ] );
+    }
+
+    BenchTarget reference;
+    BenchTarget target;
+    reference.pitch = WIDTH * sizeof( int );
+    target.pitch = WIDTH * sizeof( int );
+    reference.color = alignedMalloc( HEIGHT * reference.pitch, 64 );
+    target.color = alignedMalloc( HEIGHT * target.pitch, 64 );
+    depthBufferInit( &reference.depth, WIDTH, HEIGHT, DepthUnorm16 );
+    depthBufferInit( &target.depth, WIDTH, HEIGHT, DepthUnorm16 );
+
+    bool failed = false;
+
+    printf( "%-8s %-26s %8s %10s %10s %10s %10s\n", "set", "variant", "tris", "Mtris/s", "Mpix/s", "coverage", "color" );
+
+    for (int s = 0; s < BenchSetCount; ++s)
+    {
+        const BenchSet* set = &sets[ s ];
+
+        for (int v = 0; v < BENCH_VARIANT_COUNT; ++v)
+        {
+            const BenchVariant* variant = &benchVariants[ v ];
+
+            const BenchComparison comparison = benchCompare( set, variant, &reference, &target );
+            const float pixels = comparison.referencePixels > 0 ? (float)comparison.referencePixels : 1.0f;
+            const float coverageMismatch = comparison.coverageMismatches / pixels;
+            const float colorMismatch = comparison.colorMismatches / pixels;
+            const bool mismatchFailed = variant->mustMatch && (coverageMismatch > BENCH_COVERAGE_LIMIT || colorMismatch > BENCH_MISMATCH_LIMIT);
+            failed |= mismatchFailed;
+
+            const double seconds = benchTime( set, variant, &target );
+
+            printf( "%-8s %-26s %8d %10.3f %10.1f %9.2f%% %9.2f%%%s\n", set->name, variant->name, set->triangleCount,
+                    set->triangleCount / seconds * 1e-6, set->coveredPixels / seconds * 1e-6,
+                    coverageMismatch * 100.0f, colorMismatch * 100.0f, mismatchFailed ? " FAIL" : "" );
+        }
+    }
+
+    for (int s = 0; s < BenchSetCount; ++s)
+    {
+        free( sets[ s ].vertices );
+    }
+
+    alignedFree( reference.color );
+    alignedFree( target.color );
+    depthBufferFree( &reference.depth );
+    depthBufferFree( &target.depth );
+
+    return failed ? 1 : 0;
+}
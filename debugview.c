@@ -0,0 +1,165 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+// Debug views that replace the shaded frame with a cost metric mapped through a color ramp.
+// While a view is active, renderMesh() times each triangle and walks its coverage a second time,
+// so the views themselves are slow but the normal path pays nothing.
+#define DEBUG_OVERDRAW_SCALE 8 // Depth tests per pixel that map to the end of the ramp.
+
+typedef enum
+{
+    DebugViewNone = 0,
+    DebugViewOverdraw,        // Depth tests per pixel.
+    DebugViewTileCycles,      // Rasterizer cycles per tile, relative to the most expensive tile.
+    DebugViewTriangleDensity, // Triangles touching each tile, relative to the densest tile.
+    DebugViewCount
+} DebugView;
+
+static const char* debugViewNames[ DebugViewCount ] = { "none", "overdraw", "tile cycles", "triangle density" };
+
+typedef struct
+{
+    DebugView view;
+    int width;
+    int height;
+    int tileCountX;
+    int tileCountY;
+    Uint16* depthTests; // Per pixel.
+    uint64_t* tileCycles;
+    Uint32* tileTriangles;
+    int* tilePixels; // Covered pixels of the current triangle per tile.
+} DebugViews;
+
+// Cycle counter for profiling. Falls back to the performance counter where rdtsc is not available.
+FORCE_INLINE uint64_t readCycleCounter( void )
+{
+#ifdef ARCH_X64
+    return __rdtsc();
+#else
+    return SDL_GetPerformanceCounter();
+#endif
+}
+
+void debugViewsInit( DebugViews* debug, int width, int height )
+{
+    debug->view = DebugViewNone;
+    debug->width = width;
+    debug->height = height;
+    debug->tileCountX = (width + TILE_SIZE - 1) / TILE_SIZE;
+    debug->tileCountY = (height + TILE_SIZE - 1) / TILE_SIZE;
+    debug->depthTests = malloc( width * height * sizeof( Uint16 ) );
+    debug->tileCycles = malloc( debug->tileCountX * debug->tileCountY * sizeof( uint64_t ) );
+    debug->tileTriangles = malloc( debug->tileCountX * debug->tileCountY * sizeof( Uint32 ) );
+    debug->tilePixels = malloc( debug->tileCountX * debug->tileCountY * sizeof( int ) );
+}
+
+void debugViewsFree( DebugViews* debug )
+{
+    free( debug->depthTests );
+    free( debug->tileCycles );
+    free( debug->tileTriangles );
+    free( debug->tilePixels );
+    debug->depthTests = NULL;
+    debug->tileCycles = NULL;
+    debug->tileTriangles = NULL;
+    debug->tilePixels = NULL;
+}
+
+void debugViewsBeginFrame( DebugViews* debug )
+{
+    if (debug->view == DebugViewNone)
+    {
+        return;
+    }
+
+    const int tileCount = debug->tileCountX * debug->tileCountY;
+    memset( debug->depthTests, 0, debug->width * debug->height * sizeof( Uint16 ) );
+    memset( debug->tileCycles, 0, tileCount * sizeof( uint64_t ) );
+    memset( debug->tileTriangles, 0, tileCount * sizeof( Uint32 ) );
+    memset( debug->tilePixels, 0, tileCount * sizeof( int ) );
+}
+
+// Counts pixel (x, y) as covered by the triangle being recorded, see debugViewsAddTriangle().
+FORCE_INLINE void debugViewsAddPixel( DebugViews* debug, int x, int y )
+{
+    Uint16* depthTests = &debug->depthTests[ y * debug->width + x ];
+    *depthTests = (Uint16)mini( *depthTests + 1, 0xFFFF );
+    ++debug->tilePixels[ (y / TILE_SIZE) * debug->tileCountX + x / TILE_SIZE ];
+}
+
+// Finishes a triangle whose coveredPixels pixels within the bounds were added with debugViewsAddPixel() and that
+// took cycles to rasterize. Cycles are split between tiles by covered pixel count.
+void debugViewsEndTriangle( DebugViews* debug, int minx, int miny, int maxx, int maxy, int coveredPixels, uint64_t cycles )
+{
+    for (int tileY = miny / TILE_SIZE; tileY <= maxy / TILE_SIZE; ++tileY)
+    {
+        for (int tileX = minx / TILE_SIZE; tileX <= maxx / TILE_SIZE; ++tileX)
+        {
+            int* tilePixels = &debug->tilePixels[ tileY * debug->tileCountX + tileX ];
+
+            if (*tilePixels != 0)
+            {
+                debug->tileCycles[ tileY * debug->tileCountX + tileX ] += cycles * (uint64_t)*tilePixels / (uint64_t)coveredPixels;
+                ++debug->tileTriangles[ tileY * debug->tileCountX + tileX ];
+                *tilePixels = 0;
+            }
+        }
+    }
+}
+
+// Maps t in [0, 1] through black, blue, cyan, green, yellow, red and white.
+int debugRamp( float t )
+{
+    static const float stops[][ 3 ] =
+    {
+        { 0, 0, 0 }, { 0, 0, 1 }, { 0, 1, 1 }, { 0, 1, 0 }, { 1, 1, 0 }, { 1, 0, 0 }, { 1, 1, 1 }
+    };
+    const int lastStop = sizeof( stops ) / sizeof( stops[ 0 ] ) - 1;
+
+    t = fmaxf( 0, fminf( t, 1 ) ) * lastStop;
+    const int i = mini( (int)t, lastStop - 1 );
+    const float f = t - i;
+
+    const int r = (int)((stops[ i ][ 0 ] + (stops[ i + 1 ][ 0 ] - stops[ i ][ 0 ]) * f) * 255.0f);
+    const int g = (int)((stops[ i ][ 1 ] + (stops[ i + 1 ][ 1 ] - stops[ i ][ 1 ]) * f) * 255.0f);
+    const int b = (int)((stops[ i ][ 2 ] + (stops[ i + 1 ][ 2 ] - stops[ i ][ 2 ]) * f) * 255.0f);
+
+    return (int)0xFF000000 | (r << 16) | (g << 8) | b;
+}
+
+// Overwrites fb's color buffer with the active view. Call after framebufferResolve().
+void debugViewsResolve( const DebugViews* debug, Framebuffer* fb )
+{
+    if (debug->view == DebugViewNone)
+    {
+        return;
+    }
+
+    uint64_t maxTileValue = 1;
+
+    for (int i = 0; i < debug->tileCountX * debug->tileCountY; ++i)
+    {
+        const uint64_t value = debug->view == DebugViewTileCycles ? debug->tileCycles[ i ] : debug->tileTriangles[ i ];
+        maxTileValue = value > maxTileValue ? value : maxTileValue;
+    }
+
+    for (int y = 0; y < fb->height; ++y)
+    {
+        int* row = (int*)((Uint8*)fb->colorBuffer + y * fb->colorPitch);
+
+        for (int x = 0; x < fb->width; ++x)
+        {
+            const int tile = (y / TILE_SIZE) * debug->tileCountX + x / TILE_SIZE;
+            float t;
+
+            switch (debug->view)
+            {
+            case DebugViewOverdraw:   t = debug->depthTests[ y * debug->width + x ] / (float)DEBUG_OVERDRAW_SCALE; break;
+            case DebugViewTileCycles: t = debug->tileCycles[ tile ] / (float)maxTileValue; break;
+            default:                  t = debug->tileTriangles[ tile ] / (float)maxTileValue; break;
+            }
+
+            row[ x ] = debugRamp( t );
+        }
+    }
+}
@@ -0,0 +1,454 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+// Framebuffer is split into TILE_SIZE x TILE_SIZE tiles that are cleared lazily.
+// Clearing a frame only resets the per-tile state array, and a tile's color and depth
+// are written with clear values the first time a triangle touches it. Tiles that are
+// never touched never get their depth written, and their color is only filled in resolve.
+//
+// With multisampling, depth is stored per sample and color is compressed per tile: a tile keeps one
+// color per pixel in colorBuffer until a triangle covers a pixel partially. The tile is then expanded
+// into per-sample colors, and framebufferResolve() averages them back into colorBuffer. Tile interiors
+// that are fully covered by triangles stay at 1x color bandwidth.
+//
+// Depth is not compressed and costs sampleCount times the bandwidth of 1x, also in interior tiles.
+// A single depth per pixel can't be expanded later without a plane equation per pixel, because samples
+// of one pixel have different depths where triangles intersect, and storing planes costs more than 4 samples.
+#define TILE_SIZE 32
+#define MAX_SAMPLES 4
+
+// Depth is stored reversed: 0 is infinitely far and 1 is at z == DEPTH_NEAR_Z. Greater values pass the depth test.
+// Rasterizers write DEPTH_NEAR_Z / z interpolated linearly in screen space, clamped to [0, 1] for unorm formats.
+#define DEPTH_NEAR_Z 0.1f
+
+// For buffers that are streamed through in pixel loops. alignment must be a power of two.
+void* alignedMalloc( size_t size, size_t alignment )
+{
+#if _MSC_VER
+    return _aligned_malloc( size, alignment );
+#else
+    // aligned_alloc() requires size to be a multiple of alignment.
+    return aligned_alloc( alignment, (size + alignment - 1) & ~(alignment - 1) );
+#endif
+}
+
+void alignedFree( void* ptr )
+{
+#if _MSC_VER
+    _aligned_free( ptr );
+#else
+    free( ptr );
+#endif
+}
+
+typedef enum
+{
+    DepthFloat32 = 0,
+    DepthUnorm24, // Low 24 bits of a 32-bit word.
+    DepthUnorm16,
+    DepthFormatCount
+} DepthFormat;
+
+typedef struct
+{
+    void* data;
+    int pitch; // In bytes, independent of the color buffer's pitch.
+    int width;
+    int height;
+    DepthFormat format;
+} DepthBuffer;
+
+int depthFormatBytes( DepthFormat format )
+{
+    return format == DepthUnorm16 ? 2 : 4;
+}
+
+void depthBufferInit( DepthBuffer* depth, int width, int height, DepthFormat format )
+{
+    depth->width = width;
+    depth->height = height;
+    depth->format = format;
+    // Rows start at cache line boundaries.
+    depth->pitch = (width * depthFormatBytes( format ) + 63) & ~63;
+    depth->data = alignedMalloc( (size_t)depth->pitch * height, 64 );
+}
+
+void depthBufferFree( DepthBuffer* depth )
+{
+    alignedFree( depth->data );
+    depth->data = NULL;
+}
+
+FORCE_INLINE Uint8* depthBufferRow( const DepthBuffer* depth, int y )
+{
+    return (Uint8*)depth->data + y * depth->pitch;
+}
+
+FORCE_INLINE unsigned depthToUnorm( float depth, unsigned maxValue )
+{
+    depth = depth < 0 ? 0 : (depth > 1 ? 1 : depth);
+    return (unsigned)(depth * (float)maxValue + 0.5f);
+}
+
+// format should be a compile-time constant in inner loops so that the switch is folded away.
+FORCE_INLINE float depthRead( const DepthFormat format, const Uint8* row, int x )
+{
+    switch (format)
+    {
+    case DepthUnorm24: return (float)((const Uint32*)row)[ x ] * (1.0f / 0xFFFFFF);
+    case DepthUnorm16: return (float)((const Uint16*)row)[ x ] * (1.0f / 0xFFFF);
+    default:           return ((const float*)row)[ x ];
+    }
+}
+
+// Returns true and stores depth if it's closer than the stored value.
+FORCE_INLINE bool depthTestAndWrite( const DepthFormat format, Uint8* row, int x, float depth )
+{
+    if (format == DepthUnorm24)
+    {
+        const Uint32 d = depthToUnorm( depth, 0xFFFFFF );
+        if (d <= ((Uint32*)row)[ x ]) return false;
+        ((Uint32*)row)[ x ] = d;
+        return true;
+    }
+
+    if (format == DepthUnorm16)
+    {
+        const Uint16 d = (Uint16)depthToUnorm( depth, 0xFFFF );
+        if (d <= ((Uint16*)row)[ x ]) return false;
+        ((Uint16*)row)[ x ] = d;
+        return true;
+    }
+
+    if (depth <= ((float*)row)[ x ]) return false;
+    ((float*)row)[ x ] = depth;
+    return true;
+}
+
+// Like depthTestAndWrite() but leaves the stored value untouched.
+FORCE_INLINE bool depthTest( const DepthFormat format, const Uint8* row, int x, float depth )
+{
+    switch (format)
+    {
+    case DepthUnorm24: return depthToUnorm( depth, 0xFFFFFF ) > ((const Uint32*)row)[ x ];
+    case DepthUnorm16: return depthToUnorm( depth, 0xFFFF ) > ((const Uint16*)row)[ x ];
+    default:           return depth > ((const float*)row)[ x ];
+    }
+}
+
+FORCE_INLINE void depthWrite( const DepthFormat format, Uint8* row, int x, float depth )
+{
+    switch (format)
+    {
+    case DepthUnorm24: ((Uint32*)row)[ x ] = depthToUnorm( depth, 0xFFFFFF ); break;
+    case DepthUnorm16: ((Uint16*)row)[ x ] = (Uint16)depthToUnorm( depth, 0xFFFF ); break;
+    default:           ((float*)row)[ x ] = depth; break;
+    }
+}
+
+#ifdef ARCH_X64
+// depthTest() for pixels [x, x + count), count <= 4. Returns all ones in passing lanes, lanes past count fail.
+FORCE_INLINE __m128i depthTest4( const DepthFormat format, const Uint8* row, int x, int count, __m128 depth )
+{
+    const __m128i inRange = _mm_cmplt_epi32( _mm_setr_epi32( 0, 1, 2, 3 ), _mm_set1_epi32( count ) );
+
+    if (format == DepthFloat32)
+    {
+        float stored[ 4 ] = { 0 };
+        memcpy( stored, &((const float*)row)[ x ], count * sizeof( float ) );
+        return _mm_and_si128( inRange, _mm_castps_si128( _mm_cmpgt_ps( depth, _mm_loadu_ps( stored ) ) ) );
+    }
+
+    const float maxValue = format == DepthUnorm24 ? (float)0xFFFFFF : (float)0xFFFF;
+    const __m128 clamped = _mm_min_ps( _mm_max_ps( depth, _mm_setzero_ps() ), _mm_set1_ps( 1.0f ) );
+    // Same rounding as depthToUnorm(). Values are below 2^24, so signed compares are fine.
+    const __m128i encoded = _mm_cvttps_epi32( _mm_add_ps( _mm_mul_ps( clamped, _mm_set1_ps( maxValue ) ), _mm_set1_ps( 0.5f ) ) );
+
+    Uint32 stored[ 4 ] = { 0 };
+
+    if (format == DepthUnorm24)
+    {
+        memcpy( stored, &((const Uint32*)row)[ x ], count * sizeof( Uint32 ) );
+    }
+    else
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            stored[ i ] = ((const Uint16*)row)[ x + i ];
+        }
+    }
+
+    return _mm_and_si128( inRange, _mm_cmpgt_epi32( encoded, _mm_loadu_si128( (const __m128i*)stored ) ) );
+}
+#endif
+
+// Fills pixels [x0, x1) x [y0, y1).
+void depthBufferFill( DepthBuffer* depth, int x0, int y0, int x1, int y1, float value )
+{
+    for (int y = y0; y < y1; ++y)
+    {
+        Uint8* row = depthBufferRow( depth, y );
+
+        for (int x = x0; x < x1; ++x)
+        {
+            depthWrite( depth->format, row, x, value );
+        }
+    }
+}
+
+enum TileState
+{
+    TileCleared      = 0,      // Logically cleared, memory not written yet this frame.
+    TileDirty        = 1 << 0, // Materialized and possibly drawn into this frame.
+    TileMultisampled = 1 << 1  // Colors are in sampleColors, see framebufferExpandTile().
+};
+
+// Sample positions relative to the pixel's sampling point, in 1/16 pixels. Same rotated grid as D3D's standard 4x pattern.
+static const int msaaSampleOffsets[ MAX_SAMPLES ][ 2 ] = { { -2, -6 }, { 6, -2 }, { -6, 2 }, { 2, 6 } };
+
+typedef struct
+{
+    int* colorBuffer;
+    int colorPitch; // In bytes.
+    DepthBuffer depth; // Stores sampleCount consecutive values per pixel in every tile, see the comment at the top.
+    int* sampleColors; // MAX_SAMPLES colors per pixel, only valid in TileMultisampled tiles.
+    int sampleColorPitch; // In bytes.
+    int sampleCount; // 1 or MAX_SAMPLES.
+    int width; // Render size, see framebufferSetSize().
+    int height;
+    int maxWidth; // Allocated size.
+    int maxHeight;
+    int clearColor;
+    float clearDepth;
+    unsigned char* tileStates;
+    int tileCountX;
+    int tileCountY;
+} Framebuffer;
+
+// Allocates the depth buffer and tile state array for width x height, the largest render size.
+// Color buffer is set per frame in framebufferBeginFrame(). sampleCount is 1 or MAX_SAMPLES.
+void framebufferInit( Framebuffer* fb, int width, int height, DepthFormat depthFormat, int sampleCount )
+{
+    assert( (sampleCount == 1 || sampleCount == MAX_SAMPLES) && "unsupported sample count" );
+
+    fb->colorBuffer = NULL;
+    fb->colorPitch = width * 4;
+    depthBufferInit( &fb->depth, width * sampleCount, height, depthFormat );
+    fb->sampleCount = sampleCount;
+    fb->sampleColorPitch = width * MAX_SAMPLES * 4;
+    fb->sampleColors = sampleCount > 1 ? alignedMalloc( (size_t)fb->sampleColorPitch * height, 64 ) : NULL;
+    fb->width = width;
+    fb->height = height;
+    fb->maxWidth = width;
+    fb->maxHeight = height;
+    fb->clearColor = 0;
+    fb->clearDepth = 0;
+    fb->tileCountX = (width + TILE_SIZE - 1) / TILE_SIZE;
+    fb->tileCountY = (height + TILE_SIZE - 1) / TILE_SIZE;
+    fb->tileStates = malloc( fb->tileCountX * fb->tileCountY );
+    memset( fb->tileStates, TileCleared, fb->tileCountX * fb->tileCountY );
+}
+
+void framebufferFree( Framebuffer* fb )
+{
+    depthBufferFree( &fb->depth );
+    alignedFree( fb->sampleColors );
+    fb->sampleColors = NULL;
+    free( fb->tileStates );
+    fb->tileStates = NULL;
+}
+
+// Renders into the top-left width x height pixels from now on, without reallocating.
+// Must be at most the size given to framebufferInit(). Pitches stay the same.
+void framebufferSetSize( Framebuffer* fb, int width, int height )
+{
+    assert( width <= fb->maxWidth && height <= fb->maxHeight && "framebuffer is smaller than the render size" );
+
+    fb->width = width;
+    fb->height = height;
+    fb->depth.width = width * fb->sampleCount;
+    fb->depth.height = height;
+    fb->tileCountX = (width + TILE_SIZE - 1) / TILE_SIZE;
+    fb->tileCountY = (height + TILE_SIZE - 1) / TILE_SIZE;
+    memset( fb->tileStates, TileCleared, fb->tileCountX * fb->tileCountY );
+}
+
+// Replaces full-screen memsets. colorBuffer can change every frame (eg. SDL_LockTexture).
+void framebufferBeginFrame( Framebuffer* fb, int* colorBuffer, int colorPitch )
+{
+    memset( fb->tileStates, TileCleared, fb->tileCountX * fb->tileCountY );
+    fb->colorBuffer = colorBuffer;
+    fb->colorPitch = colorPitch;
+}
+
+void framebufferFillColor( Framebuffer* fb, int x0, int y0, int x1, int y1 )
+{
+    for (int y = y0; y < y1; ++y)
+    {
+        int* row = (int*)((Uint8*)fb->colorBuffer + y * fb->colorPitch);
+
+        for (int x = x0; x < x1; ++x)
+        {
+            row[ x ] = fb->clearColor;
+        }
+    }
+}
+
+void framebufferMaterializeTile( Framebuffer* fb, int tileX, int tileY )
+{
+    unsigned char* state = &fb->tileStates[ tileY * fb->tileCountX + tileX ];
+
+    const int x0 = tileX * TILE_SIZE;
+    const int y0 = tileY * TILE_SIZE;
+    const int x1 = mini( x0 + TILE_SIZE, fb->width );
+    const int y1 = mini( y0 + TILE_SIZE, fb->height );
+
+    framebufferFillColor( fb, x0, y0, x1, y1 );
+    depthBufferFill( &fb->depth, x0 * fb->sampleCount, y0, x1 * fb->sampleCount, y1, fb->clearDepth );
+
+    *state = TileDirty;
+}
+
+// Must be called before drawing into the pixel rectangle [minx, maxx] x [miny, maxy] (inclusive).
+void framebufferTouch( Framebuffer* fb, int minx, int miny, int maxx, int maxy )
+{
+    minx = maxi( minx, 0 );
+    miny = maxi( miny, 0 );
+    maxx = mini( maxx, fb->width - 1 );
+    maxy = mini( maxy, fb->height - 1 );
+
+    if (minx > maxx || miny > maxy)
+    {
+        return;
+    }
+
+    for (int tileY = miny / TILE_SIZE; tileY <= maxy / TILE_SIZE; ++tileY)
+    {
+        for (int tileX = minx / TILE_SIZE; tileX <= maxx / TILE_SIZE; ++tileX)
+        {
+            if (!(fb->tileStates[ tileY * fb->tileCountX + tileX ] & TileDirty))
+            {
+                framebufferMaterializeTile( fb, tileX, tileY );
+            }
+        }
+    }
+}
+
+FORCE_INLINE int* framebufferSamples( const Framebuffer* fb, int x, int y )
+{
+    return (int*)((Uint8*)fb->sampleColors + y * fb->sampleColorPitch) + x * MAX_SAMPLES;
+}
+
+// Replicates each pixel's color into its samples. Must be called before writing a partially covered pixel in a tile that isn't TileMultisampled.
+void framebufferExpandTile( Framebuffer* fb, int tileX, int tileY )
+{
+    const int x0 = tileX * TILE_SIZE;
+    const int y0 = tileY * TILE_SIZE;
+    const int x1 = mini( x0 + TILE_SIZE, fb->width );
+    const int y1 = mini( y0 + TILE_SIZE, fb->height );
+
+    for (int y = y0; y < y1; ++y)
+    {
+        const int* row = (const int*)((const Uint8*)fb->colorBuffer + y * fb->colorPitch);
+        int* samples = framebufferSamples( fb, 0, y );
+
+        for (int x = x0; x < x1; ++x)
+        {
+#ifdef ARCH_X64
+            _mm_storeu_si128( (__m128i*)&samples[ x * MAX_SAMPLES ], _mm_set1_epi32( row[ x ] ) );
+#else
+            for (int s = 0; s < MAX_SAMPLES; ++s)
+            {
+                samples[ x * MAX_SAMPLES + s ] = row[ x ];
+            }
+#endif
+        }
+    }
+
+    fb->tileStates[ tileY * fb->tileCountX + tileX ] |= TileMultisampled;
+}
+
+// Averages the samples of a TileMultisampled tile into colorBuffer.
+void framebufferResolveTile( Framebuffer* fb, int tileX, int tileY )
+{
+    const int x0 = tileX * TILE_SIZE;
+    const int y0 = tileY * TILE_SIZE;
+    const int x1 = mini( x0 + TILE_SIZE, fb->width );
+    const int y1 = mini( y0 + TILE_SIZE, fb->height );
+
+    for (int y = y0; y < y1; ++y)
+    {
+        int* row = (int*)((Uint8*)fb->colorBuffer + y * fb->colorPitch);
+        const int* samples = framebufferSamples( fb, 0, y );
+        int x = x0;
+
+#ifdef ARCH_X64
+        for (; x + 4 <= x1; x += 4)
+        {
+            // Transposes 4 pixels x 4 samples so that each register holds one sample of every pixel.
+            __m128 p0 = _mm_castsi128_ps( _mm_loadu_si128( (const __m128i*)&samples[ (x + 0) * MAX_SAMPLES ] ) );
+            __m128 p1 = _mm_castsi128_ps( _mm_loadu_si128( (const __m128i*)&samples[ (x + 1) * MAX_SAMPLES ] ) );
+            __m128 p2 = _mm_castsi128_ps( _mm_loadu_si128( (const __m128i*)&samples[ (x + 2) * MAX_SAMPLES ] ) );
+            __m128 p3 = _mm_castsi128_ps( _mm_loadu_si128( (const __m128i*)&samples[ (x + 3) * MAX_SAMPLES ] ) );
+            _MM_TRANSPOSE4_PS( p0, p1, p2, p3 );
+
+            // Averages in the stored 8-bit encoding, like a UNORM render target. Channels are widened to 16 bits
+            // so that the sum is rounded once, like the scalar loop.
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i s0 = _mm_castps_si128( p0 ), s1 = _mm_castps_si128( p1 ), s2 = _mm_castps_si128( p2 ), s3 = _mm_castps_si128( p3 );
+            __m128i sumLo = _mm_add_epi16( _mm_add_epi16( _mm_unpacklo_epi8( s0, zero ), _mm_unpacklo_epi8( s1, zero ) ),
+                                           _mm_add_epi16( _mm_unpacklo_epi8( s2, zero ), _mm_unpacklo_epi8( s3, zero ) ) );
+            __m128i sumHi = _mm_add_epi16( _mm_add_epi16( _mm_unpackhi_epi8( s0, zero ), _mm_unpackhi_epi8( s1, zero ) ),
+                                           _mm_add_epi16( _mm_unpackhi_epi8( s2, zero ), _mm_unpackhi_epi8( s3, zero ) ) );
+            sumLo = _mm_srli_epi16( _mm_add_epi16( sumLo, _mm_set1_epi16( MAX_SAMPLES / 2 ) ), 2 );
+            sumHi = _mm_srli_epi16( _mm_add_epi16( sumHi, _mm_set1_epi16( MAX_SAMPLES / 2 ) ), 2 );
+            _mm_storeu_si128( (__m128i*)&row[ x ], _mm_packus_epi16( sumLo, sumHi ) );
+        }
+#endif
+        for (; x < x1; ++x)
+        {
+            unsigned result = 0;
+
+            for (int shift = 0; shift < 32; shift += 8)
+            {
+                unsigned sum = 0;
+
+                for (int s = 0; s < MAX_SAMPLES; ++s)
+                {
+                    sum += ((unsigned)samples[ x * MAX_SAMPLES + s ] >> shift) & 0xFF;
+                }
+
+                result |= ((sum + MAX_SAMPLES / 2) / MAX_SAMPLES) << shift;
+            }
+
+            row[ x ] = (int)result;
+        }
+    }
+}
+
+// Writes clear color into tiles that were not drawn into and resolves multisampled tiles. Must be called before presenting colorBuffer.
+void framebufferResolve( Framebuffer* fb )
+{
+    for (int tileY = 0; tileY < fb->tileCountY; ++tileY)
+    {
+        for (int tileX = 0; tileX < fb->tileCountX; ++tileX)
+        {
+            unsigned char* state = &fb->tileStates[ tileY * fb->tileCountX + tileX ];
+
+            if (*state & TileMultisampled)
+            {
+                framebufferResolveTile( fb, tileX, tileY );
+                continue;
+            }
+
+            if (*state & TileDirty)
+            {
+                continue;
+            }
+
+            const int x0 = tileX * TILE_SIZE;
+            const int y0 = tileY * TILE_SIZE;
+            framebufferFillColor( fb, x0, y0, mini( x0 + TILE_SIZE, fb->width ), mini( y0 + TILE_SIZE, fb->height ) );
+        }
+    }
+}
@@ -0,0 +1,396 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+// Work-stealing job system. Every thread owns a deque of jobs: it pushes and pops at the bottom,
+// idle threads steal from the top of the others' deques, so a thread works on its most recent
+// (cache-warm) jobs while thieves take the oldest, largest chunks. Deques are guarded by spinlocks,
+// which are held for a handful of instructions and rarely contended.
+//
+// Completion is tracked with counters: jobsSubmit() increments one, finishing the job decrements it.
+// jobsWait() runs queued jobs until the counter reaches zero, so jobs can wait for other jobs
+// (dependencies) without blocking a worker. Thread 0 is the thread that called jobsInit().
+//
+// Each thread also has a scratch arena for temporary memory of the jobs it runs, see jobsScratch().
+//
+// Idle workers sleep on a semaphore. A submit only posts it when it can claim a sleeping worker, so jobs
+// that the submitting thread runs itself don't leave posts behind that would wake workers for nothing.
+#define MAX_JOB_THREADS 64
+#define JOB_QUEUE_SIZE 4096 // Jobs per thread, power of two.
+#define JOB_SCRATCH_SIZE (256 * 1024) // Initial scratch arena size per thread.
+
+#if _MSC_VER
+#define JOB_THREAD_LOCAL __declspec( thread )
+#else
+#define JOB_THREAD_LOCAL _Thread_local
+#endif
+
+// Processes items [begin, end) of data.
+typedef void (*JobFunc)( void* data, unsigned begin, unsigned end );
+
+typedef struct
+{
+    JobFunc func;
+    void* data;
+    unsigned begin;
+    unsigned end;
+    SDL_atomic_t* counter;
+    const char* name; // Trace event name, must be a string literal.
+} Job;
+
+typedef struct
+{
+    Job jobs[ JOB_QUEUE_SIZE ];
+    unsigned top;    // Oldest job, stolen next.
+    unsigned bottom; // One past the newest job.
+    SDL_SpinLock lock;
+    Arena scratch; // Only used by the owning thread.
+} JobQueue;
+
+typedef struct
+{
+    JobQueue* queues; // One per thread.
+    SDL_Thread* threads[ MAX_JOB_THREADS ];
+    int threadCount;  // Workers plus the thread that called jobsInit().
+    SDL_sem* wakeup;  // Posted once per claimed sleeping worker, see jobsClaimSleeper().
+    SDL_atomic_t sleepingWorkers; // Workers about to wait on wakeup that no submit has claimed yet.
+    int cpus[ MAX_JOB_THREADS ]; // CPUs the process was allowed to run on at jobsInit(), thread i is pinned to cpus[ i % cpuCount ].
+    int cpuCount;     // 0 if unknown, then threads aren't pinned.
+    SDL_atomic_t startedThreads;
+    SDL_atomic_t quit;
+} JobSystem;
+
+// Index of the calling thread in its job system, -1 if it doesn't belong to one.
+static JOB_THREAD_LOCAL int jobThreadIndex = -1;
+
+// Writes up to maxCount CPUs of the calling thread's affinity mask, which it inherited from the process unless it was changed.
+// Returns their count, 0 where the mask can't be read.
+static int jobsAllowedCpus( int* outCpus, int maxCount )
+{
+    int count = 0;
+#if defined( __linux__ )
+    cpu_set_t set;
+    CPU_ZERO( &set );
+
+    if (pthread_getaffinity_np( pthread_self(), sizeof( set ), &set ) == 0)
+    {
+        for (int cpu = 0; cpu < CPU_SETSIZE && count < maxCount; ++cpu)
+        {
+            if (CPU_ISSET( cpu, &set ))
+            {
+                outCpus[ count++ ] = cpu;
+            }
+        }
+    }
+#elif defined( _WIN32 )
+    DWORD_PTR processMask = 0;
+    DWORD_PTR systemMask = 0;
+
+    if (GetProcessAffinityMask( GetCurrentProcess(), &processMask, &systemMask ))
+    {
+        for (int cpu = 0; cpu < (int)(sizeof( DWORD_PTR ) * 8) && count < maxCount; ++cpu)
+        {
+            if (processMask & ((DWORD_PTR)1 << cpu))
+            {
+                outCpus[ count++ ] = cpu;
+            }
+        }
+    }
+#else
+    (void)outCpus;
+    (void)maxCount;
+#endif
+    return count;
+}
+
+// Binds the calling thread to a core so the scheduler doesn't migrate it away from its caches.
+static void jobsPinThread( int core )
+{
+#if defined( __linux__ )
+    cpu_set_t set;
+    CPU_ZERO( &set );
+    CPU_SET( core, &set );
+    pthread_setaffinity_np( pthread_self(), sizeof( set ), &set );
+#elif defined( _WIN32 )
+    SetThreadAffinityMask( GetCurrentThread(), (DWORD_PTR)1 << core );
+#else
+    // macOS only has affinity hints, threads stay unpinned.
+    (void)core;
+#endif
+}
+
+static bool jobsPop( JobQueue* queue, Job* outJob )
+{
+    bool found = false;
+    SDL_AtomicLock( &queue->lock );
+
+    if (queue->bottom != queue->top)
+    {
+        --queue->bottom;
+        *outJob = queue->jobs[ queue->bottom & (JOB_QUEUE_SIZE - 1) ];
+        found = true;
+    }
+
+    SDL_AtomicUnlock( &queue->lock );
+    return found;
+}
+
+static bool jobsSteal( JobQueue* queue, Job* outJob )
+{
+    bool found = false;
+    SDL_AtomicLock( &queue->lock );
+
+    if (queue->bottom != queue->top)
+    {
+        *outJob = queue->jobs[ queue->top & (JOB_QUEUE_SIZE - 1) ];
+        ++queue->top;
+        found = true;
+    }
+
+    SDL_AtomicUnlock( &queue->lock );
+    return found;
+}
+
+static void jobsExecute( const Job* job )
+{
+    TRACE_BEGIN( job->name );
+    job->func( job->data, job->begin, job->end );
+    TRACE_END( job->name );
+
+    // Publishes the job's writes to the thread waiting for the counter.
+    SDL_AtomicAdd( job->counter, -1 );
+}
+
+// Runs one job of thread's own deque or, if it's empty, one stolen from another thread. Returns false if there was no work.
+static bool jobsRunOne( JobSystem* jobs, int thread )
+{
+    Job job;
+
+    if (jobsPop( &jobs->queues[ thread ], &job ))
+    {
+        jobsExecute( &job );
+        return true;
+    }
+
+    for (int i = 1; i < jobs->threadCount; ++i)
+    {
+        if (jobsSteal( &jobs->queues[ (thread + i) % jobs->threadCount ], &job ))
+        {
+            jobsExecute( &job );
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Returns true if any deque has a job.
+static bool jobsHasWork( JobSystem* jobs )
+{
+    for (int i = 0; i < jobs->threadCount; ++i)
+    {
+        JobQueue* queue = &jobs->queues[ i ];
+        SDL_AtomicLock( &queue->lock );
+        const bool empty = queue->bottom == queue->top;
+        SDL_AtomicUnlock( &queue->lock );
+
+        if (!empty)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Takes one worker off sleepingWorkers. Returns false if none was left. The caller owes the claimed worker a post of wakeup.
+static bool jobsClaimSleeper( JobSystem* jobs )
+{
+    for (;;)
+    {
+        const int sleeping = SDL_AtomicGet( &jobs->sleepingWorkers );
+
+        if (sleeping <= 0)
+        {
+            return false;
+        }
+
+        if (SDL_AtomicCAS( &jobs->sleepingWorkers, sleeping, sleeping - 1 ))
+        {
+            return true;
+        }
+    }
+}
+
+static int jobsWorkerThread( void* data )
+{
+    JobSystem* jobs = (JobSystem*)data;
+    const int thread = SDL_AtomicAdd( &jobs->startedThreads, 1 );
+    jobThreadIndex = thread;
+
+    if (jobs->cpuCount > 0)
+    {
+        jobsPinThread( jobs->cpus[ thread % jobs->cpuCount ] );
+    }
+
+    traceSetThreadName( "worker" );
+
+    while (!SDL_AtomicGet( &jobs->quit ))
+    {
+        if (jobsRunOne( jobs, thread ))
+        {
+            continue;
+        }
+
+        // Registers before checking the deques again: a job pushed after the check sees the registration and posts.
+        SDL_AtomicAdd( &jobs->sleepingWorkers, 1 );
+
+        // If a submit claimed this worker in the meantime, its post must be consumed even though there is work.
+        if (!jobsHasWork( jobs ) || !jobsClaimSleeper( jobs ))
+        {
+            SDL_SemWait( jobs->wakeup );
+        }
+    }
+
+    return 0;
+}
+
+// Starts workerCount worker threads, 0 runs all jobs on the calling thread.
+// Use SDL_GetCPUCount() - 1 to have one thread per core.
+void jobsInit( JobSystem* jobs, int workerCount )
+{
+    workerCount = maxi( 0, mini( workerCount, MAX_JOB_THREADS - 1 ) );
+
+    jobs->threadCount = workerCount + 1;
+    jobs->queues = calloc( jobs->threadCount, sizeof( JobQueue ) );
+    jobs->wakeup = SDL_CreateSemaphore( 0 );
+    SDL_AtomicSet( &jobs->sleepingWorkers, 0 );
+    SDL_AtomicSet( &jobs->startedThreads, 1 );
+    SDL_AtomicSet( &jobs->quit, 0 );
+
+    for (int i = 0; i < jobs->threadCount; ++i)
+    {
+        arenaInit( &jobs->queues[ i ].scratch, JOB_SCRATCH_SIZE );
+    }
+
+    // Read before pinning the calling thread, the workers inherit its affinity.
+    jobs->cpuCount = jobsAllowedCpus( jobs->cpus, MAX_JOB_THREADS );
+    jobThreadIndex = 0;
+
+    if (jobs->cpuCount > 0)
+    {
+        jobsPinThread( jobs->cpus[ 0 ] );
+    }
+
+    for (int i = 0; i < workerCount; ++i)
+    {
+        jobs->threads[ i ] = SDL_CreateThread( jobsWorkerThread, "worker", jobs );
+    }
+}
+
+// Must be called when no jobs are in flight.
+void jobsShutdown( JobSystem* jobs )
+{
+    SDL_AtomicSet( &jobs->quit, 1 );
+
+    for (int i = 1; i < jobs->threadCount; ++i)
+    {
+        SDL_SemPost( jobs->wakeup );
+    }
+
+    for (int i = 1; i < jobs->threadCount; ++i)
+    {
+        SDL_WaitThread( jobs->threads[ i - 1 ], NULL );
+    }
+
+    for (int i = 0; i < jobs->threadCount; ++i)
+    {
+        arenaFree( &jobs->queues[ i ].scratch );
+    }
+
+    SDL_DestroySemaphore( jobs->wakeup );
+    free( jobs->queues );
+    jobs->queues = NULL;
+    jobThreadIndex = -1;
+}
+
+// Queues func( data, begin, end ) and increments counter. Must be called from a thread of the job system.
+// If the calling thread's deque is full, the job runs immediately.
+void jobsSubmit( JobSystem* jobs, const char* name, JobFunc func, void* data, unsigned begin, unsigned end, SDL_atomic_t* counter )
+{
+    assert( jobThreadIndex >= 0 && jobThreadIndex < jobs->threadCount && "jobs can only be submitted from job system threads" );
+
+    const Job job = { func, data, begin, end, counter, name };
+    JobQueue* queue = &jobs->queues[ jobThreadIndex ];
+    SDL_AtomicAdd( counter, 1 );
+    SDL_AtomicLock( &queue->lock );
+
+    if (queue->bottom - queue->top < JOB_QUEUE_SIZE)
+    {
+        queue->jobs[ queue->bottom & (JOB_QUEUE_SIZE - 1) ] = job;
+        ++queue->bottom;
+        SDL_AtomicUnlock( &queue->lock );
+
+        if (jobsClaimSleeper( jobs ))
+        {
+            SDL_SemPost( jobs->wakeup );
+        }
+    }
+    else
+    {
+        SDL_AtomicUnlock( &queue->lock );
+        jobsExecute( &job );
+    }
+}
+
+// Temporary memory of the calling thread. Jobs take an arenaMark() when they start and arenaRelease() it before
+// they return, which keeps the arena a stack even when a waiting job runs others. Must be called from a thread of the job system.
+Arena* jobsScratch( JobSystem* jobs )
+{
+    assert( jobThreadIndex >= 0 && jobThreadIndex < jobs->threadCount && "scratch arenas belong to job system threads" );
+    return &jobs->queues[ jobThreadIndex ].scratch;
+}
+
+// Lets the scratch arenas settle into single blocks. Must be called when no jobs are in flight, eg. between frames.
+void jobsResetScratch( JobSystem* jobs )
+{
+    for (int i = 0; i < jobs->threadCount; ++i)
+    {
+        arenaReset( &jobs->queues[ i ].scratch );
+    }
+}
+
+// Runs queued jobs until counter is zero.
+void jobsWait( JobSystem* jobs, SDL_atomic_t* counter )
+{
+    while (SDL_AtomicGet( counter ) > 0)
+    {
+        jobsRunOne( jobs, jobThreadIndex );
+    }
+}
+
+// Calls func on ranges of at most grain items that cover [0, count) and returns when all are done.
+// jobs can be NULL, then func runs on the calling thread.
+void jobsParallelFor( JobSystem* jobs, const char* name, unsigned count, unsigned grain, JobFunc func, void* data )
+{
+    if (!jobs || count <= grain)
+    {
+        if (count > 0)
+        {
+            TRACE_BEGIN( name );
+            func( data, 0, count );
+            TRACE_END( name );
+        }
+
+        return;
+    }
+
+    SDL_atomic_t counter;
+    SDL_AtomicSet( &counter, 0 );
+
+    for (unsigned begin = 0; begin < count; begin += grain)
+    {
+        jobsSubmit( jobs, name, func, data, begin, mini( begin + grain, count ), &counter );
+    }
+
+    jobsWait( jobs, &counter );
+}
@@ -0,0 +1,134 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+// Per-vertex lighting: ambient plus Lambert terms from directional and point lights.
+// Evaluated in the batched vertex pass, transformVertices() in renderer.c, and
+// interpolated by the rasterizer's lit variants.
+#define MAX_LIGHTS 8
+#define LIGHT_MIN_DISTANCE 1e-6f // Point light distances are clamped to this, a vertex at the light's position would divide 0 by 0.
+
+typedef enum
+{
+    LightDirectional = 0,
+    LightPoint
+} LightType;
+
+typedef struct
+{
+    LightType type;
+    Vec3 direction; // Directional: normalized direction the light travels to.
+    Vec3 position;  // Point: world position.
+    Vec3 color;
+    float radius;   // Point: distance where the contribution falls to zero.
+} Light;
+
+typedef struct
+{
+    Vec3 ambient;
+    Light lights[ MAX_LIGHTS ];
+    int lightCount;
+} Lighting;
+
+void lightingAddDirectional( Lighting* lighting, Vec3 direction, Vec3 color )
+{
+    assert( lighting->lightCount < MAX_LIGHTS );
+
+    Light* light = &lighting->lights[ lighting->lightCount++ ];
+    light->type = LightDirectional;
+    light->direction = normalized( direction );
+    light->position = (Vec3){ 0, 0, 0 };
+    light->color = color;
+    light->radius = 0;
+}
+
+void lightingAddPoint( Lighting* lighting, Vec3 position, Vec3 color, float radius )
+{
+    assert( lighting->lightCount < MAX_LIGHTS );
+
+    Light* light = &lighting->lights[ lighting->lightCount++ ];
+    light->type = LightPoint;
+    light->direction = (Vec3){ 0, 0, 0 };
+    light->position = position;
+    light->color = color;
+    light->radius = radius;
+}
+
+// worldNormal must be normalized.
+Vec3 lightVertex( const Lighting* lighting, Vec3 worldPosition, Vec3 worldNormal )
+{
+    Vec3 result = lighting->ambient;
+
+    for (int l = 0; l < lighting->lightCount; ++l)
+    {
+        const Light* light = &lighting->lights[ l ];
+        float intensity;
+
+        if (light->type == LightDirectional)
+        {
+            intensity = -dot( worldNormal, light->direction );
+        }
+        else
+        {
+            const Vec3 toLight = sub( light->position, worldPosition );
+            const float distance = fmaxf( sqrtf( dot( toLight, toLight ) ), LIGHT_MIN_DISTANCE );
+            const float attenuation = 1.0f - distance / light->radius;
+            intensity = dot( worldNormal, toLight ) / distance;
+            intensity *= attenuation > 0 ? attenuation : 0;
+        }
+
+        if (intensity > 0)
+        {
+            result = add( result, mulf( light->color, intensity ) );
+        }
+    }
+
+    return result;
+}
+
+#ifdef ARCH_X64
+// SoA version of lightVertex() for 4 vertices.
+FORCE_INLINE void lightVertices4( const Lighting* lighting, __m128 px, __m128 py, __m128 pz, __m128 nx, __m128 ny, __m128 nz,
+                                  __m128* outR, __m128* outG, __m128* outB )
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps( 1.0f );
+
+    __m128 r = _mm_set1_ps( lighting->ambient.x );
+    __m128 g = _mm_set1_ps( lighting->ambient.y );
+    __m128 b = _mm_set1_ps( lighting->ambient.z );
+
+    for (int l = 0; l < lighting->lightCount; ++l)
+    {
+        const Light* light = &lighting->lights[ l ];
+        __m128 intensity;
+
+        if (light->type == LightDirectional)
+        {
+            intensity = _mm_add_ps( _mm_add_ps( _mm_mul_ps( nx, _mm_set1_ps( -light->direction.x ) ),
+                                                _mm_mul_ps( ny, _mm_set1_ps( -light->direction.y ) ) ),
+                                    _mm_mul_ps( nz, _mm_set1_ps( -light->direction.z ) ) );
+        }
+        else
+        {
+            const __m128 dx = _mm_sub_ps( _mm_set1_ps( light->position.x ), px );
+            const __m128 dy = _mm_sub_ps( _mm_set1_ps( light->position.y ), py );
+            const __m128 dz = _mm_sub_ps( _mm_set1_ps( light->position.z ), pz );
+            const __m128 distance = _mm_max_ps( _mm_sqrt_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( dx, dx ), _mm_mul_ps( dy, dy ) ), _mm_mul_ps( dz, dz ) ) ),
+                                                _mm_set1_ps( LIGHT_MIN_DISTANCE ) );
+            const __m128 attenuation = _mm_max_ps( zero, _mm_sub_ps( one, _mm_div_ps( distance, _mm_set1_ps( light->radius ) ) ) );
+            const __m128 nDotL = _mm_add_ps( _mm_add_ps( _mm_mul_ps( nx, dx ), _mm_mul_ps( ny, dy ) ), _mm_mul_ps( nz, dz ) );
+            intensity = _mm_mul_ps( _mm_div_ps( nDotL, distance ), attenuation );
+        }
+
+        // _mm_max_ps() returns its second operand if either is NaN, so a NaN intensity becomes 0 like in lightVertex().
+        intensity = _mm_max_ps( intensity, zero );
+        r = _mm_add_ps( r, _mm_mul_ps( intensity, _mm_set1_ps( light->color.x ) ) );
+        g = _mm_add_ps( g, _mm_mul_ps( intensity, _mm_set1_ps( light->color.y ) ) );
+        b = _mm_add_ps( b, _mm_mul_ps( intensity, _mm_set1_ps( light->color.z ) ) );
+    }
+
+    *outR = r;
+    *outG = g;
+    *outB = b;
+}
+#endif
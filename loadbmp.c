@@ -28,9 +28,10 @@ typedef struct
     uint32_t importantColors;
 } BMPInfo;
 
-// Only supports uncompressed images.
+// Only supports uncompressed 24-bit images.
 // Allocates memory for outPixels. Caller should free() it.
-// Returns pixel data that will contain RGBA data, regardless of the input file.
+// Returns pixel data that will contain RGBA data, regardless of the input file, or NULL if the file
+// can't be read. The reason is printed.
 int* loadBMP( const char* path, int* outWidth, int* outHeight )
 {
     FILE* file = fopen( path, "rb" );
@@ -38,14 +39,20 @@ int* loadBMP( const char* path, int* outWidth, int* outHeight )
     if (!file)
     {
         printf( "Could not open %s\n", path );
-        exit( 1 );
+        return NULL;
     }
 
     BMPHeader header = { 0 };
-    fread( &header, 1, sizeof( header ), file );
-
     BMPInfo info = { 0 };
-    fread( &info, 1, sizeof( info ), file );
+
+    if (fread( &header, 1, sizeof( header ), file ) != sizeof( header ) || fread( &info, 1, sizeof( info ), file ) != sizeof( info ) ||
+        header.type != 0x4D42)
+    {
+        printf( "%s is not a BMP file.\n", path );
+        fclose( file );
+        return NULL;
+    }
+
     printf( "texture %s width: %d, height: %d, bpp: %d, bits / 8: %d\n", path, info.width, info.height, info.bits, info.bits / 8 );
 
     if (info.height < 0)
@@ -54,17 +61,27 @@ int* loadBMP( const char* path, int* outWidth, int* outHeight )
         info.height = -info.height;    
     }
     
-    if (info.compression != 0)
+    if (info.compression != 0 || info.bits != 24 || info.width <= 0 || info.height == 0)
     {
-        printf( "%s must be uncompressed!\n", path );
+        printf( "%s must be an uncompressed 24-bit image!\n", path );
+        fclose( file );
+        return NULL;
     }
 
-    *outWidth = info.width;
-    *outHeight = info.height;
-
     int* outPixels = malloc( info.width * info.height * 4 );
     char* imageData = malloc( info.width * info.height * info.bits / 8 );
-    fread( imageData, 1, info.width * info.height * info.bits / 8, file );
+
+    if (fread( imageData, 1, info.width * info.height * info.bits / 8, file ) != (size_t)(info.width * info.height * info.bits / 8))
+    {
+        printf( "%s is truncated.\n", path );
+        fclose( file );
+        free( imageData );
+        free( outPixels );
+        return NULL;
+    }
+
+    *outWidth = info.width;
+    *outHeight = info.height;
 
     int j = 0;
     for (int i = 0; i < info.width * info.height; ++i)
@@ -23,13 +23,34 @@ typedef struct
     unsigned faceCount;
 } OBJMesh;
 
-// Returns an array of meshes. Caller must deallocate them.
-OBJMesh* initMeshArrays( FILE* file )
+// Returns an array of meshes, NULL if the file has no objects or groups. Their memory is allocated from arena.
+OBJMesh* initMeshArrays( FILE* file, Arena* arena )
 {
     char line[ 255 ];
 
-    OBJMesh* meshes = malloc( sizeof( OBJMesh ) * 10 );
-    for (int i = 0; i < 10; ++i)
+    // Counts the objects first, there can be any number of them.
+    unsigned meshCapacity = 0;
+
+    while (fgets( line, 255, file ) != NULL)
+    {
+        char input[ 255 ] = { 0 };
+        sscanf( line, "%254s", input );
+
+        if (strchr( input, 'o' ) != 0 || strchr( input, 'g' ) != 0)
+        {
+            ++meshCapacity;
+        }
+    }
+
+    if (meshCapacity == 0)
+    {
+        return NULL;
+    }
+
+    fseek( file, 0, SEEK_SET );
+
+    OBJMesh* meshes = arenaAlloc( arena, sizeof( OBJMesh ) * meshCapacity );
+    for (unsigned i = 0; i < meshCapacity; ++i)
     {
         meshes[ i ].uvOffset = 0;
         meshes[ i ].positionOffset = 0;
@@ -91,10 +112,10 @@ OBJMesh* initMeshArrays( FILE* file )
                 meshes[ meshCount - 1 ].uvCount = uvCount;
                 meshes[ meshCount - 1 ].normalCount = normalCount;
 
-                meshes[ meshCount - 1 ].faces = malloc( sizeof( OBJFace ) * faceCount );
-                meshes[ meshCount - 1 ].positions = malloc( sizeof( Vec3 ) * positionCount );
-                meshes[ meshCount - 1 ].uvs = malloc( sizeof( UV ) * uvCount );
-                meshes[ meshCount - 1 ].normals = malloc( sizeof( Vec3 ) * normalCount );
+                meshes[ meshCount - 1 ].faces = arenaAlloc( arena, sizeof( OBJFace ) * faceCount );
+                meshes[ meshCount - 1 ].positions = arenaAlloc( arena, sizeof( Vec3 ) * positionCount );
+                meshes[ meshCount - 1 ].uvs = arenaAlloc( arena, sizeof( UV ) * uvCount );
+                meshes[ meshCount - 1 ].normals = arenaAlloc( arena, sizeof( Vec3 ) * normalCount );
 
                 meshes[ meshCount ].positionOffset = totalPositionCount;
                 meshes[ meshCount ].uvOffset = totalUVCount;
@@ -107,7 +128,6 @@ OBJMesh* initMeshArrays( FILE* file )
             }
 
             ++meshCount;
-            assert( meshCount < 10 );
         }
     }
 
@@ -116,10 +136,10 @@ OBJMesh* initMeshArrays( FILE* file )
     meshes[ meshCount - 1 ].positionCount = positionCount;
     meshes[ meshCount - 1 ].uvCount = uvCount;
     meshes[ meshCount - 1 ].normalCount = normalCount;
-    meshes[ meshCount - 1 ].faces = malloc( sizeof( OBJFace ) * faceCount );
-    meshes[ meshCount - 1 ].positions = malloc( sizeof( Vec3 ) * positionCount );
-    meshes[ meshCount - 1 ].uvs = malloc( sizeof( UV ) * uvCount );
-    meshes[ meshCount - 1 ].normals = malloc( sizeof( Vec3 ) * normalCount );
+    meshes[ meshCount - 1 ].faces = arenaAlloc( arena, sizeof( OBJFace ) * faceCount );
+    meshes[ meshCount - 1 ].positions = arenaAlloc( arena, sizeof( Vec3 ) * positionCount );
+    meshes[ meshCount - 1 ].uvs = arenaAlloc( arena, sizeof( UV ) * uvCount );
+    meshes[ meshCount - 1 ].normals = arenaAlloc( arena, sizeof( Vec3 ) * normalCount );
 
     fseek( file, 0, SEEK_SET );
 
@@ -178,14 +198,138 @@ bool AlmostEqualsUV( const UV* uv1, const UV* uv2 )
     return fabs( uv1->u - uv2->u ) < 0.0001f && fabs( uv1->v - uv2->v ) < 0.0001f;
 }
 
-void createFinalGeometry( const OBJMesh* objMesh, Mesh* mesh )
+// Allocates mesh's arrays as one block, meshFree() releases it.
+void meshAllocate( Mesh* mesh, unsigned vertexCount, unsigned faceCount )
 {
-    VertexInd newFace = { 0 };
+    // Each array starts at a multiple of 16 bytes.
+    const size_t positionBytes = (sizeof( Vec3 ) * vertexCount + 15) & ~(size_t)15;
+    const size_t normalBytes = positionBytes;
+    const size_t uvBytes = (sizeof( UV ) * vertexCount + 15) & ~(size_t)15;
+    const unsigned clusterCount = (faceCount + MESH_CLUSTER_SIZE - 1) / MESH_CLUSTER_SIZE;
+    const size_t clusterBytes = (sizeof( MeshCluster ) * clusterCount + 15) & ~(size_t)15;
+    const size_t faceBytes = sizeof( VertexInd ) * faceCount;
+
+    Uint8* memory = malloc( positionBytes + normalBytes + uvBytes + clusterBytes + faceBytes );
+    mesh->memory = memory;
+    mesh->positions = (Vec3*)memory;
+    mesh->normals = (Vec3*)(memory + positionBytes);
+    mesh->uvs = (UV*)(memory + positionBytes + normalBytes);
+    mesh->clusters = (MeshCluster*)(memory + positionBytes + normalBytes + uvBytes);
+    mesh->faces = (VertexInd*)(memory + positionBytes + normalBytes + uvBytes + clusterBytes);
+    mesh->vertexCount = vertexCount;
+    mesh->faceCount = faceCount;
+
+    // Until meshBuildClusters(), no cluster is culled and each uses every vertex.
+    for (unsigned c = 0; c < clusterCount; ++c)
+    {
+        mesh->clusters[ c ] = (MeshCluster){ .coneCos = -1, .firstVertex = 0, .endVertex = vertexCount };
+    }
+}
+
+// Computes the bounds, normal cones and vertex ranges of mesh's clusters. Must be called again when faces are reordered.
+void meshBuildClusters( Mesh* mesh )
+{
+    const unsigned clusterCount = (mesh->faceCount + MESH_CLUSTER_SIZE - 1) / MESH_CLUSTER_SIZE;
+
+    for (unsigned c = 0; c < clusterCount; ++c)
+    {
+        MeshCluster* cluster = &mesh->clusters[ c ];
+        const unsigned firstFace = c * MESH_CLUSTER_SIZE;
+        const unsigned endFace = mini( firstFace + MESH_CLUSTER_SIZE, mesh->faceCount );
+
+        Vec3 aabbMin = (Vec3){ 999999.0f, 999999.0f, 999999.0f };
+        Vec3 aabbMax = (Vec3){ -999999.0f, -999999.0f, -999999.0f };
+        Vec3 normalSum = (Vec3){ 0, 0, 0 };
+        cluster->firstVertex = ~0u;
+        cluster->endVertex = 0;
+
+        for (unsigned f = firstFace; f < endFace; ++f)
+        {
+            const unsigned indices[ 3 ] = { mesh->faces[ f ].a, mesh->faces[ f ].b, mesh->faces[ f ].c };
+
+            for (int k = 0; k < 3; ++k)
+            {
+                const Vec3 p = mesh->positions[ indices[ k ] ];
+                aabbMin = (Vec3){ fminf( aabbMin.x, p.x ), fminf( aabbMin.y, p.y ), fminf( aabbMin.z, p.z ) };
+                aabbMax = (Vec3){ fmaxf( aabbMax.x, p.x ), fmaxf( aabbMax.y, p.y ), fmaxf( aabbMax.z, p.z ) };
+                cluster->firstVertex = indices[ k ] < cluster->firstVertex ? indices[ k ] : cluster->firstVertex;
+                cluster->endVertex = indices[ k ] + 1 > cluster->endVertex ? indices[ k ] + 1 : cluster->endVertex;
+            }
+
+            // Zero area faces have no normal and are culled by setup anyway.
+            const Vec3 p0 = mesh->positions[ indices[ 0 ] ];
+            const Vec3 normal = cross( sub( mesh->positions[ indices[ 1 ] ], p0 ), sub( mesh->positions[ indices[ 2 ] ], p0 ) );
+
+            if (dot( normal, normal ) > 0)
+            {
+                normalSum = add( normalSum, normalized( normal ) );
+            }
+        }
+
+        cluster->center = mulf( add( aabbMin, aabbMax ), 0.5f );
+        cluster->radius = 0;
+
+        for (unsigned f = firstFace; f < endFace; ++f)
+        {
+            const unsigned indices[ 3 ] = { mesh->faces[ f ].a, mesh->faces[ f ].b, mesh->faces[ f ].c };
+
+            for (int k = 0; k < 3; ++k)
+            {
+                const Vec3 offset = sub( mesh->positions[ indices[ k ] ], cluster->center );
+                cluster->radius = fmaxf( cluster->radius, sqrtf( dot( offset, offset ) ) );
+            }
+        }
+
+        // The cone is centered on the average normal and opens to the normal furthest from it.
+        cluster->coneAxis = (Vec3){ 0, 0, 0 };
+        cluster->coneCos = -1;
+        cluster->coneSin = 0;
+
+        if (dot( normalSum, normalSum ) > 0)
+        {
+            cluster->coneAxis = normalized( normalSum );
+            cluster->coneCos = 1;
+
+            for (unsigned f = firstFace; f < endFace; ++f)
+            {
+                const Vec3 p0 = mesh->positions[ mesh->faces[ f ].a ];
+                const Vec3 normal = cross( sub( mesh->positions[ mesh->faces[ f ].b ], p0 ), sub( mesh->positions[ mesh->faces[ f ].c ], p0 ) );
 
-    mesh->positions = malloc( sizeof( Vec3 ) * 153636 );
-    mesh->uvs = malloc( sizeof( UV ) * 153636 );
-    mesh->normals = malloc( sizeof( Vec3 ) * 153636 );
-    mesh->faces = malloc( sizeof( VertexInd ) * 128343 );
+                if (dot( normal, normal ) > 0)
+                {
+                    cluster->coneCos = fminf( cluster->coneCos, dot( cluster->coneAxis, normalized( normal ) ) );
+                }
+            }
+
+            cluster->coneSin = sqrtf( fmaxf( 0.0f, 1 - cluster->coneCos * cluster->coneCos ) );
+        }
+    }
+}
+
+void meshFree( Mesh* mesh )
+{
+    free( mesh->memory );
+    mesh->memory = NULL;
+    mesh->positions = NULL;
+    mesh->normals = NULL;
+    mesh->uvs = NULL;
+    mesh->faces = NULL;
+}
+
+// Vertices are deduplicated in arrays from arena, sized for the worst case of 3 unique vertices per face.
+// The finished mesh is copied into one exactly sized allocation. Returns false without allocating if the mesh
+// has more unique vertices than VertexInd's 16-bit indices can address.
+bool createFinalGeometry( const OBJMesh* objMesh, Arena* arena, Mesh* outMesh )
+{
+    VertexInd newFace = { 0 };
+    const unsigned maxVertexCount = objMesh->faceCount * 3;
+
+    Mesh work;
+    Mesh* mesh = &work;
+    mesh->positions = arenaAlloc( arena, sizeof( Vec3 ) * maxVertexCount );
+    mesh->uvs = arenaAlloc( arena, sizeof( UV ) * maxVertexCount );
+    mesh->normals = arenaAlloc( arena, sizeof( Vec3 ) * maxVertexCount );
+    mesh->faces = arenaAlloc( arena, sizeof( VertexInd ) * objMesh->faceCount );
     mesh->faceCount = 0;
     mesh->vertexCount = 0;
     
@@ -211,12 +355,16 @@ void createFinalGeometry( const OBJMesh* objMesh, Mesh* mesh )
 
         if (!found)
         {
+            if (mesh->vertexCount > 0xFFFF)
+            {
+                return false;
+            }
+
             mesh->positions[ mesh->vertexCount ] = pos;
             mesh->uvs[ mesh->vertexCount ] = uv;
             mesh->normals[ mesh->vertexCount ] = norm;
 
             ++mesh->vertexCount;
-            assert( mesh->vertexCount < 153636 );
 
             newFace.a = (unsigned short)(mesh->vertexCount - 1);
         }
@@ -241,12 +389,16 @@ void createFinalGeometry( const OBJMesh* objMesh, Mesh* mesh )
 
         if (!found)
         {
+            if (mesh->vertexCount > 0xFFFF)
+            {
+                return false;
+            }
+
             mesh->positions[ mesh->vertexCount ] = pos;
             mesh->uvs[ mesh->vertexCount ] = uv;
             mesh->normals[ mesh->vertexCount ] = norm;
 
             ++mesh->vertexCount;
-            assert( mesh->vertexCount < 153636 );
 
             newFace.b = (unsigned short)(mesh->vertexCount - 1);
         }
@@ -271,19 +423,22 @@ void createFinalGeometry( const OBJMesh* objMesh, Mesh* mesh )
 
         if (!found)
         {
+            if (mesh->vertexCount > 0xFFFF)
+            {
+                return false;
+            }
+
             mesh->positions[ mesh->vertexCount ] = pos;
             mesh->uvs[ mesh->vertexCount ] = uv;
             mesh->normals[ mesh->vertexCount ] = norm;
 
             ++mesh->vertexCount;
-            assert( mesh->vertexCount < 153636 );
 
             newFace.c = (unsigned short)(mesh->vertexCount - 1);
         }
 
         mesh->faces[ f ] = newFace;
         ++mesh->faceCount;
-        assert( mesh->faceCount < 128343 );
     }
 
     mesh->aabbMin = (Vec3){ 999999.0f, 999999.0f, 999999.0f };
@@ -321,19 +476,55 @@ void createFinalGeometry( const OBJMesh* objMesh, Mesh* mesh )
             mesh->aabbMax.z = mesh->positions[ i ].z;
         }
     }
+
+    meshAllocate( outMesh, mesh->vertexCount, mesh->faceCount );
+    memcpy( outMesh->positions, mesh->positions, sizeof( Vec3 ) * mesh->vertexCount );
+    memcpy( outMesh->normals, mesh->normals, sizeof( Vec3 ) * mesh->vertexCount );
+    memcpy( outMesh->uvs, mesh->uvs, sizeof( UV ) * mesh->vertexCount );
+    memcpy( outMesh->faces, mesh->faces, sizeof( VertexInd ) * mesh->faceCount );
+    outMesh->aabbMin = mesh->aabbMin;
+    outMesh->aabbMax = mesh->aabbMax;
+
+    return true;
+}
+
+// Converts a face's 1-based OBJ index to an index into its mesh's array of count elements, which starts at offset in the file.
+// Returns false for 0, for relative (negative) indices, which aren't supported, and for indices outside the mesh.
+bool objIndexToMesh( int objIndex, unsigned offset, unsigned count, unsigned* outIndex )
+{
+    if (objIndex <= 0 || (unsigned)objIndex <= offset || (unsigned)objIndex - offset > count)
+    {
+        return false;
+    }
+
+    *outIndex = (unsigned)objIndex - offset - 1;
+    return true;
 }
 
-void loadObj( const char* path, Mesh* outMeshes, int* outMeshCount )
+// Returns false if the file can't be read, the reason is printed.
+// Allocates *outMeshes, one mesh per object or group. Caller should meshFree() each and free() the array.
+bool loadObj( const char* path, Mesh** outMeshes, int* outMeshCount )
 {
     FILE* file = fopen( path, "rb" );
 
     if (!file)
     {
         printf( "Could not open %s\n", path );
-        return;
+        return false;
     }
 
-    OBJMesh* meshes = initMeshArrays( file );
+    // Everything but the final meshes is temporary and freed in one call at the end.
+    Arena loadArena;
+    arenaInit( &loadArena, 1024 * 1024 );
+    OBJMesh* meshes = initMeshArrays( file, &loadArena );
+
+    if (!meshes)
+    {
+        printf( "%s has no objects.\n", path );
+        fclose( file );
+        arenaFree( &loadArena );
+        return false;
+    }
 
     fseek( file, 0, SEEK_SET );
 
@@ -353,21 +544,26 @@ void loadObj( const char* path, Mesh* outMeshes, int* outMeshCount )
         }
         else if (strstr( input, "f" ))
         {
+            const OBJMesh* objMesh = &meshes[ meshCount - 1 ];
             OBJFace* face = &meshes[ meshCount - 1 ].faces[ faceIndex ];
-            sscanf( line, "%254s %u/%u/%u %u/%u/%u %u/%u/%u", input, &face->posInd[ 0 ], &face->uvInd[ 0 ], &face->normInd[ 0 ],
-                    &face->posInd[ 1 ], &face->uvInd[ 1 ], &face->normInd[ 1 ], &face->posInd[ 2 ], &face->uvInd[ 2 ], &face->normInd[ 2 ] );
-
-            face->posInd[ 0 ] -= meshes[ meshCount - 1 ].positionOffset + 1;
-            face->posInd[ 1 ] -= meshes[ meshCount - 1 ].positionOffset + 1;
-            face->posInd[ 2 ] -= meshes[ meshCount - 1 ].positionOffset + 1;
+            int posInd[ 3 ] = { 0 };
+            int uvInd[ 3 ] = { 0 };
+            int normInd[ 3 ] = { 0 };
+            sscanf( line, "%254s %d/%d/%d %d/%d/%d %d/%d/%d", input, &posInd[ 0 ], &uvInd[ 0 ], &normInd[ 0 ],
+                    &posInd[ 1 ], &uvInd[ 1 ], &normInd[ 1 ], &posInd[ 2 ], &uvInd[ 2 ], &normInd[ 2 ] );
 
-            face->uvInd[ 0 ] -= meshes[ meshCount - 1 ].uvOffset + 1;
-            face->uvInd[ 1 ] -= meshes[ meshCount - 1 ].uvOffset + 1;
-            face->uvInd[ 2 ] -= meshes[ meshCount - 1 ].uvOffset + 1;
-
-            face->normInd[ 0 ] -= meshes[ meshCount - 1 ].normalOffset + 1;
-            face->normInd[ 1 ] -= meshes[ meshCount - 1 ].normalOffset + 1;
-            face->normInd[ 2 ] -= meshes[ meshCount - 1 ].normalOffset + 1;
+            for (int k = 0; k < 3; ++k)
+            {
+                if (!objIndexToMesh( posInd[ k ], objMesh->positionOffset, objMesh->positionCount, &face->posInd[ k ] ) ||
+                    !objIndexToMesh( uvInd[ k ], objMesh->uvOffset, objMesh->uvCount, &face->uvInd[ k ] ) ||
+                    !objIndexToMesh( normInd[ k ], objMesh->normalOffset, objMesh->normalCount, &face->normInd[ k ] ))
+                {
+                    printf( "%s has a face with an invalid or unsupported index: %s", path, line );
+                    fclose( file );
+                    arenaFree( &loadArena );
+                    return false;
+                }
+            }
 
             ++faceIndex;
         }
@@ -375,16 +571,35 @@ void loadObj( const char* path, Mesh* outMeshes, int* outMeshCount )
 
     fclose( file );
 
-    *outMeshCount = meshCount;
+    Mesh* finalMeshes = malloc( meshCount * sizeof( Mesh ) );
     
     for (int m = 0; m < meshCount; ++m)
     {
-        createFinalGeometry( &meshes[ m ], &outMeshes[ m ] );
-        free( meshes[ m ].faces );
-        free( meshes[ m ].normals );
-        free( meshes[ m ].positions );
-        free( meshes[ m ].uvs );
+        Mesh* outMesh = &finalMeshes[ m ];
+
+        if (!createFinalGeometry( &meshes[ m ], &loadArena, outMesh ))
+        {
+            printf( "%s mesh %d has more than 65536 unique vertices.\n", path, m );
+
+            for (int i = 0; i < m; ++i)
+            {
+                meshFree( &finalMeshes[ i ] );
+            }
+
+            free( finalMeshes );
+            arenaFree( &loadArena );
+            return false;
+        }
+
+        const float acmrBefore = meshComputeAcmr( outMesh );
+        meshOptimizeVertexCache( outMesh, &loadArena );
+        meshBuildClusters( outMesh );
+        printf( "%s mesh %d: %u faces, ACMR %.3f -> %.3f\n", path, m, outMesh->faceCount, acmrBefore, meshComputeAcmr( outMesh ) );
     }
     
-    free( meshes );
+    arenaFree( &loadArena );
+
+    *outMeshes = finalMeshes;
+    *outMeshCount = meshCount;
+    return true;
 }
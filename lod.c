@@ -0,0 +1,526 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+// Level of detail chains. Each LOD is simplified from the previous one by half-edge collapses in order of
+// quadric error (Garland & Heckbert): a vertex is moved onto one of its neighbors, so LODs reuse the source's
+// vertices and their attributes as they are. Vertices on UV or normal seams and on open borders never move,
+// which keeps texturing intact but limits how far meshes with many seams simplify.
+#define MAX_MESH_LODS 5 // Including the source mesh.
+#define LOD_PIXEL_ERROR 1.0f // Largest simplification error that can be selected, in pixels.
+#define LOD_MAX_ERROR 0.1f // Largest error of a level relative to the diagonal of the mesh's bounds, coarser levels aren't built.
+
+typedef struct
+{
+    Mesh lods[ MAX_MESH_LODS ]; // lods[ 0 ] is the source mesh and isn't owned by the chain.
+    float errors[ MAX_MESH_LODS ]; // Quadric estimate of how far the surface moved, relative to the diagonal of the mesh's bounds.
+    int lodCount;
+} MeshLods;
+
+// Sum of squared distances to planes, weighted by the area of the faces they came from.
+typedef struct
+{
+    float a00, a01, a02, a11, a12, a22; // Symmetric 3x3 part.
+    float b0, b1, b2;
+    float c;
+    float weight;
+} Quadric;
+
+typedef struct
+{
+    float cost;
+    unsigned from;
+    unsigned to;
+} LodCollapse;
+
+typedef struct
+{
+    Vec3 position;
+    unsigned index;
+} LodSortKey;
+
+static void quadricAddPlane( Quadric* q, Vec3 n, float d, float weight )
+{
+    q->a00 += weight * n.x * n.x;
+    q->a01 += weight * n.x * n.y;
+    q->a02 += weight * n.x * n.z;
+    q->a11 += weight * n.y * n.y;
+    q->a12 += weight * n.y * n.z;
+    q->a22 += weight * n.z * n.z;
+    q->b0 += weight * n.x * d;
+    q->b1 += weight * n.y * d;
+    q->b2 += weight * n.z * d;
+    q->c += weight * d * d;
+    q->weight += weight;
+}
+
+static void quadricAdd( Quadric* q, const Quadric* other )
+{
+    q->a00 += other->a00;
+    q->a01 += other->a01;
+    q->a02 += other->a02;
+    q->a11 += other->a11;
+    q->a12 += other->a12;
+    q->a22 += other->a22;
+    q->b0 += other->b0;
+    q->b1 += other->b1;
+    q->b2 += other->b2;
+    q->c += other->c;
+    q->weight += other->weight;
+}
+
+// Mean squared distance of p to q's planes.
+static float quadricError( const Quadric* q, Vec3 p )
+{
+    const float e = p.x * (q->a00 * p.x + 2 * q->a01 * p.y + 2 * q->a02 * p.z + 2 * q->b0) +
+                    p.y * (q->a11 * p.y + 2 * q->a12 * p.z + 2 * q->b1) +
+                    p.z * (q->a22 * p.z + 2 * q->b2) + q->c;
+
+    return q->weight > 0 ? fabsf( e ) / q->weight : 0;
+}
+
+static int compareLodSortKeys( const void* a, const void* b )
+{
+    const Vec3 pa = ((const LodSortKey*)a)->position;
+    const Vec3 pb = ((const LodSortKey*)b)->position;
+
+    if (pa.x != pb.x)
+    {
+        return (pa.x > pb.x) - (pa.x < pb.x);
+    }
+
+    if (pa.y != pb.y)
+    {
+        return (pa.y > pb.y) - (pa.y < pb.y);
+    }
+
+    return (pa.z > pb.z) - (pa.z < pb.z);
+}
+
+static int compareLodCollapses( const void* a, const void* b )
+{
+    const float costA = ((const LodCollapse*)a)->cost;
+    const float costB = ((const LodCollapse*)b)->cost;
+
+    return (costA > costB) - (costA < costB);
+}
+
+FORCE_INLINE unsigned lodFaceVertex( const VertexInd* face, int corner )
+{
+    return corner == 0 ? face->a : (corner == 1 ? face->b : face->c);
+}
+
+// Vertex v's faces are adjacentFaces[ adjacencyStarts[ v ] ] .. adjacentFaces[ adjacencyStarts[ v + 1 ] - 1 ].
+static void buildAdjacency( const VertexInd* faces, unsigned faceCount, unsigned vertexCount, Arena* arena,
+                            unsigned** outAdjacencyStarts, unsigned** outAdjacentFaces )
+{
+    unsigned* starts = arenaAlloc( arena, (vertexCount + 1) * sizeof( unsigned ) );
+    unsigned* adjacentFaces = arenaAlloc( arena, faceCount * 3 * sizeof( unsigned ) );
+    memset( starts, 0, (vertexCount + 1) * sizeof( unsigned ) );
+
+    for (unsigned f = 0; f < faceCount; ++f)
+    {
+        ++starts[ faces[ f ].a + 1 ];
+        ++starts[ faces[ f ].b + 1 ];
+        ++starts[ faces[ f ].c + 1 ];
+    }
+
+    for (unsigned v = 0; v < vertexCount; ++v)
+    {
+        starts[ v + 1 ] += starts[ v ];
+    }
+
+    unsigned* cursors = arenaAlloc( arena, vertexCount * sizeof( unsigned ) );
+    memcpy( cursors, starts, vertexCount * sizeof( unsigned ) );
+
+    for (unsigned f = 0; f < faceCount; ++f)
+    {
+        adjacentFaces[ cursors[ faces[ f ].a ]++ ] = f;
+        adjacentFaces[ cursors[ faces[ f ].b ]++ ] = f;
+        adjacentFaces[ cursors[ faces[ f ].c ]++ ] = f;
+    }
+
+    *outAdjacencyStarts = starts;
+    *outAdjacentFaces = adjacentFaces;
+}
+
+// Returns true if moving vertex from onto to leaves a manifold surface without folded faces.
+static bool lodCollapseIsValid( const Vec3* positions, const VertexInd* faces, const unsigned* adjacencyStarts,
+                                const unsigned* adjacentFaces, unsigned* marks, unsigned* stamp, unsigned from, unsigned to )
+{
+    // Link condition: the only neighbors the two vertices share are the third vertices of their shared faces.
+    *stamp += 2;
+    const unsigned seen = *stamp;
+
+    for (unsigned i = adjacencyStarts[ to ]; i < adjacencyStarts[ to + 1 ]; ++i)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            marks[ lodFaceVertex( &faces[ adjacentFaces[ i ] ], k ) ] = seen;
+        }
+    }
+
+    unsigned sharedNeighbors = 0;
+    unsigned sharedFaces = 0;
+
+    for (unsigned i = adjacencyStarts[ from ]; i < adjacencyStarts[ from + 1 ]; ++i)
+    {
+        const VertexInd* face = &faces[ adjacentFaces[ i ] ];
+        bool hasTo = false;
+
+        for (int k = 0; k < 3; ++k)
+        {
+            const unsigned v = lodFaceVertex( face, k );
+            hasTo |= v == to;
+
+            if (v != from && v != to && marks[ v ] == seen)
+            {
+                marks[ v ] = seen + 1;
+                ++sharedNeighbors;
+            }
+        }
+
+        if (hasTo)
+        {
+            ++sharedFaces;
+            continue;
+        }
+
+        // Faces that stay must not turn by more than about 75 degrees.
+        const Vec3 p0 = positions[ face->a ];
+        const Vec3 p1 = positions[ face->b ];
+        const Vec3 p2 = positions[ face->c ];
+        const Vec3 q0 = face->a == from ? positions[ to ] : p0;
+        const Vec3 q1 = face->b == from ? positions[ to ] : p1;
+        const Vec3 q2 = face->c == from ? positions[ to ] : p2;
+        const Vec3 before = cross( sub( p1, p0 ), sub( p2, p0 ) );
+        const Vec3 after = cross( sub( q1, q0 ), sub( q2, q0 ) );
+
+        if (dot( before, after ) <= 0.25f * sqrtf( dot( before, before ) * dot( after, after ) ))
+        {
+            return false;
+        }
+    }
+
+    return sharedFaces > 0 && sharedNeighbors == sharedFaces;
+}
+
+// Simplifies source towards targetFaceCount faces into outMesh, moving no vertex further than maxError from
+// the planes of its faces. Returns the largest distance, or a negative value and no mesh if less than a tenth
+// of the faces could be removed.
+static float simplifyMesh( const Mesh* source, unsigned targetFaceCount, float maxError, Arena* arena, Mesh* outMesh )
+{
+    const unsigned vertexCount = source->vertexCount;
+    const Vec3* positions = source->positions;
+    unsigned faceCount = source->faceCount;
+
+    VertexInd* faces = arenaAlloc( arena, faceCount * sizeof( VertexInd ) );
+    memcpy( faces, source->faces, faceCount * sizeof( VertexInd ) );
+
+    Quadric* quadrics = arenaAlloc( arena, vertexCount * sizeof( Quadric ) );
+    bool* locked = arenaAlloc( arena, vertexCount * sizeof( bool ) );
+    bool* touched = arenaAlloc( arena, vertexCount * sizeof( bool ) );
+    unsigned* remap = arenaAlloc( arena, vertexCount * sizeof( unsigned ) );
+    unsigned* marks = arenaAlloc( arena, vertexCount * sizeof( unsigned ) );
+    unsigned stamp = 0;
+    memset( quadrics, 0, vertexCount * sizeof( Quadric ) );
+    memset( locked, 0, vertexCount * sizeof( bool ) );
+    memset( marks, 0, vertexCount * sizeof( unsigned ) );
+
+    for (unsigned f = 0; f < faceCount; ++f)
+    {
+        const Vec3 p0 = positions[ faces[ f ].a ];
+        const Vec3 normal = cross( sub( positions[ faces[ f ].b ], p0 ), sub( positions[ faces[ f ].c ], p0 ) );
+        const float length = sqrtf( dot( normal, normal ) );
+
+        if (length > 0)
+        {
+            const Vec3 n = mulf( normal, 1.0f / length );
+
+            for (int k = 0; k < 3; ++k)
+            {
+                quadricAddPlane( &quadrics[ lodFaceVertex( &faces[ f ], k ) ], n, -dot( n, p0 ), length * 0.5f );
+            }
+        }
+    }
+
+    // Vertices sharing their position with another one are on a seam.
+    LodSortKey* keys = arenaAlloc( arena, vertexCount * sizeof( LodSortKey ) );
+
+    for (unsigned v = 0; v < vertexCount; ++v)
+    {
+        keys[ v ].position = positions[ v ];
+        keys[ v ].index = v;
+    }
+
+    qsort( keys, vertexCount, sizeof( LodSortKey ), compareLodSortKeys );
+
+    for (unsigned i = 1; i < vertexCount; ++i)
+    {
+        if (compareLodSortKeys( &keys[ i - 1 ], &keys[ i ] ) == 0)
+        {
+            locked[ keys[ i - 1 ].index ] = true;
+            locked[ keys[ i ].index ] = true;
+        }
+    }
+
+    // A vertex is on a border if one of its edges has a face on only one side.
+    {
+        const ArenaMark mark = arenaMark( arena );
+        unsigned* adjacencyStarts;
+        unsigned* adjacentFaces;
+        buildAdjacency( faces, faceCount, vertexCount, arena, &adjacencyStarts, &adjacentFaces );
+
+        for (unsigned v = 0; v < vertexCount; ++v)
+        {
+            for (unsigned i = adjacencyStarts[ v ]; i < adjacencyStarts[ v + 1 ] && !locked[ v ]; ++i)
+            {
+                const VertexInd* face = &faces[ adjacentFaces[ i ] ];
+                const int corner = face->a == v ? 0 : (face->b == v ? 1 : 2);
+                const unsigned next = lodFaceVertex( face, (corner + 1) % 3 );
+                bool opposite = false;
+
+                for (unsigned j = adjacencyStarts[ v ]; j < adjacencyStarts[ v + 1 ] && !opposite; ++j)
+                {
+                    const VertexInd* other = &faces[ adjacentFaces[ j ] ];
+                    const int otherCorner = other->a == v ? 0 : (other->b == v ? 1 : 2);
+                    opposite = lodFaceVertex( other, (otherCorner + 2) % 3 ) == next;
+                }
+
+                locked[ v ] = !opposite;
+            }
+        }
+
+        arenaRelease( arena, mark );
+    }
+
+    const float maxCost = maxError * maxError;
+    float maxCollapseCost = 0;
+
+    // Each pass collapses the cheapest edges whose neighborhoods don't overlap, then removes the collapsed faces.
+    while (faceCount > targetFaceCount)
+    {
+        const ArenaMark mark = arenaMark( arena );
+        unsigned* adjacencyStarts;
+        unsigned* adjacentFaces;
+        buildAdjacency( faces, faceCount, vertexCount, arena, &adjacencyStarts, &adjacentFaces );
+
+        LodCollapse* collapses = arenaAlloc( arena, faceCount * 6 * sizeof( LodCollapse ) );
+        unsigned collapseCount = 0;
+
+        for (unsigned f = 0; f < faceCount; ++f)
+        {
+            for (int k = 0; k < 3; ++k)
+            {
+                const unsigned v0 = lodFaceVertex( &faces[ f ], k );
+                const unsigned v1 = lodFaceVertex( &faces[ f ], (k + 1) % 3 );
+
+                if (!locked[ v0 ])
+                {
+                    collapses[ collapseCount++ ] = (LodCollapse){ quadricError( &quadrics[ v0 ], positions[ v1 ] ), v0, v1 };
+                }
+
+                if (!locked[ v1 ])
+                {
+                    collapses[ collapseCount++ ] = (LodCollapse){ quadricError( &quadrics[ v1 ], positions[ v0 ] ), v1, v0 };
+                }
+            }
+        }
+
+        qsort( collapses, collapseCount, sizeof( LodCollapse ), compareLodCollapses );
+
+        for (unsigned v = 0; v < vertexCount; ++v)
+        {
+            remap[ v ] = v;
+            touched[ v ] = false;
+        }
+
+        unsigned removedFaces = 0;
+
+        for (unsigned i = 0; i < collapseCount && faceCount - removedFaces > targetFaceCount; ++i)
+        {
+            const unsigned from = collapses[ i ].from;
+            const unsigned to = collapses[ i ].to;
+
+            if (collapses[ i ].cost > maxCost)
+            {
+                break;
+            }
+
+            if (touched[ from ] || touched[ to ] ||
+                !lodCollapseIsValid( positions, faces, adjacencyStarts, adjacentFaces, marks, &stamp, from, to ))
+            {
+                continue;
+            }
+
+            remap[ from ] = to;
+            quadricAdd( &quadrics[ to ], &quadrics[ from ] );
+            maxCollapseCost = fmaxf( maxCollapseCost, collapses[ i ].cost );
+
+            // The faces around from are stale until the pass ends, so their vertices wait for the next one.
+            for (unsigned j = adjacencyStarts[ from ]; j < adjacencyStarts[ from + 1 ]; ++j)
+            {
+                const VertexInd* face = &faces[ adjacentFaces[ j ] ];
+                touched[ face->a ] = true;
+                touched[ face->b ] = true;
+                touched[ face->c ] = true;
+                removedFaces += face->a == to || face->b == to || face->c == to;
+            }
+        }
+
+        arenaRelease( arena, mark );
+
+        if (removedFaces == 0)
+        {
+            break;
+        }
+
+        unsigned keptFaces = 0;
+
+        for (unsigned f = 0; f < faceCount; ++f)
+        {
+            const VertexInd face = { (unsigned short)remap[ faces[ f ].a ], (unsigned short)remap[ faces[ f ].b ], (unsigned short)remap[ faces[ f ].c ] };
+
+            if (face.a != face.b && face.b != face.c && face.c != face.a)
+            {
+                faces[ keptFaces++ ] = face;
+            }
+        }
+
+        faceCount = keptFaces;
+    }
+
+    if (faceCount * 10 > source->faceCount * 9)
+    {
+        return -1;
+    }
+
+    // Unused vertices are dropped, the rest keep their order.
+    unsigned* newIndices = remap;
+    unsigned newVertexCount = 0;
+
+    for (unsigned v = 0; v < vertexCount; ++v)
+    {
+        newIndices[ v ] = ~0u;
+    }
+
+    for (unsigned f = 0; f < faceCount; ++f)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            newIndices[ lodFaceVertex( &faces[ f ], k ) ] = 0;
+        }
+    }
+
+    for (unsigned v = 0; v < vertexCount; ++v)
+    {
+        if (newIndices[ v ] == 0)
+        {
+            newIndices[ v ] = newVertexCount++;
+        }
+    }
+
+    meshAllocate( outMesh, newVertexCount, faceCount );
+
+    for (unsigned v = 0; v < vertexCount; ++v)
+    {
+        if (newIndices[ v ] != ~0u)
+        {
+            outMesh->positions[ newIndices[ v ] ] = source->positions[ v ];
+            outMesh->normals[ newIndices[ v ] ] = source->normals[ v ];
+            outMesh->uvs[ newIndices[ v ] ] = source->uvs[ v ];
+        }
+    }
+
+    for (unsigned f = 0; f < faceCount; ++f)
+    {
+        outMesh->faces[ f ].a = (unsigned short)newIndices[ faces[ f ].a ];
+        outMesh->faces[ f ].b = (unsigned short)newIndices[ faces[ f ].b ];
+        outMesh->faces[ f ].c = (unsigned short)newIndices[ faces[ f ].c ];
+    }
+
+    // The source's bounds contain every LOD, so culling doesn't depend on the selected one.
+    outMesh->aabbMin = source->aabbMin;
+    outMesh->aabbMax = source->aabbMax;
+
+    return sqrtf( maxCollapseCost );
+}
+
+// Builds up to maxLods levels, including mesh itself, each with about half the faces of the previous one.
+// Stops early when a level doesn't simplify further. mesh must outlive the chain.
+void meshBuildLods( const Mesh* mesh, int maxLods, MeshLods* outLods )
+{
+    Arena arena;
+    arenaInit( &arena, 1024 * 1024 );
+
+    const Vec3 diagonal = sub( mesh->aabbMax, mesh->aabbMin );
+    const float size = sqrtf( dot( diagonal, diagonal ) );
+
+    outLods->lods[ 0 ] = *mesh;
+    outLods->errors[ 0 ] = 0;
+    outLods->lodCount = 1;
+
+    while (outLods->lodCount < mini( maxLods, MAX_MESH_LODS ))
+    {
+        const Mesh* previous = &outLods->lods[ outLods->lodCount - 1 ];
+        const float error = simplifyMesh( previous, previous->faceCount / 2, LOD_MAX_ERROR * size, &arena, &outLods->lods[ outLods->lodCount ] );
+        arenaReset( &arena );
+
+        if (error < 0)
+        {
+            break;
+        }
+
+        // Collapses keep the previous level's face order only roughly.
+        meshOptimizeVertexCache( &outLods->lods[ outLods->lodCount ], &arena );
+        meshBuildClusters( &outLods->lods[ outLods->lodCount ] );
+
+        // Errors of successive levels add up at most.
+        outLods->errors[ outLods->lodCount ] = outLods->errors[ outLods->lodCount - 1 ] + (size > 0 ? error / size : 0);
+        ++outLods->lodCount;
+    }
+
+    arenaFree( &arena );
+}
+
+// Frees the simplified levels.
+void meshLodsFree( MeshLods* lods )
+{
+    for (int i = 1; i < lods->lodCount; ++i)
+    {
+        meshFree( &lods->lods[ i ] );
+    }
+
+    lods->lodCount = 1;
+}
+
+// Projected diameter in pixels of a sphere around the bounds. pixelsPerUnit is the projection's scale
+// at distance 1: height / (2 * tan( fovY / 2 )).
+float lodScreenSize( Vec3 aabbMin, Vec3 aabbMax, Vec3 cameraPos, float pixelsPerUnit )
+{
+    const Vec3 diagonal = sub( aabbMax, aabbMin );
+    const Vec3 toCenter = sub( mulf( add( aabbMin, aabbMax ), 0.5f ), cameraPos );
+    const float diameter = sqrtf( dot( diagonal, diagonal ) );
+    const float distance = sqrtf( dot( toCenter, toCenter ) );
+
+    // The camera is inside the sphere.
+    if (distance <= diameter * 0.5f)
+    {
+        return 999999.0f;
+    }
+
+    return diameter * pixelsPerUnit / distance;
+}
+
+// Returns the coarsest level whose error is at most LOD_PIXEL_ERROR pixels when the mesh's bounds cover
+// screenSize pixels, see lodScreenSize().
+const Mesh* meshLodsSelect( const MeshLods* lods, float screenSize )
+{
+    int lod = 0;
+
+    while (lod + 1 < lods->lodCount && lods->errors[ lod + 1 ] * screenSize <= LOD_PIXEL_ERROR)
+    {
+        ++lod;
+    }
+
+    return &lods->lods[ lod ];
+}
@@ -28,10 +28,14 @@
 // Hi-Z
 // -march=x86_64-v2 (for MacBook Pro 2010)
 // Optimize triangle test with (w0 | w1 | w2) >= 0 and check its disassembly.
+#ifdef __linux__
+#define _GNU_SOURCE // pthread_setaffinity_np() in jobs.c
+#endif
 #include <assert.h>
 #include <stdio.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include <float.h>
 #include <string.h>
 #include <time.h>
 #include <math.h>
@@ -41,9 +45,14 @@
 #if _MSC_VER
 #include "SDL.h"
 #include <intrin.h>
+#include <malloc.h>
 #else
 #include <stdalign.h>
 #include <SDL2/SDL.h>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 #ifdef ARCH_X64
 #include <x86intrin.h>
 #endif
@@ -51,58 +60,155 @@
 #include <arm_neon.h>
 #endif
 #endif
-
-const int WIDTH = 1920 / 2;
-const int HEIGHT = 1080 / 2;
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h> // SetThreadAffinityMask() in jobs.c
+#endif
 
 #include "vec3.c"
 #include "mymath.c"
+#include "srgb.c"
 #include "frustum.c"
+#include "stats.c"
+#include "trace.c"
+#include "arena.c"
+#include "jobs.c"
+#include "framebuffer.c"
+#include "lighting.c"
+#include "debugview.c"
 #include "renderer.c"
+#include "occlusion.c"
+#include "transparency.c"
+#include "present.c"
+#include "resolution.c"
+#include "vertexcache.c"
 #include "loadobj.c"
+#include "lod.c"
 #include "loadbmp.c"
+#include "assets.c"
+#include "scene.c"
 
-typedef struct GameObject
+// Per-object output of the culling jobs.
+typedef struct
+{
+    Matrix44 localToClip;
+    bool visible;
+    bool occluded; // Inside the frustum but hidden behind occluders.
+    float screenSize; // Projected size of the bounds in pixels, selects the LOD.
+} ObjectDraw;
+
+typedef struct
+{
+    const Scene* scene;
+    Frustum* frustum;
+    const Matrix44* worldToClip;
+    Vec3 cameraPos;
+    float pixelsPerUnit; // See lodScreenSize().
+    ObjectDraw* draws; // One per scene object.
+} CullJob;
+
+// Computes the local-to-clip matrices of scene objects [begin, end) and culls their bounds against the camera frustum.
+static void cullObjectsJob( void* data, unsigned begin, unsigned end )
 {
-    Vec3 position;
-    Vec3 rotation;
-} GameObject;
+    const CullJob* job = (const CullJob*)data;
+    const Scene* scene = job->scene;
+
+    for (unsigned i = begin; i < end; ++i)
+    {
+        ObjectDraw* draw = &job->draws[ i ];
+        draw->occluded = false;
+
+        // Still loading.
+        if (scene->dirty[ i ])
+        {
+            draw->visible = false;
+            continue;
+        }
+
+        multiplySIMD( &scene->localToWorld[ i ], job->worldToClip, &draw->localToClip );
+
+        const Vec3 meshAabbMinWorld = scene->worldAabbMin[ i ];
+        const Vec3 meshAabbMaxWorld = scene->worldAabbMax[ i ];
+        const Vec3 cameraPos = job->cameraPos;
+
+        draw->visible = boxInFrustum( job->frustum, meshAabbMinWorld, meshAabbMaxWorld );
+        draw->screenSize = lodScreenSize( meshAabbMinWorld, meshAabbMaxWorld, cameraPos, job->pixelsPerUnit );
+    }
+}
+
+typedef struct
+{
+    const Scene* scene;
+    const OcclusionBuffer* occlusion;
+    ObjectDraw* draws; // One per scene object.
+} OcclusionJob;
+
+// Tests the bounds of visible scene objects [begin, end) against the occlusion buffer.
+static void occlusionQueriesJob( void* data, unsigned begin, unsigned end )
+{
+    const OcclusionJob* job = (const OcclusionJob*)data;
+
+    for (unsigned i = begin; i < end; ++i)
+    {
+        ObjectDraw* draw = &job->draws[ i ];
+        const Asset* mesh = job->scene->meshes[ i ];
+
+        if (draw->visible && !occlusionTestBox( job->occlusion, mesh->aabbMin, mesh->aabbMax, &draw->localToClip ))
+        {
+            draw->visible = false;
+            draw->occluded = true;
+        }
+    }
+}
 
 int main( int argc, char** argv )
 {
     (void)argc;
     (void)argv;
-    int texWidth = 0;
-    int texHeight = 0;
-    int* checkerTex = loadBMP( "checker.bmp", &texWidth, &texHeight );
-    assert( texWidth == texHeight && "drawTriangle assumes square texture dimension!" );
-    
-    SDL_Init( SDL_INIT_VIDEO );
-    const unsigned createFlags = SDL_WINDOW_SHOWN;
-    SDL_Window* win = SDL_CreateWindow( "Software Rasterizer", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, WIDTH, HEIGHT, createFlags );
-    SDL_Renderer* renderer = SDL_CreateRenderer( win, -1, SDL_RENDERER_PRESENTVSYNC );
-    if (!renderer)
-    {
-        printf( "Unable to create renderer\n" );
-    }
+    initSRGBTables();
+    traceSetThreadName( "main" );
 
-    float* zBuf = malloc( WIDTH * HEIGHT * 4 );
+    // One thread per core, including this one.
+    JobSystem jobs;
+    jobsInit( &jobs, SDL_GetCPUCount() - 1 );
 
-    SDL_Texture* renderTexture = SDL_CreateTexture( renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, WIDTH, HEIGHT );
-    void* pixels = NULL;
-    int* backBuf = malloc( WIDTH * HEIGHT * 4 );
-    int pitch = 0;
+    // Assets load while frames are drawn, see the placeholders below.
+    AssetLoader assetLoader;
+    assetLoaderInit( &assetLoader );
+    Asset* cubeAsset = assetLoadMesh( &assetLoader, "cube.obj" );
+    Asset* checkerAsset = assetLoadTexture( &assetLoader, "checker.bmp" );
+
+    SDL_Init( SDL_INIT_VIDEO );
+    const unsigned createFlags = SDL_WINDOW_SHOWN;
+    // Window size. Frames are rendered at up to this size, see ResolutionController.
+    const int outputWidth = 1920 / 2;
+    const int outputHeight = 1080 / 2;
+    SDL_Window* win = SDL_CreateWindow( "Software Rasterizer", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, outputWidth, outputHeight, createFlags );
+
+    // 3 buffers: rendering never waits for the presentation thread.
+    Presenter presenter;
+    presenterInit( &presenter, win, outputWidth, outputHeight, 3 );
+
+    // DepthFloat32, DepthUnorm24 or DepthUnorm16. Depth is reversed 1/z, whose steps grow with distance: 16 bits halves
+    // depth bandwidth but z-fights at far distances in these scenes, so opt in only for scenes with a short depth range.
+    // Sample count 1 or MAX_SAMPLES for anti-aliased edges.
+    Framebuffer framebuffer;
+    framebufferInit( &framebuffer, outputWidth, outputHeight, DepthFloat32, MAX_SAMPLES );
+
+    // F6 toggles dynamic resolution. Frames below the output size are rendered into renderColor and upscaled.
+    ResolutionController resolution;
+    resolutionInit( &resolution, outputWidth, outputHeight, 1000.0f / 60.0f );
+    bool dynamicResolution = true;
+    int* renderColor = alignedMalloc( (size_t)presenter.pitch * outputHeight, 64 );
 
-    Mesh cube[ 2 ];
-    int cubeMeshCount = 1;
-    loadObj( "cube.obj", &cube[ 0 ], &cubeMeshCount );
-    
     Frustum cameraFrustum;
 
     Matrix44 projMat;
-    makeProjection( 45.0f, WIDTH / (float)HEIGHT, 0.1f, 100.0f, &projMat );
+    makeProjection( 45.0f, outputWidth / (float)outputHeight, 0.1f, 100.0f, &projMat );
 
-    frustumSetProjection( &cameraFrustum, 45.0f, WIDTH / (float)HEIGHT, 0.1f, 100.0f );
+    frustumSetProjection( &cameraFrustum, 45.0f, outputWidth / (float)outputHeight, 0.1f, 100.0f );
+    const float tanHalfFov = tanf( 0.5f * 45.0f * 3.14159265f / 180.0f );
     
     SDL_SetWindowGrab( win, SDL_TRUE );
     SDL_SetRelativeMouseMode( SDL_TRUE );
@@ -115,9 +221,39 @@ int main( int argc, char** argv )
     float yaw = 90;
     float cameraPitch = 0;
 
-    GameObject scene[ 2 ];
-    scene[ 0 ].position = (Vec3){ -2, 0, -5 };
-    scene[ 1 ].position = (Vec3){ 2, 0, -5 };
+    Lighting lighting = { 0 };
+    lighting.ambient = (Vec3){ 0.25f, 0.25f, 0.25f };
+    lightingAddDirectional( &lighting, (Vec3){ -0.5f, -1, -0.5f }, (Vec3){ 0.8f, 0.8f, 0.75f } );
+    lightingAddPoint( &lighting, (Vec3){ 0, 2, -3 }, (Vec3){ 0.6f, 0.3f, 0.1f }, 8 );
+
+    DrawState drawState = { 0 };
+    drawState.depthWrite = true;
+    drawState.lighting = &lighting;
+    drawState.jobs = &jobs;
+
+    // Per-draw buffers of renderMesh(), freed at the end of each frame.
+    Arena frameArena;
+    arenaInit( &frameArena, 4 * 1024 * 1024 );
+    drawState.frameArena = &frameArena;
+
+    // F3 cycles through debug views.
+    DebugViews debugViews;
+    debugViewsInit( &debugViews, outputWidth, outputHeight );
+    drawState.debugViews = &debugViews;
+
+    // F5 toggles occlusion culling.
+    OcclusionBuffer occlusion;
+    occlusionInit( &occlusion, outputWidth, outputHeight );
+    bool occlusionCulling = true;
+
+    Scene scene;
+    sceneInit( &scene );
+    const unsigned opaqueCube = sceneAddObject( &scene, cubeAsset, (Vec3){ -2, 0, -5 } );
+    scene.occluders[ opaqueCube ] = true;
+    const unsigned transparentCube = sceneAddObject( &scene, cubeAsset, (Vec3){ 2, 0, -5 } );
+    scene.opacities[ transparentCube ] = 0.5f;
+
+    TransparentQueue transparentQueue = { 0 };
 
     uint32_t startTime = SDL_GetTicks();
     double deltaTime = 0.0;
@@ -125,6 +261,8 @@ int main( int argc, char** argv )
     while (1)
     {
         startTime = SDL_GetTicks();
+        TRACE_BEGIN( "frame" );
+        TRACE_BEGIN( "input" );
         
         SDL_Event e;
 
@@ -132,25 +270,70 @@ int main( int argc, char** argv )
         {
             if (e.type == SDL_QUIT)
             {
-                free( checkerTex );
-                free( zBuf );
-                free( backBuf );
+                presenterShutdown( &presenter );
+                jobsShutdown( &jobs );
+                assetLoaderShutdown( &assetLoader );
+                sceneFree( &scene );
+                arenaFree( &frameArena );
+                framebufferFree( &framebuffer );
+                debugViewsFree( &debugViews );
+                occlusionFree( &occlusion );
+                alignedFree( renderColor );
                 return 0;
             }
 
             if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_ESCAPE)
             {
-                free( cube[ 0 ].positions );
-                free( cube[ 0 ].normals );
-                free( cube[ 0 ].uvs );
-                free( cube[ 0 ].faces );
-
-                free( checkerTex );
-                free( zBuf );
-                free( backBuf );
+                presenterShutdown( &presenter );
+                jobsShutdown( &jobs );
+                assetLoaderShutdown( &assetLoader );
+                sceneFree( &scene );
+                arenaFree( &frameArena );
+                framebufferFree( &framebuffer );
+                debugViewsFree( &debugViews );
+                occlusionFree( &occlusion );
+                alignedFree( renderColor );
                 return 0;
             }
 
+            if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_F1)
+            {
+                statsDumpText( statsGetFrame(), stdout );
+            }
+
+            if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_F2)
+            {
+                statsDumpJson( statsGetFrame(), stdout );
+            }
+
+            if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_F3)
+            {
+                debugViews.view = (DebugView)((debugViews.view + 1) % DebugViewCount);
+                printf( "Debug view: %s\n", debugViewNames[ debugViews.view ] );
+            }
+
+            if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_F4)
+            {
+                if (traceWriteJson( "trace.json" ))
+                {
+                    printf( "Wrote trace.json\n" );
+                }
+            }
+
+            if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_F5)
+            {
+                occlusionCulling = !occlusionCulling;
+                printf( "Occlusion culling: %s\n", occlusionCulling ? "on" : "off" );
+            }
+
+            if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_F6)
+            {
+                dynamicResolution = !dynamicResolution;
+                resolutionSetScale( &resolution, 1 );
+                framebufferSetSize( &framebuffer, resolution.width, resolution.height );
+                printf( "Dynamic resolution: %s\n", dynamicResolution ? "on" : "off" );
+            }
+
             if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_UP)
             {
                 ++cameraPitch;
@@ -192,6 +375,8 @@ int main( int argc, char** argv )
             }
         }
 
+        TRACE_END( "input" );
+
         float yawRad = yaw * 3.14159265f / 180.0f;
         float pitchRad = cameraPitch * 3.14159265f / 180.0f;
         
@@ -200,15 +385,11 @@ int main( int argc, char** argv )
         cameraDir.z = sinf( yawRad ) * cosf( pitchRad );
         cameraFront = normalized( cameraDir );
 
-        SDL_RenderClear( renderer );
-
-        if (SDL_LockTexture( renderTexture, NULL, &pixels, &pitch ) < 0)
-        {
-            printf( "SDL_LockTexture failed!\n" );
-        }
-
-        memset( pixels, 0, WIDTH * HEIGHT * 4 );
-        memset( zBuf, 0, WIDTH * HEIGHT * 4 );
+        // Full size frames go straight into the back buffer.
+        const uint64_t renderStart = SDL_GetPerformanceCounter();
+        const bool upscale = framebuffer.width != outputWidth || framebuffer.height != outputHeight;
+        framebufferBeginFrame( &framebuffer, upscale ? renderColor : presenterBackBuffer( &presenter ), presenter.pitch );
+        debugViewsBeginFrame( &debugViews );
 
         Matrix44 worldToView;
         makeLookat( cameraPos, add( cameraPos, cameraFront ), &worldToView );
@@ -216,79 +397,149 @@ int main( int argc, char** argv )
         //printf( "cameraDir: %f, %f, %f, cameraFront: %f, %f, %f\n", cameraDir.x, cameraDir.y, cameraDir.z, cameraFront.x, cameraFront.y, cameraFront.z );
         updateFrustum( &cameraFrustum, cameraPos, cameraFront );
 
-        for (int i = 0; i < 1; ++i)
+        // Flat gray until the texture has loaded. A failed texture stays gray.
+        if (assetState( checkerAsset ) == AssetReady)
+        {
+            drawState.shadeMode = ShadeTextureBilinear;
+            drawState.texture = checkerAsset->pixels;
+            drawState.texDim = checkerAsset->texDim;
+        }
+        else
         {
-            Matrix44 meshLocalToWorld;
-            makeIdentity( &meshLocalToWorld );
-            meshLocalToWorld.m[ 12 ] = scene[ i ].position.x;
-            meshLocalToWorld.m[ 13 ] = scene[ i ].position.y;
-            meshLocalToWorld.m[ 14 ] = scene[ i ].position.z;
+            drawState.shadeMode = ShadeFlat;
+            drawState.flatColor = 0xFF808080;
+        }
 
-            Matrix44 rotation;
-            makeRotationXYZ( angleDeg, angleDeg, angleDeg, &rotation );
+        // Objects aren't drawn until their mesh has loaded, see sceneUpdateTransforms().
+        for (unsigned i = 0; i < scene.objectCount; ++i)
+        {
+            sceneSetRotation( &scene, i, (Vec3){ angleDeg, angleDeg, angleDeg } );
+        }
 
-            multiplySIMD( &rotation, &meshLocalToWorld, &meshLocalToWorld );
-        
-            Matrix44 localToView;
-            multiplySIMD( &meshLocalToWorld, &worldToView, &localToView );
+        sceneUpdateTransforms( &scene, &jobs );
 
-            Matrix44 localToClip;
-            multiplySIMD( &localToView, &projMat, &localToClip );
+        Matrix44 worldToClip;
+        multiplySIMD( &worldToView, &projMat, &worldToClip );
 
-            angleDeg += 0.5f;
+        ObjectDraw* objectDraws = arenaAlloc( &frameArena, scene.objectCount * sizeof( ObjectDraw ) );
+        const float pixelsPerUnit = framebuffer.height * 0.5f / tanHalfFov;
+        CullJob cullJob = { &scene, &cameraFrustum, &worldToClip, cameraPos, pixelsPerUnit, objectDraws };
+        jobsParallelFor( &jobs, "culling", scene.objectCount, 16, cullObjectsJob, &cullJob );
 
-            Vec3 meshAabbWorld[ 8 ];
-            Vec3 meshAabbMinWorld = cube[ 0 ].aabbMin;
-            Vec3 meshAabbMaxWorld = cube[ 0 ].aabbMax;
-            //printf( "aabMin: %f, %f, %f, aabMax: %f, %f, %f\n", cube.aabbMin.x, cube.aabbMin.y, cube.aabbMin.z, cube.aabbMax.x, cube.aabbMax.y, cube.aabbMax.z );
-            getCorners( meshAabbMinWorld, meshAabbMaxWorld, meshAabbWorld );
+        if (occlusionCulling)
+        {
+            TRACE_BEGIN( "occluders" );
+            occlusionClear( &occlusion );
 
-            for (unsigned v = 0; v < 8; ++v)
+            for (unsigned i = 0; i < scene.objectCount; ++i)
             {
-                Vec3 res;
-                transformPoint( meshAabbWorld[ v ], &meshLocalToWorld, &res );
-                meshAabbWorld[ v ] = res;
+                if (objectDraws[ i ].visible && scene.occluders[ i ])
+                {
+                    const Asset* model = scene.meshes[ i ];
+
+                    for (int subMesh = 0; subMesh < model->meshCount; ++subMesh)
+                    {
+                        occlusionAddOccluder( &occlusion, &model->meshes[ subMesh ], &scene.localToWorld[ i ], &objectDraws[ i ].localToClip, &frameArena );
+                    }
+                }
             }
 
-            getMinMax( meshAabbWorld, 8, &meshAabbMinWorld, &meshAabbMaxWorld );
+            TRACE_END( "occluders" );
+
+            // Occluders are tested too, one can hide another.
+            OcclusionJob occlusionJob = { &scene, &occlusion, objectDraws };
+            jobsParallelFor( &jobs, "occlusion queries", scene.objectCount, 16, occlusionQueriesJob, &occlusionJob );
+        }
 
-            if (cameraPos.x > meshAabbMinWorld.x && cameraPos.x < meshAabbMaxWorld.x &&
-                cameraPos.y > meshAabbMinWorld.y && cameraPos.y < meshAabbMaxWorld.y &&
-                cameraPos.z > meshAabbMinWorld.z && cameraPos.z < meshAabbMaxWorld.z)
+        for (unsigned i = 0; i < scene.objectCount; ++i)
+        {
+            // Still loading.
+            if (scene.dirty[ i ])
             {
-                printf("camera inside AABB\n");
+                continue;
             }
 
-            if (boxInFrustum( &cameraFrustum, meshAabbMinWorld, meshAabbMaxWorld ))
-            {           
-                for (int subMesh = 0; subMesh < cubeMeshCount; ++subMesh)
+            const Asset* model = scene.meshes[ i ];
+            const Matrix44* meshLocalToWorld = &scene.localToWorld[ i ];
+            const Matrix44* localToClip = &objectDraws[ i ].localToClip;
+
+            if (objectDraws[ i ].visible)
+            {
+                for (int subMesh = 0; subMesh < model->meshCount; ++subMesh)
                 {
-                    //printf( "minAABBWorld: %f, %f, %f, maxAABBWorld: %f, %f, %f\n", meshAabbMinWorld.x, meshAabbMinWorld.y, meshAabbMinWorld.z, meshAabbMaxWorld.x, meshAabbMaxWorld.y, meshAabbMaxWorld.z );
-                    renderMesh( &cube[ subMesh ], &localToClip, pitch, checkerTex, texWidth, zBuf, pixels );
+                    const Mesh* mesh = meshLodsSelect( &model->lods[ subMesh ], objectDraws[ i ].screenSize );
+
+                    if (scene.opacities[ i ] < 1)
+                    {
+                        DrawState transparentState = drawState;
+                        transparentState.opacity = scene.opacities[ i ];
+                        transparentQueueAdd( &transparentQueue, mesh, meshLocalToWorld, localToClip, &transparentState,
+                                             dot( sub( scenePosition( &scene, i ), cameraPos ), cameraFront ) );
+                    }
+                    else
+                    {
+                        renderMesh( mesh, meshLocalToWorld, localToClip, &drawState, &framebuffer );
+                    }
                 }
             }
-        }
-        
-        for (int y = 0; y < mini( texHeight, HEIGHT ); ++y)
-        {
-            for (int x = 0; x < mini( texWidth, WIDTH ); ++x)
+            else
             {
-                backBuf[ y * WIDTH + x ] = checkerTex[ y * texWidth + x ];
+                for (int subMesh = 0; subMesh < model->meshCount; ++subMesh)
+                {
+                    STAT_ADD( StatTrianglesSubmitted, model->meshes[ subMesh ].faceCount );
+                    STAT_ADD( objectDraws[ i ].occluded ? StatTrianglesCulledOcclusion : StatTrianglesCulledFrustum, model->meshes[ subMesh ].faceCount );
+                }
             }
         }
-        //memcpy( pixels, backBuf, WIDTH * HEIGHT * 4 );
 
-        SDL_UnlockTexture( renderTexture );
+        angleDeg += 0.5f;
+
+        TRACE_BEGIN( "transparent" );
+        transparentQueueRender( &transparentQueue, &framebuffer );
+        TRACE_END( "transparent" );
+
+        TRACE_BEGIN( "resolve" );
+        framebufferResolve( &framebuffer );
+        debugViewsResolve( &debugViews, &framebuffer );
+        TRACE_END( "resolve" );
+
+        if (upscale)
+        {
+            TRACE_BEGIN( "upscale" );
+            upscaleBilinear( renderColor, framebuffer.width, framebuffer.height, presenter.pitch, presenterBackBuffer( &presenter ), outputWidth, outputHeight,
+                             presenter.pitch, &jobs, &frameArena );
+            TRACE_END( "upscale" );
+        }
+
+        // Waiting for a free buffer isn't rendering cost, lowering the resolution wouldn't shorten it.
+        const float renderMs = (float)((SDL_GetPerformanceCounter() - renderStart) * 1000.0 / (double)SDL_GetPerformanceFrequency());
+
+        if (dynamicResolution && resolutionUpdate( &resolution, renderMs ))
+        {
+            framebufferSetSize( &framebuffer, resolution.width, resolution.height );
+        }
 
-        SDL_RenderCopy( renderer, renderTexture, NULL, NULL );
-        SDL_RenderPresent( renderer );
+        TRACE_BEGIN( "submit" );
+        presenterSubmit( &presenter );
+        TRACE_END( "submit" );
+        statsEndFrame();
+        arenaReset( &frameArena );
+        jobsResetScratch( &jobs );
+        TRACE_END( "frame" );
 
         uint32_t endTime = SDL_GetTicks();
         deltaTime = (endTime - startTime) / 1000.0;
     }
 
-    free( backBuf );
-    free( checkerTex );
+    presenterShutdown( &presenter );
+    jobsShutdown( &jobs );
+    assetLoaderShutdown( &assetLoader );
+    sceneFree( &scene );
+    arenaFree( &frameArena );
+    framebufferFree( &framebuffer );
+    debugViewsFree( &debugViews );
+    occlusionFree( &occlusion );
+    alignedFree( renderColor );
 
     return 0;
 }
@@ -1,6 +1,12 @@
 // This is an independent project of an individual developer. Dear PVS-Studio, please check it.
 // PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
 
+#if _MSC_VER
+#define FORCE_INLINE static __forceinline
+#else
+#define FORCE_INLINE static inline __attribute__((always_inline))
+#endif
+
 typedef struct
 {
     float m[ 16 ];
@@ -119,6 +125,19 @@ void transformPoint( Vec3 point, const Matrix44* mat, Vec3* out )
     out->z = tmp.z;
 }
 
+// Like transformPoint() but ignores translation.
+void transformDirection( Vec3 dir, const Matrix44* mat, Vec3* out )
+{
+    Vec3 tmp;
+    tmp.x = mat->m[ 0 ] * dir.x + mat->m[ 4 ] * dir.y + mat->m[ 8 ] * dir.z;
+    tmp.y = mat->m[ 1 ] * dir.x + mat->m[ 5 ] * dir.y + mat->m[ 9 ] * dir.z;
+    tmp.z = mat->m[ 2 ] * dir.x + mat->m[ 6 ] * dir.y + mat->m[ 10 ] * dir.z;
+
+    out->x = tmp.x;
+    out->y = tmp.y;
+    out->z = tmp.z;
+}
+
 #ifdef ARCH_X64
 void multiplySIMD( const Matrix44* ma, const Matrix44* mb, Matrix44* out )
 {
@@ -193,19 +212,43 @@ void multiplySIMD( const Matrix44* ma, const Matrix44* mb, Matrix44* out )
     out->z = v4.z;
     }*/
 
-Vec3 localToRaster( Vec3 v, const Matrix44* localToClip )
+// width and height are the render target's.
+Vec3 localToRaster( Vec3 v, const Matrix44* localToClip, int width, int height )
 {
     Vec3 vertexNDC;
     transformPoint( v, localToClip, &vertexNDC );
 
     Vec3 output;
-    output.x = WIDTH * 0.5f + vertexNDC.x * WIDTH  * 0.5f / vertexNDC.z;
-    output.y = HEIGHT * 0.5f + vertexNDC.y * HEIGHT * 0.5f / vertexNDC.z;
+    output.x = width * 0.5f + vertexNDC.x * width  * 0.5f / vertexNDC.z;
+    output.y = height * 0.5f + vertexNDC.y * height * 0.5f / vertexNDC.z;
     output.z = vertexNDC.z;
 
     return output;
 }
 
+// Local space point that localToRaster() projects from: clip x, y and z are all 0 there, because the
+// rasterizer divides by clip z. Returns false if localToClip is singular.
+bool projectionCenter( const Matrix44* localToClip, Vec3* outCenter )
+{
+    const float* m = localToClip->m;
+    const Vec3 cx = { m[ 0 ], m[ 1 ], m[ 2 ] };
+    const Vec3 cy = { m[ 4 ], m[ 5 ], m[ 6 ] };
+    const Vec3 cz = { m[ 8 ], m[ 9 ], m[ 10 ] };
+    const Vec3 t = { -m[ 12 ], -m[ 13 ], -m[ 14 ] };
+    const float det = dot( cx, cross( cy, cz ) );
+
+    if (det == 0)
+    {
+        return false;
+    }
+
+    // Cramer's rule.
+    outCenter->x = dot( t, cross( cy, cz ) ) / det;
+    outCenter->y = dot( cx, cross( t, cz ) ) / det;
+    outCenter->z = dot( cx, cross( cy, t ) ) / det;
+    return true;
+}
+
 float toSRGB( float f )
 {
     if (f > 1)
@@ -220,7 +263,7 @@ float toSRGB( float f )
 
     float s = f * 12.92f;
 
-    if (s > 0.0031308f)
+    if (f > 0.0031308f)
     {
         s = 1.055f * powf( f, 1 / 2.4f ) - 0.055f;
     }
@@ -254,6 +297,11 @@ float sRGBToLinear( float s )
     return 0;
 }
 
+float orient2D( float ax, float ay, float bx, float by, float cx, float cy )
+{
+    return (bx - ax) * (cy - ay) - (by - ay) * (cx - ax);
+}
+
 bool isBackface( float x1, float y1, float x2, float y2, float x3, float y3 )
 {
     return ((x3 - x1) * (y3 - y2) - (x3 - x2) * (y3 - y1)) < 0;
@@ -0,0 +1,227 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+// Software occlusion culling. Large occluders are rasterized depth-only into a low-resolution buffer,
+// then objects are tested against it before they are drawn. Occluders write their farthest depth over each
+// pixel they cover and an object is hidden only if its nearest depth is behind the buffer everywhere under
+// its screen bounds. Occluders only cover the pixels that they cover entirely, so silhouettes shrink by up to a
+// pixel and edges shared by two triangles leave a crack. Both only cost culling, never hide a visible object.
+// Depth is reversed like the framebuffer's: 0 is far or not covered by an occluder.
+#define OCCLUSION_SCALE 4 // Output pixels per occlusion buffer pixel in x and y.
+
+typedef struct
+{
+    float* depth;
+    int width;
+    int height;
+    int pitch; // In floats, a multiple of 4.
+    int targetWidth; // Raster space that occluders and boxes are projected to before scaling down.
+    int targetHeight;
+} OcclusionBuffer;
+
+// width and height are the output's. The buffer doesn't follow the render resolution, only the aspect ratio matters.
+void occlusionInit( OcclusionBuffer* occlusion, int width, int height )
+{
+    occlusion->targetWidth = width;
+    occlusion->targetHeight = height;
+    occlusion->width = (width + OCCLUSION_SCALE - 1) / OCCLUSION_SCALE;
+    occlusion->height = (height + OCCLUSION_SCALE - 1) / OCCLUSION_SCALE;
+    occlusion->pitch = (occlusion->width + 3) & ~3;
+    occlusion->depth = alignedMalloc( (size_t)occlusion->pitch * occlusion->height * sizeof( float ), 64 );
+}
+
+void occlusionFree( OcclusionBuffer* occlusion )
+{
+    alignedFree( occlusion->depth );
+    occlusion->depth = NULL;
+}
+
+void occlusionClear( OcclusionBuffer* occlusion )
+{
+    memset( occlusion->depth, 0, (size_t)occlusion->pitch * occlusion->height * sizeof( float ) );
+}
+
+// Maps a raster coordinate of the target size to the occlusion buffer. Pixel centers are at integer coordinates in both.
+FORCE_INLINE float occlusionCoordinate( float x )
+{
+    return (x + 0.5f) / OCCLUSION_SCALE - 0.5f;
+}
+
+// Depth-only rasterizer for occluders. setup must be clipped to the occlusion buffer. Writes only pixels that are entirely
+// inside the triangle, the fill convention thresholds are ignored. The depth plane is moved half a pixel towards the far
+// corner, so the written depth is the farthest over the pixel.
+static void occlusionRasterTriangle( OcclusionBuffer* occlusion, const TriangleSetup* setup )
+{
+    const float a01 = setup->a01, b01 = setup->b01;
+    const float a12 = setup->a12, b12 = setup->b12;
+    const float a20 = setup->a20, b20 = setup->b20;
+    const float depthScale = setup->depthScale;
+    const float dzdx = depthScale * (a12 * setup->z1 + a20 * setup->z2 + a01 * setup->z3);
+    const float dzdy = depthScale * (b12 * setup->z1 + b20 * setup->z2 + b01 * setup->z3);
+
+    float w0row = setup->w0row;
+    float w1row = setup->w1row;
+    float w2row = setup->w2row;
+    float depthRow = depthScale * (w0row * setup->z1 + w1row * setup->z2 + w2row * setup->z3) - 0.5f * (fabsf( dzdx ) + fabsf( dzdy ));
+
+    // An edge function's smallest value over a pixel is half a step in x and y below its value at the center,
+    // so testing the shifted functions against 0 tests the whole pixel.
+    w0row -= 0.5f * (fabsf( a12 ) + fabsf( b12 ));
+    w1row -= 0.5f * (fabsf( a20 ) + fabsf( b20 ));
+    w2row -= 0.5f * (fabsf( a01 ) + fabsf( b01 ));
+
+#ifdef ARCH_X64
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 laneOffsets = _mm_setr_ps( 0, 1, 2, 3 );
+    const __m128 minxv = _mm_set1_ps( (float)setup->minx );
+    const __m128 maxxv = _mm_set1_ps( (float)setup->maxx );
+#endif
+
+    for (int y = setup->miny; y <= setup->maxy; ++y)
+    {
+        float* row = &occlusion->depth[ y * occlusion->pitch ];
+
+#ifdef ARCH_X64
+        // Aligned groups of 4, lanes outside the bounds are masked out.
+        for (int x = setup->minx & ~3; x <= setup->maxx; x += 4)
+        {
+            const __m128 xs = _mm_add_ps( _mm_set1_ps( (float)x ), laneOffsets );
+            const __m128 k = _mm_sub_ps( xs, minxv );
+            const __m128 w0 = _mm_add_ps( _mm_set1_ps( w0row ), _mm_mul_ps( k, _mm_set1_ps( a12 ) ) );
+            const __m128 w1 = _mm_add_ps( _mm_set1_ps( w1row ), _mm_mul_ps( k, _mm_set1_ps( a20 ) ) );
+            const __m128 w2 = _mm_add_ps( _mm_set1_ps( w2row ), _mm_mul_ps( k, _mm_set1_ps( a01 ) ) );
+            const __m128 depth = _mm_add_ps( _mm_set1_ps( depthRow ), _mm_mul_ps( k, _mm_set1_ps( dzdx ) ) );
+
+            __m128 mask = _mm_and_ps( _mm_cmpge_ps( w0, zero ), _mm_and_ps( _mm_cmpge_ps( w1, zero ), _mm_cmpge_ps( w2, zero ) ) );
+            mask = _mm_and_ps( mask, _mm_and_ps( _mm_cmpge_ps( xs, minxv ), _mm_cmple_ps( xs, maxxv ) ) );
+
+            const __m128 old = _mm_load_ps( &row[ x ] );
+            _mm_store_ps( &row[ x ], _mm_or_ps( _mm_and_ps( mask, _mm_max_ps( old, depth ) ), _mm_andnot_ps( mask, old ) ) );
+        }
+#else
+        for (int x = setup->minx; x <= setup->maxx; ++x)
+        {
+            const float k = (float)(x - setup->minx);
+
+            if (w0row + a12 * k >= 0 && w1row + a20 * k >= 0 && w2row + a01 * k >= 0)
+            {
+                row[ x ] = fmaxf( row[ x ], depthRow + dzdx * k );
+            }
+        }
+#endif
+
+        w0row += b12;
+        w1row += b20;
+        w2row += b01;
+        depthRow += dzdy;
+    }
+}
+
+// Rasterizes mesh's front faces into the occlusion buffer. Triangles that cross the near plane are skipped,
+// which only makes the occluder smaller. arena holds the transformed vertices during the call.
+void occlusionAddOccluder( OcclusionBuffer* occlusion, const Mesh* mesh, const Matrix44* localToWorld, const Matrix44* localToClip, Arena* arena )
+{
+    const ArenaMark mark = arenaMark( arena );
+    Vertex* vertices = arenaAlloc( arena, mesh->vertexCount * sizeof( Vertex ) );
+    transformVertices( mesh, 0, mesh->vertexCount, localToWorld, localToClip, occlusion->targetWidth, occlusion->targetHeight, NULL, vertices );
+
+    for (unsigned i = 0; i < mesh->vertexCount; ++i)
+    {
+        vertices[ i ].x = occlusionCoordinate( vertices[ i ].x );
+        vertices[ i ].y = occlusionCoordinate( vertices[ i ].y );
+    }
+
+    for (unsigned f = 0; f < mesh->faceCount; ++f)
+    {
+        const Vertex* cv0 = &vertices[ mesh->faces[ f ].a ];
+        const Vertex* cv1 = &vertices[ mesh->faces[ f ].b ];
+        const Vertex* cv2 = &vertices[ mesh->faces[ f ].c ];
+
+        if (cv0->z <= 0 || cv1->z <= 0 || cv2->z <= 0)
+        {
+            continue;
+        }
+
+        // Same winding as setupMeshTriangle().
+        const float area = (cv1->x - cv0->x) * (cv1->y - cv2->y) - (cv1->x - cv2->x) * (cv1->y - cv0->y);
+        TriangleSetup setup;
+        TriangleSetup clipped;
+
+        // Multisampled setup rounds the bounds outwards.
+        if (area > 0 && setupTriangle( cv0, cv2, cv1, occlusion->width, occlusion->height, true, 0, false, &setup ) &&
+            clipTriangleSetup( &setup, 0, 0, occlusion->width - 1, occlusion->height - 1, &clipped ))
+        {
+            occlusionRasterTriangle( occlusion, &clipped );
+        }
+    }
+
+    arenaRelease( arena, mark );
+}
+
+// Returns false if the box is hidden by the occluders. Boxes that cross the near plane are visible.
+bool occlusionTestBox( const OcclusionBuffer* occlusion, Vec3 aabbMin, Vec3 aabbMax, const Matrix44* localToClip )
+{
+    Vec3 corners[ 8 ];
+    getCorners( aabbMin, aabbMax, corners );
+
+    float minx = 999999.0f, miny = 999999.0f, minz = 999999.0f;
+    float maxx = -999999.0f, maxy = -999999.0f;
+
+    for (int i = 0; i < 8; ++i)
+    {
+        const Vec3 p = localToRaster( corners[ i ], localToClip, occlusion->targetWidth, occlusion->targetHeight );
+
+        if (p.z <= 0)
+        {
+            return true;
+        }
+
+        minx = fminf( minx, p.x );
+        miny = fminf( miny, p.y );
+        minz = fminf( minz, p.z );
+        maxx = fmaxf( maxx, p.x );
+        maxy = fmaxf( maxy, p.y );
+    }
+
+    // Every occlusion buffer pixel that the screen bounds touch.
+    const int x0 = maxi( 0, (int)ceilf( occlusionCoordinate( minx ) - 0.5f ) );
+    const int y0 = maxi( 0, (int)ceilf( occlusionCoordinate( miny ) - 0.5f ) );
+    const int x1 = mini( occlusion->width - 1, (int)floorf( occlusionCoordinate( maxx ) + 0.5f ) );
+    const int y1 = mini( occlusion->height - 1, (int)floorf( occlusionCoordinate( maxy ) + 0.5f ) );
+    const float nearest = DEPTH_NEAR_Z / minz;
+
+#ifdef ARCH_X64
+    const __m128 nearestv = _mm_set1_ps( nearest );
+    const __m128 laneOffsets = _mm_setr_ps( 0, 1, 2, 3 );
+    const __m128 x0v = _mm_set1_ps( (float)x0 );
+    const __m128 x1v = _mm_set1_ps( (float)x1 );
+#endif
+
+    for (int y = y0; y <= y1; ++y)
+    {
+        const float* row = &occlusion->depth[ y * occlusion->pitch ];
+
+#ifdef ARCH_X64
+        for (int x = x0 & ~3; x <= x1; x += 4)
+        {
+            const __m128 xs = _mm_add_ps( _mm_set1_ps( (float)x ), laneOffsets );
+            const __m128 inside = _mm_and_ps( _mm_cmpge_ps( xs, x0v ), _mm_cmple_ps( xs, x1v ) );
+
+            if (_mm_movemask_ps( _mm_and_ps( inside, _mm_cmple_ps( _mm_load_ps( &row[ x ] ), nearestv ) ) ))
+            {
+                return true;
+            }
+        }
+#else
+        for (int x = x0; x <= x1; ++x)
+        {
+            if (row[ x ] <= nearest)
+            {
+                return true;
+            }
+        }
+#endif
+    }
+
+    return false;
+}
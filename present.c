@@ -0,0 +1,221 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+// Frames are rendered into program-owned, cache line aligned color buffers instead of a locked
+// streaming texture, which can be write-combined driver memory. presenterSubmit() hands a finished
+// buffer to the presentation thread, which uploads and presents it while the next frame renders.
+//
+// With 2 buffers, submitting waits until the previous frame has been uploaded.
+// With 3 buffers, submitting never waits: a frame that wasn't picked up before the next one
+// finished is replaced by it.
+//
+// SDL supports the render API only on the main thread on macOS. There PRESENT_THREAD is 0 and
+// presenterSubmit() uploads and presents on the calling thread, without the overlap.
+#ifndef PRESENT_THREAD
+#ifdef __APPLE__
+#define PRESENT_THREAD 0
+#else
+#define PRESENT_THREAD 1
+#endif
+#endif
+
+#define MAX_PRESENT_BUFFERS 3
+
+typedef struct
+{
+    SDL_Window* window;
+    SDL_Renderer* renderer; // Only used by the thread that created it.
+    SDL_Texture* texture;
+    SDL_Thread* thread;     // NULL unless PRESENT_THREAD.
+    SDL_mutex* mutex;
+    SDL_cond* cond; // Signaled when pendingIndex or presentingIndex changes.
+    int* buffers[ MAX_PRESENT_BUFFERS ];
+    int bufferCount;
+    int pitch; // In bytes, a multiple of 64.
+    int width;
+    int height;
+    int renderIndex;     // Owned by the rendering thread.
+    int pendingIndex;    // Finished frame waiting for upload, -1 if none.
+    int presentingIndex; // Frame being uploaded, -1 if none.
+    bool quit;
+} Presenter;
+
+// Render API must be used from the thread that created the renderer.
+static void presentCreateRenderer( Presenter* presenter )
+{
+    presenter->renderer = SDL_CreateRenderer( presenter->window, -1, SDL_RENDERER_PRESENTVSYNC );
+    if (!presenter->renderer)
+    {
+        printf( "Unable to create renderer\n" );
+    }
+
+    presenter->texture = SDL_CreateTexture( presenter->renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, presenter->width, presenter->height );
+}
+
+static void presentDestroyRenderer( Presenter* presenter )
+{
+    SDL_DestroyTexture( presenter->texture );
+    SDL_DestroyRenderer( presenter->renderer );
+    presenter->texture = NULL;
+    presenter->renderer = NULL;
+}
+
+static void presentUpload( Presenter* presenter, int index )
+{
+    TRACE_BEGIN( "upload" );
+    SDL_UpdateTexture( presenter->texture, NULL, presenter->buffers[ index ], presenter->pitch );
+    TRACE_END( "upload" );
+}
+
+static void presentTexture( Presenter* presenter )
+{
+    TRACE_BEGIN( "present" );
+    SDL_RenderClear( presenter->renderer );
+    SDL_RenderCopy( presenter->renderer, presenter->texture, NULL, NULL );
+    SDL_RenderPresent( presenter->renderer );
+    TRACE_END( "present" );
+}
+
+#if PRESENT_THREAD
+static int presentThread( void* data )
+{
+    Presenter* presenter = (Presenter*)data;
+    traceSetThreadName( "present" );
+    presentCreateRenderer( presenter );
+
+    SDL_LockMutex( presenter->mutex );
+
+    while (1)
+    {
+        while (presenter->pendingIndex < 0 && !presenter->quit)
+        {
+            SDL_CondWait( presenter->cond, presenter->mutex );
+        }
+
+        if (presenter->pendingIndex < 0)
+        {
+            break;
+        }
+
+        const int index = presenter->pendingIndex;
+        presenter->presentingIndex = index;
+        presenter->pendingIndex = -1;
+        SDL_UnlockMutex( presenter->mutex );
+
+        presentUpload( presenter, index );
+
+        // The buffer can be rendered into again while this thread waits for vsync.
+        SDL_LockMutex( presenter->mutex );
+        presenter->presentingIndex = -1;
+        SDL_CondBroadcast( presenter->cond );
+        SDL_UnlockMutex( presenter->mutex );
+
+        presentTexture( presenter );
+
+        SDL_LockMutex( presenter->mutex );
+    }
+
+    SDL_UnlockMutex( presenter->mutex );
+    presentDestroyRenderer( presenter );
+
+    return 0;
+}
+#endif
+
+// bufferCount is 2 or 3. Creates the renderer on the presentation thread, or on the calling thread unless PRESENT_THREAD.
+void presenterInit( Presenter* presenter, SDL_Window* window, int width, int height, int bufferCount )
+{
+    assert( bufferCount >= 2 && bufferCount <= MAX_PRESENT_BUFFERS );
+
+    presenter->window = window;
+    presenter->width = width;
+    presenter->height = height;
+    presenter->bufferCount = bufferCount;
+    presenter->pitch = (width * 4 + 63) & ~63;
+
+    for (int i = 0; i < MAX_PRESENT_BUFFERS; ++i)
+    {
+        presenter->buffers[ i ] = i < bufferCount ? alignedMalloc( (size_t)presenter->pitch * height, 64 ) : NULL;
+    }
+
+    presenter->renderIndex = 0;
+    presenter->pendingIndex = -1;
+    presenter->presentingIndex = -1;
+    presenter->quit = false;
+    presenter->renderer = NULL;
+    presenter->texture = NULL;
+    presenter->thread = NULL;
+    presenter->mutex = SDL_CreateMutex();
+    presenter->cond = SDL_CreateCond();
+
+#if PRESENT_THREAD
+    presenter->thread = SDL_CreateThread( presentThread, "present", presenter );
+#else
+    presentCreateRenderer( presenter );
+#endif
+}
+
+// Presents the last submitted frame before returning.
+void presenterShutdown( Presenter* presenter )
+{
+    SDL_LockMutex( presenter->mutex );
+    presenter->quit = true;
+    SDL_CondBroadcast( presenter->cond );
+    SDL_UnlockMutex( presenter->mutex );
+
+#if PRESENT_THREAD
+    SDL_WaitThread( presenter->thread, NULL );
+#else
+    presentDestroyRenderer( presenter );
+#endif
+    SDL_DestroyCond( presenter->cond );
+    SDL_DestroyMutex( presenter->mutex );
+
+    for (int i = 0; i < MAX_PRESENT_BUFFERS; ++i)
+    {
+        alignedFree( presenter->buffers[ i ] );
+        presenter->buffers[ i ] = NULL;
+    }
+}
+
+// Buffer to render the current frame into. Stays valid until presenterSubmit().
+int* presenterBackBuffer( const Presenter* presenter )
+{
+    return presenter->buffers[ presenter->renderIndex ];
+}
+
+// Queues the back buffer for presentation and selects the next one.
+void presenterSubmit( Presenter* presenter )
+{
+#if PRESENT_THREAD
+    SDL_LockMutex( presenter->mutex );
+
+    // With 2 buffers, replacing the pending frame would drop it.
+    while (presenter->bufferCount < 3 && presenter->pendingIndex >= 0)
+    {
+        SDL_CondWait( presenter->cond, presenter->mutex );
+    }
+
+    presenter->pendingIndex = presenter->renderIndex;
+    SDL_CondBroadcast( presenter->cond );
+
+    while (1)
+    {
+        for (int i = 0; i < presenter->bufferCount; ++i)
+        {
+            if (i != presenter->pendingIndex && i != presenter->presentingIndex)
+            {
+                presenter->renderIndex = i;
+                SDL_UnlockMutex( presenter->mutex );
+                return;
+            }
+        }
+
+        SDL_CondWait( presenter->cond, presenter->mutex );
+    }
+#else
+    presentUpload( presenter, presenter->renderIndex );
+    presentTexture( presenter );
+    presenter->renderIndex = (presenter->renderIndex + 1) % presenter->bufferCount;
+#endif
+}
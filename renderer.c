@@ -5,6 +5,7 @@ typedef struct
 {
     float x, y, z;
     float u, v;
+    float r, g, b; // Vertex lighting, 1 when unlit.
 } Vertex;
 
 typedef struct
@@ -17,6 +18,21 @@ typedef struct
     float u, v;
 } UV;
 
+#define MESH_CLUSTER_SIZE 64 // Faces per cluster.
+
+// Consecutive faces of a mesh, bounded by a sphere and with all normals inside a cone,
+// so that they can be backface culled together before any vertex work, see clusterIsBackfacing().
+typedef struct
+{
+    Vec3 center;
+    float radius;
+    Vec3 coneAxis;
+    float coneCos; // Cosine of the cone's half angle, 0 or less if the cluster can't be culled.
+    float coneSin;
+    unsigned firstVertex; // Vertices the faces use are in [firstVertex, endVertex).
+    unsigned endVertex;
+} MeshCluster;
+
 typedef struct
 {
     Vec3* positions;
@@ -27,6 +43,8 @@ typedef struct
     unsigned faceCount;
     Vec3 aabbMin;
     Vec3 aabbMax;
+    MeshCluster* clusters; // Faces [i * MESH_CLUSTER_SIZE, (i + 1) * MESH_CLUSTER_SIZE) form cluster i, see meshBuildClusters().
+    void* memory; // All arrays are in this one allocation, see meshFree().
 } Mesh;
 
 float edgeFunction( float ax, float ay, float bx, float by, float cx, float cy )
@@ -34,14 +52,9 @@ float edgeFunction( float ax, float ay, float bx, float by, float cx, float cy )
     return (cx - ax) * (by - ay) - (cy - ay) * (bx - ax);
 }
 
-float orient2D( float ax, float ay, float bx, float by, float cx, float cy )
-{
-    return (bx - ax) * (cy - ay) - (by - ay) * (cx - ax);
-}
-
 // Vertices must be in CCW order! texture must be a 4-channel 32-bit format.
 // Reference implementation, not optimized. Optimized version is below in drawTriangle2().
-void drawTriangle( Vertex* v1, Vertex* v2, Vertex* v3, int rowPitch, int* texture, int texDim, float* zBuffer, int* outBuffer )
+void drawTriangle( Vertex* v1, Vertex* v2, Vertex* v3, int rowPitch, int* texture, int texDim, DepthBuffer* depthBuffer, int* outBuffer )
 {
     float x1 = v1->x;
     float x2 = v2->x;
@@ -69,11 +82,11 @@ void drawTriangle( Vertex* v1, Vertex* v2, Vertex* v3, int rowPitch, int* textur
     // Clip against screen bounds
     minx = fmax( minx, 0 );
     miny = fmax( miny, 0 );
-    maxx = fmin( maxx, WIDTH - 1 );
-    maxy = fmin( maxy, HEIGHT - 1 );
+    maxx = fmin( maxx, depthBuffer->width - 1 );
+    maxy = fmin( maxy, depthBuffer->height - 1 );
 
     Uint32* target = (Uint32*)((Uint8*)outBuffer + miny * rowPitch);
-    float* targetZ = (float*)((Uint8*)zBuffer + miny * rowPitch);
+    Uint8* targetZ = depthBufferRow( depthBuffer, miny );
 
     float area = edgeFunction( x1, y1, x2, y2, x3, y3 );
 
@@ -104,12 +117,12 @@ void drawTriangle( Vertex* v1, Vertex* v2, Vertex* v3, int rowPitch, int* textur
 
                 float z = 1.0f / (w0 * z1 + w1 * z2 + w2 * z3);
 
-                //if (z > targetZ[ x ] )
+                //if (!depthTestAndWrite( depthBuffer->format, targetZ, x, DEPTH_NEAR_Z / z ))
                 {
                 //    continue;
                 }
 
-                targetZ[ x ] = z;
+                depthWrite( depthBuffer->format, targetZ, x, DEPTH_NEAR_Z / z );
 
                 s *= z;
                 t *= z;
@@ -121,15 +134,348 @@ void drawTriangle( Vertex* v1, Vertex* v2, Vertex* v3, int rowPitch, int* textur
             }
         }
 
-        target += WIDTH;
-        targetZ += WIDTH;
+        target = (Uint32*)((Uint8*)target + rowPitch);
+        targetZ += depthBuffer->pitch;
     }
 }
 
-// Vertices must be in CCW order! texture must be a 4-channel 32-bit format.
-// Optimized version of drawTriangle().
-// texture dimension must be square (width == height)
-void drawTriangle2( Vertex* v1, Vertex* v2, Vertex* v3, int rowPitch, int* texture, int texDim, int forceColor, float* zBuffer, int* outBuffer )
+typedef enum
+{
+    ShadeDepthOnly = 0,
+    ShadeFlat,
+    ShadeTextureNearest,
+    ShadeTextureBilinear,
+    ShadeModeCount
+} ShadeMode;
+
+// Rasterizer flags. DepthWrite and Blend are combined with DepthFormat and ShadeMode to select a variant, see rasterVariant().
+// Lit and Msaa cost a branch per pixel or row, so they are taken from the draw at run time, see rasterRuntimeFlags().
+enum
+{
+    RasterDepthWrite = 1 << 0,
+    RasterLit        = 1 << 1, // Modulates color by interpolated vertex lighting. Set when DrawState.lighting != NULL.
+    RasterBlend      = 1 << 2, // Premultiplied alpha blending with DrawState.opacity. Depth is tested but never written.
+    RasterMsaa       = 1 << 3  // Per-sample coverage and depth, shading once per pixel. Set when the framebuffer has MAX_SAMPLES samples.
+};
+
+typedef enum
+{
+    RasterVariantNone = 0,
+    RasterVariantDepthWrite,
+    RasterVariantBlend,
+    RasterVariantCount
+} RasterVariant;
+
+// Per-draw pipeline state. Selects a rasterizer variant once per draw, see selectRasterTriangle().
+typedef struct
+{
+    ShadeMode shadeMode;
+    bool depthWrite;
+    int flatColor; // Used by ShadeFlat.
+    int* texture;  // Used by textured modes. Must be square and a 4-channel 32-bit format.
+    int texDim;
+    const Lighting* lighting; // NULL disables vertex lighting.
+    bool blend;    // Transparent draw, see transparency.c.
+    float opacity; // Alpha of blended draws. Shaded color is premultiplied by it.
+    DebugViews* debugViews; // Records per-triangle costs when a view is active, can be NULL.
+    JobSystem* jobs; // Runs renderMesh()'s stages on worker threads, NULL runs them on the calling thread.
+    Arena* frameArena; // Per-draw buffers of renderMesh(). The owner resets it once the frame is done.
+} DrawState;
+
+// color is sRGB, lighting is applied in linear space.
+FORCE_INLINE int modulateColor( int color, float r, float g, float b )
+{
+    const unsigned red   = linearToSRGB8( srgbToLinearTable[ (color >> 16) & 0xFF ] * r );
+    const unsigned green = linearToSRGB8( srgbToLinearTable[ (color >> 8) & 0xFF ] * g );
+    const unsigned blue  = linearToSRGB8( srgbToLinearTable[ color & 0xFF ] * b );
+
+    return (color & (int)0xFF000000) | (int)((red << 16) | (green << 8) | blue);
+}
+
+// Blend weight of opacity in [0, 256].
+FORCE_INLINE int blendAlpha( float opacity )
+{
+    return (int)(fmaxf( 0, fminf( opacity, 1 ) ) * 256.0f);
+}
+
+// Blending is done on the stored 8-bit values, like a UNORM render target.
+// src is premultiplied by alpha here: result = src * alpha + dst * (1 - alpha).
+FORCE_INLINE int blendPremultiplied( int src, int dst, float opacity )
+{
+    const unsigned alpha = (unsigned)blendAlpha( opacity );
+    unsigned result = 0;
+
+    for (int shift = 0; shift < 32; shift += 8)
+    {
+        const unsigned srcChannel = shift == 24 ? 255 : ((unsigned)src >> shift) & 0xFF;
+        const unsigned premultiplied = (srcChannel * alpha) >> 8;
+        const unsigned dstChannel = ((unsigned)dst >> shift) & 0xFF;
+        result |= mini( premultiplied + ((dstChannel * (256 - alpha)) >> 8), 255 ) << shift;
+    }
+
+    return (int)result;
+}
+
+#ifdef ARCH_X64
+// blendPremultiplied() for 4 pixels. alpha is in [0, 256].
+FORCE_INLINE __m128i blendPremultiplied4( __m128i src, __m128i dst, int alpha )
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i srcAlpha = _mm_set1_epi16( (short)alpha );
+    const __m128i dstAlpha = _mm_set1_epi16( (short)(256 - alpha) );
+
+    // Source alpha channel is opaque before premultiplying, so the result's alpha is the draw's opacity.
+    src = _mm_or_si128( src, _mm_set1_epi32( (int)0xFF000000 ) );
+
+    const __m128i srcLo = _mm_srli_epi16( _mm_mullo_epi16( _mm_unpacklo_epi8( src, zero ), srcAlpha ), 8 );
+    const __m128i srcHi = _mm_srli_epi16( _mm_mullo_epi16( _mm_unpackhi_epi8( src, zero ), srcAlpha ), 8 );
+    const __m128i dstLo = _mm_srli_epi16( _mm_mullo_epi16( _mm_unpacklo_epi8( dst, zero ), dstAlpha ), 8 );
+    const __m128i dstHi = _mm_srli_epi16( _mm_mullo_epi16( _mm_unpackhi_epi8( dst, zero ), dstAlpha ), 8 );
+
+    return _mm_packus_epi16( _mm_add_epi16( srcLo, dstLo ), _mm_add_epi16( srcHi, dstHi ) );
+}
+
+// Blends src over the lanes of dst in laneMask and keeps the rest.
+FORCE_INLINE __m128i blendPremultipliedMasked4( __m128i src, __m128i dst, int alpha, int laneMask )
+{
+    const __m128i laneBits = _mm_setr_epi32( 1, 2, 4, 8 );
+    const __m128i laneSelect = _mm_cmpeq_epi32( _mm_and_si128( _mm_set1_epi32( laneMask ), laneBits ), laneBits );
+    return _mm_or_si128( _mm_and_si128( laneSelect, blendPremultiplied4( src, dst, alpha ) ), _mm_andnot_si128( laneSelect, dst ) );
+}
+#endif
+
+FORCE_INLINE bool isTileMultisampled( const Framebuffer* fb, int x, int y )
+{
+    return (fb->tileStates[ (y / TILE_SIZE) * fb->tileCountX + x / TILE_SIZE ] & TileMultisampled) != 0;
+}
+
+// Writes color into the covered samples of pixel (x, y). row is the pixel's row in colorBuffer.
+// Fully covered pixels of single-color tiles are written once, partial coverage expands the tile into samples.
+FORCE_INLINE void writeCoverage( Framebuffer* fb, int* row, int x, int y, int coverage, int color, const bool blend, float opacity )
+{
+    if (!isTileMultisampled( fb, x, y ))
+    {
+        if (coverage == (1 << MAX_SAMPLES) - 1)
+        {
+            row[ x ] = blend ? blendPremultiplied( color, row[ x ], opacity ) : color;
+            return;
+        }
+
+        framebufferExpandTile( fb, x / TILE_SIZE, y / TILE_SIZE );
+    }
+
+    int* samples = framebufferSamples( fb, x, y );
+
+#ifdef ARCH_X64
+    if (blend)
+    {
+        // A pixel's samples are consecutive, so they blend as one register.
+        const __m128i dst = _mm_loadu_si128( (const __m128i*)samples );
+        _mm_storeu_si128( (__m128i*)samples, blendPremultipliedMasked4( _mm_set1_epi32( color ), dst, blendAlpha( opacity ), coverage ) );
+        return;
+    }
+#endif
+
+    for (int s = 0; s < MAX_SAMPLES; ++s)
+    {
+        if (coverage & (1 << s))
+        {
+            samples[ s ] = blend ? blendPremultiplied( color, samples[ s ], opacity ) : color;
+        }
+    }
+}
+
+// writeCoverage() for pixels [x, x + count) of a row, count <= 4. Blended pixels that fully cover their single-color tile's
+// pixel are blended together, before the partially covered ones can expand the tile.
+FORCE_INLINE void writeCoverage4( Framebuffer* fb, int* row, int x, int y, int count, const int* coverages, const int* colors, const bool blend, float opacity )
+{
+    int pixelMask = 0;
+
+#ifdef ARCH_X64
+    if (blend)
+    {
+        for (int k = 0; k < count; ++k)
+        {
+            if (coverages[ k ] == (1 << MAX_SAMPLES) - 1 && !isTileMultisampled( fb, x + k, y ))
+            {
+                pixelMask |= 1 << k;
+            }
+        }
+
+        if (pixelMask != 0)
+        {
+            Uint32 pixels[ 4 ] = { 0 };
+            memcpy( pixels, &row[ x ], count * sizeof( Uint32 ) );
+
+            const __m128i dst = _mm_loadu_si128( (const __m128i*)pixels );
+            _mm_storeu_si128( (__m128i*)pixels, blendPremultipliedMasked4( _mm_loadu_si128( (const __m128i*)colors ), dst, blendAlpha( opacity ), pixelMask ) );
+            memcpy( &row[ x ], pixels, count * sizeof( Uint32 ) );
+        }
+    }
+#endif
+
+    for (int k = 0; k < count; ++k)
+    {
+        if (coverages[ k ] != 0 && !(pixelMask & (1 << k)))
+        {
+            writeCoverage( fb, row, x + k, y, coverages[ k ], colors[ k ], blend, opacity );
+        }
+    }
+}
+
+// s and t are in texels.
+FORCE_INLINE int sampleNearest( const int* texture, int texDim, float s, float t )
+{
+    int ix = s + 0.5f;
+    int iy = t + 0.5f;
+
+    ix = maxi( 0, mini( ix, texDim - 1 ) );
+    iy = maxi( 0, mini( iy, texDim - 1 ) );
+
+    STAT_ADD( StatTexelsFetched, 1 );
+
+    return texture[ iy * texDim + ix ];
+}
+
+// s and t are in texels. Weights are in 8-bit fixed point.
+// Filters horizontally and then vertically, rounding down to 8 bits after each pass. The SIMD and scalar paths give identical results.
+FORCE_INLINE int sampleBilinear( const int* texture, int texDim, float s, float t )
+{
+    s = fmaxf( 0, fminf( s, texDim - 1 ) );
+    t = fmaxf( 0, fminf( t, texDim - 1 ) );
+
+    const int x0 = (int)s;
+    const int y0 = (int)t;
+    const unsigned fx = (unsigned)((s - x0) * 256.0f);
+    const unsigned fy = (unsigned)((t - y0) * 256.0f);
+    const int* row0 = &texture[ y0 * texDim ];
+    const int* row1 = &texture[ mini( y0 + 1, texDim - 1 ) * texDim ];
+
+    STAT_ADD( StatTexelsFetched, 4 );
+
+#ifdef ARCH_X64
+    __m128i top;
+    __m128i bottom;
+
+    if (x0 + 1 < texDim)
+    {
+        // Fast path: each row's texel pair is adjacent in memory, so the footprint is two 8-byte loads.
+        top = _mm_loadl_epi64( (const __m128i*)&row0[ x0 ] );
+        bottom = _mm_loadl_epi64( (const __m128i*)&row1[ x0 ] );
+    }
+    else
+    {
+        // Right edge, clamps by repeating the last column.
+        top = _mm_set1_epi32( row0[ x0 ] );
+        bottom = _mm_set1_epi32( row1[ x0 ] );
+    }
+
+    const __m128i zero = _mm_setzero_si128();
+    // Texel pair in 16-bit lanes: left texel's channels in the low half, right texel's in the high half.
+    const __m128i weightX = _mm_setr_epi16( (short)(256 - fx), (short)(256 - fx), (short)(256 - fx), (short)(256 - fx),
+                                            (short)fx, (short)fx, (short)fx, (short)fx );
+    top = _mm_mullo_epi16( _mm_unpacklo_epi8( top, zero ), weightX );
+    bottom = _mm_mullo_epi16( _mm_unpacklo_epi8( bottom, zero ), weightX );
+
+    // Products are at most 255 * 256, so the sums fit into unsigned 16 bits.
+    top = _mm_srli_epi16( _mm_add_epi16( top, _mm_srli_si128( top, 8 ) ), 8 );
+    bottom = _mm_srli_epi16( _mm_add_epi16( bottom, _mm_srli_si128( bottom, 8 ) ), 8 );
+
+    const __m128i filtered = _mm_add_epi16( _mm_mullo_epi16( top, _mm_set1_epi16( (short)(256 - fy) ) ),
+                                            _mm_mullo_epi16( bottom, _mm_set1_epi16( (short)fy ) ) );
+
+    return _mm_cvtsi128_si32( _mm_packus_epi16( _mm_srli_epi16( filtered, 8 ), zero ) );
+#else
+    const int x1 = mini( x0 + 1, texDim - 1 );
+    const unsigned c00 = (unsigned)row0[ x0 ];
+    const unsigned c10 = (unsigned)row0[ x1 ];
+    const unsigned c01 = (unsigned)row1[ x0 ];
+    const unsigned c11 = (unsigned)row1[ x1 ];
+
+    unsigned result = 0;
+
+    for (int shift = 0; shift < 32; shift += 8)
+    {
+        const unsigned top    = (((c00 >> shift) & 0xFF) * (256 - fx) + ((c10 >> shift) & 0xFF) * fx) >> 8;
+        const unsigned bottom = (((c01 >> shift) & 0xFF) * (256 - fx) + ((c11 >> shift) & 0xFF) * fx) >> 8;
+        result |= (((top * (256 - fy) + bottom * fy) >> 8) & 0xFF) << shift;
+    }
+
+    return (int)result;
+#endif
+}
+
+// Per-triangle constants for perspective-correct attribute interpolation.
+typedef struct
+{
+    float s1, s2, s3;
+    float t1, t2, t3;
+    float r1, r2, r3;
+    float g1, g2, g3;
+    float b1, b2, b3;
+} Interpolants;
+
+// Returns the color of a pixel with edge function values w0, w1, w2. di is the interpolated unnormalized 1/z.
+FORCE_INLINE int shadePixel( const ShadeMode shadeMode, const bool lit, const Interpolants* in, const DrawState* state, float w0, float w1, float w2, float di )
+{
+    const bool textured = shadeMode == ShadeTextureNearest || shadeMode == ShadeTextureBilinear;
+    const float z = (textured || lit) ? 1.0f / di : 0;
+    int color = state->flatColor;
+
+    if (textured)
+    {
+        float s = w0 * in->s1 + w1 * in->s2 + w2 * in->s3;
+        float t = w0 * in->t1 + w1 * in->t2 + w2 * in->t3;
+        s *= z;
+        t *= z;
+
+        if (shadeMode == ShadeTextureBilinear)
+        {
+            color = sampleBilinear( state->texture, state->texDim, s, t );
+        }
+        else
+        {
+            color = sampleNearest( state->texture, state->texDim, s, t );
+        }
+    }
+
+    if (lit)
+    {
+        color = modulateColor( color, (w0 * in->r1 + w1 * in->r2 + w2 * in->r3) * z, (w0 * in->g1 + w1 * in->g2 + w2 * in->g3) * z, (w0 * in->b1 + w1 * in->b2 + w2 * in->b3) * z );
+    }
+
+    return color;
+}
+
+// Output of triangle setup and input of the raster loops. Vertices are in the rasterizer's CCW order.
+typedef struct
+{
+    int minx, miny, maxx, maxy; // Pixel bounds, clipped to the screen.
+    float a01, b01, a12, b12, a20, b20; // Edge function steps in x and y.
+    float w0row, w1row, w2row; // Edge functions at (minx, miny).
+    float w0min, w1min, w2min; // Fill convention, a pixel or sample is inside edge i where wi >= wimin. See edgeThreshold().
+    float z1, z2, z3;
+    float depthScale; // Edge functions sum to the doubled area, so this normalizes interpolated 1/z into DEPTH_NEAR_Z / z.
+    Interpolants in;
+} TriangleSetup;
+
+// Fill convention: pixels and samples exactly on an edge belong to the triangle if the edge is a top or left edge, so one on an edge
+// shared by two triangles is drawn once. Returns the smallest inside value of an edge function with steps a, b:
+// 0 for top-left edges, otherwise FLT_MIN, which only excludes 0 and denormals.
+FORCE_INLINE float edgeThreshold( float a, float b )
+{
+    return (a < 0 || (a == 0 && b < 0)) ? 0.0f : FLT_MIN;
+}
+
+// Texture coordinates are interpolated in texels.
+FORCE_INLINE float setupTexScale( const DrawState* state, const ShadeMode shadeMode )
+{
+    return (shadeMode == ShadeTextureNearest || shadeMode == ShadeTextureBilinear) ? (float)state->texDim - 1.0f : 0.0f;
+}
+
+// Scalar triangle setup. Returns false if the triangle doesn't overlap the width x height render target.
+// setupMeshTriangles() is the batched version and must give identical results.
+FORCE_INLINE bool setupTriangle( const Vertex* v1, const Vertex* v2, const Vertex* v3, int width, int height, const bool msaa, const float texScale, const bool lit, TriangleSetup* out )
 {
     float x1 = v1->x;
     float x2 = v2->x;
@@ -138,62 +484,134 @@ void drawTriangle2( Vertex* v1, Vertex* v2, Vertex* v3, int rowPitch, int* textu
     float y2 = v2->y;
     float y3 = v3->y;
 
-    float s1 = v1->u / v1->z;
-    float s2 = v2->u / v2->z;
-    float s3 = v3->u / v3->z;
-    float t1 = v1->v / v1->z;
-    float t2 = v2->v / v2->z;
-    float t3 = v3->v / v3->z;
-
-    float z1 = 1.0f / v1->z;
-    float z2 = 1.0f / v2->z;
-    float z3 = 1.0f / v3->z;
-
-    int minx = round( fmin( x1, fmin( x2, x3 ) ) );
-    int miny = round( fmin( y1, fmin( y2, y3 ) ) );
-    int maxx = fmax( x1, fmax( x2, x3 ) );
-    int maxy = fmax( y1, fmax( y2, y3 ) );
+    // Samples are up to 6/16 pixels from the sampling point, so multisampling needs every pixel the triangle overlaps.
+    int minx = msaa ? floor( fmin( x1, fmin( x2, x3 ) ) ) : round( fmin( x1, fmin( x2, x3 ) ) );
+    int miny = msaa ? floor( fmin( y1, fmin( y2, y3 ) ) ) : round( fmin( y1, fmin( y2, y3 ) ) );
+    int maxx = msaa ? ceil( fmax( x1, fmax( x2, x3 ) ) ) : fmax( x1, fmax( x2, x3 ) );
+    int maxy = msaa ? ceil( fmax( y1, fmax( y2, y3 ) ) ) : fmax( y1, fmax( y2, y3 ) );
 
     // Clip against screen bounds
     minx = fmax( minx, 0 );
     miny = fmax( miny, 0 );
-    maxx = fmin( maxx, WIDTH - 1 );
-    maxy = fmin( maxy, HEIGHT - 1 );
+    maxx = fmin( maxx, width - 1 );
+    maxy = fmin( maxy, height - 1 );
 
     //assert( minx <= maxx && "minx == maxx" );
     //assert( miny <= maxy && "miny == maxy" );
     
     if (minx > maxx || miny > maxy)
-        return;
+        return false;
         
-    if (minx > WIDTH || miny > HEIGHT)
-        return;
+    if (minx > width || miny > height)
+        return false;
         
     if (maxx < 0 || maxy < 0)
-        return;
+        return false;
         
+    // Entirely behind the camera.
     if (v1->z < 0 && v2->z < 0 && v3->z < 0)
-        printf("cull?\n");    
+        return false;
+
     //printf( "minx: %d, miny: %d, maxx: %d, maxy: %d\n", minx, miny, maxx, maxy );
     //printf( "z1: %f, z2: %f, z3: %f\n", v1->z, v2->z, v3->z );
     float a01 = y1 - y2, b01 = x2 - x1;
     float a12 = y2 - y3, b12 = x3 - x2;
     float a20 = y3 - y1, b20 = x1 - x3;
 
-    // Correct for filling convention. FIXME: Not sure if this is correct!
-    int bias0 = a01 < 0 ? 0 : -1;
-    int bias1 = a12 < 0 ? 0 : -1;
-    int bias2 = a20 < 0 ? 0 : -1;
-    //if (a01 < 0 || (a01 == 0 && b01 < 0)) bias0 = 0;
-    //if (a12 < 0 || (a12 == 0 && b12 < 0)) bias1 = 0;
-    //if (a20 < 0 || (a20 == 0 && b20 < 0)) bias2 = 0;
+    out->minx = minx;
+    out->miny = miny;
+    out->maxx = maxx;
+    out->maxy = maxy;
+    out->a01 = a01; out->b01 = b01;
+    out->a12 = a12; out->b12 = b12;
+    out->a20 = a20; out->b20 = b20;
+    out->w0row = orient2D( x2, y2, x3, y3, minx, miny );
+    out->w1row = orient2D( x3, y3, x1, y1, minx, miny );
+    out->w2row = orient2D( x1, y1, x2, y2, minx, miny );
+    out->w0min = edgeThreshold( a12, b12 );
+    out->w1min = edgeThreshold( a20, b20 );
+    out->w2min = edgeThreshold( a01, b01 );
+    out->depthScale = DEPTH_NEAR_Z / orient2D( x1, y1, x2, y2, x3, y3 );
+
+    out->z1 = 1.0f / v1->z;
+    out->z2 = 1.0f / v2->z;
+    out->z3 = 1.0f / v3->z;
+
+    // Vertex lighting is interpolated perspective-correctly like texture coordinates.
+    Interpolants* in = &out->in;
+    in->s1 = v1->u * texScale / v1->z;
+    in->s2 = v2->u * texScale / v2->z;
+    in->s3 = v3->u * texScale / v3->z;
+    in->t1 = v1->v * texScale / v1->z;
+    in->t2 = v2->v * texScale / v2->z;
+    in->t3 = v3->v * texScale / v3->z;
+    in->r1 = lit ? v1->r * out->z1 : 0; in->g1 = lit ? v1->g * out->z1 : 0; in->b1 = lit ? v1->b * out->z1 : 0;
+    in->r2 = lit ? v2->r * out->z2 : 0; in->g2 = lit ? v2->g * out->z2 : 0; in->b2 = lit ? v2->b * out->z2 : 0;
+    in->r3 = lit ? v3->r * out->z3 : 0; in->g3 = lit ? v3->g * out->z3 : 0; in->b3 = lit ? v3->b * out->z3 : 0;
+
+    return true;
+}
 
-    float w0row = orient2D( x2, y2, x3, y3, minx, miny ) + bias0;
-    float w1row = orient2D( x3, y3, x1, y1, minx, miny ) + bias1;
-    float w2row = orient2D( x1, y1, x2, y2, minx, miny ) + bias2;
+typedef void (*RasterTriangleFunc)( const TriangleSetup* setup, const DrawState* state, Framebuffer* fb );
+typedef void (*RasterSmallTrianglesFunc)( const TriangleSetup* setups, unsigned count, const DrawState* state, Framebuffer* fb );
+typedef void (*DrawTriangle2Func)( Vertex* v1, Vertex* v2, Vertex* v3, const DrawState* state, Framebuffer* fb );
 
-    Uint32* target = (Uint32*)((Uint8*)outBuffer + miny * rowPitch);
-    float* targetZ = (float*)((Uint8*)zBuffer + miny * rowPitch);
+// Rasterizes a set up triangle. texture must be a 4-channel 32-bit format and square (width == height).
+// depthFormat, shadeMode and the variant flags are constants in every caller, so each variant
+// compiles to an inner loop without per-pixel mode branches. Lighting and multisampling are branched on, see rasterRuntimeFlags().
+FORCE_INLINE void rasterTriangleImpl( const TriangleSetup* setup, const DrawState* state, Framebuffer* fb,
+                                      const DepthFormat depthFormat, const ShadeMode shadeMode, const int flags )
+{
+    const bool blend = (flags & RasterBlend) != 0 && shadeMode != ShadeDepthOnly;
+    const bool depthWrite = (flags & RasterDepthWrite) != 0 && !blend;
+    const bool lit = (flags & RasterLit) != 0 && shadeMode != ShadeDepthOnly;
+    const bool msaa = (flags & RasterMsaa) != 0;
+    const int rowPitch = fb->colorPitch;
+    DepthBuffer* depthBuffer = &fb->depth;
+    const Interpolants* in = &setup->in;
+
+    const int minx = setup->minx;
+    const int miny = setup->miny;
+    const int maxx = setup->maxx;
+    const int maxy = setup->maxy;
+    const float a01 = setup->a01, b01 = setup->b01;
+    const float a12 = setup->a12, b12 = setup->b12;
+    const float a20 = setup->a20, b20 = setup->b20;
+    const float z1 = setup->z1;
+    const float z2 = setup->z2;
+    const float z3 = setup->z3;
+    const float depthScale = setup->depthScale;
+    const float w0min = setup->w0min;
+    const float w1min = setup->w1min;
+    const float w2min = setup->w2min;
+
+    float w0row = setup->w0row;
+    float w1row = setup->w1row;
+    float w2row = setup->w2row;
+
+    Uint32* target = (Uint32*)((Uint8*)fb->colorBuffer + miny * rowPitch);
+    Uint8* targetZ = depthBufferRow( depthBuffer, miny );
+
+    // Edge function offsets of each sample.
+    float w0Sample[ MAX_SAMPLES ], w1Sample[ MAX_SAMPLES ], w2Sample[ MAX_SAMPLES ];
+
+    for (int s = 0; s < MAX_SAMPLES; ++s)
+    {
+        const float dx = msaaSampleOffsets[ s ][ 0 ] / 16.0f;
+        const float dy = msaaSampleOffsets[ s ][ 1 ] / 16.0f;
+        w0Sample[ s ] = a12 * dx + b12 * dy;
+        w1Sample[ s ] = a20 * dx + b20 * dy;
+        w2Sample[ s ] = a01 * dx + b01 * dy;
+    }
+
+#ifdef ARCH_X64
+    const int alpha = blend ? blendAlpha( state->opacity ) : 0;
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 laneOffsets = _mm_setr_ps( 0, 1, 2, 3 );
+    const __m128 w0step = _mm_set1_ps( 4 * a12 );
+    const __m128 w1step = _mm_set1_ps( 4 * a20 );
+    const __m128 w2step = _mm_set1_ps( 4 * a01 );
+#endif
 
     for (int y = miny; y <= maxy; ++y)
     {
@@ -201,112 +619,877 @@ void drawTriangle2( Vertex* v1, Vertex* v2, Vertex* v3, int rowPitch, int* textu
         float w1 = w1row;
         float w2 = w2row;
 
-        for (int x = minx; x <= maxx; ++x)
+        if (msaa)
         {
-            float di = (w0 * z1 + w1 * z2 + w2 * z3);
-            float z = 1.0f / di;
-
-            // FIXME: looks like di only becomes 0 when object is offscreen, and should already be culled.
-            if (di != 0 && z > targetZ[ x ] && w0 >= 0 && w1 >= 0 && w2 >= 0)
+            // 4 pixels per iteration, so that blending can write them together, see writeCoverage4().
+            for (int x = minx; x <= maxx; x += 4)
             {
-                targetZ[ x ] = z;
+                const int count = mini( 4, maxx - x + 1 );
+                int coverages[ 4 ] = { 0 };
+                int colors[ 4 ] = { 0 };
 
-                float s = w0 * s1 + w1 * s2 + w2 * s3;
-                float t = w0 * t1 + w1 * t2 + w2 * t3;
-                s *= z;
-                t *= z;
+                for (int k = 0; k < count; ++k)
+                {
+                    int coverage = 0;
+                    int shadeSample = -1;
+
+                    for (int s = 0; s < MAX_SAMPLES; ++s)
+                    {
+                        const float sw0 = w0 + w0Sample[ s ];
+                        const float sw1 = w1 + w1Sample[ s ];
+                        const float sw2 = w2 + w2Sample[ s ];
+                        const float sdi = sw0 * z1 + sw1 * z2 + sw2 * z3;
+
+                        if (sdi != 0 && sw0 >= w0min && sw1 >= w1min && sw2 >= w2min)
+                        {
+                            STAT_ADD( StatPixelsTested, 1 );
+
+                            if (depthWrite ? depthTestAndWrite( depthFormat, targetZ, (x + k) * MAX_SAMPLES + s, sdi * depthScale )
+                                           : depthTest( depthFormat, targetZ, (x + k) * MAX_SAMPLES + s, sdi * depthScale ))
+                            {
+                                STAT_ADD( StatPixelsPassed, 1 );
+                                coverage |= 1 << s;
+                                shadeSample = shadeSample < 0 ? s : shadeSample;
+                            }
+                        }
+                    }
+
+                    if (coverage != 0 && shadeMode != ShadeDepthOnly)
+                    {
+                        // Shades at the pixel's sampling point when it's inside, otherwise at the first covered sample to avoid extrapolating attributes.
+                        const bool centerInside = w0 >= 0 && w1 >= 0 && w2 >= 0 && (w0 * z1 + w1 * z2 + w2 * z3) != 0;
+                        const float sw0 = centerInside ? w0 : w0 + w0Sample[ shadeSample ];
+                        const float sw1 = centerInside ? w1 : w1 + w1Sample[ shadeSample ];
+                        const float sw2 = centerInside ? w2 : w2 + w2Sample[ shadeSample ];
+                        colors[ k ] = shadePixel( shadeMode, lit, in, state, sw0, sw1, sw2, sw0 * z1 + sw1 * z2 + sw2 * z3 );
+                        coverages[ k ] = coverage;
+                    }
+
+                    w0 += a12;
+                    w1 += a20;
+                    w2 += a01;
+                }
 
-                int ix = s * ((float)texDim - 1.0f) + 0.5f;
-                int iy = t * ((float)texDim - 1.0f) + 0.5f;
+                writeCoverage4( fb, (int*)target, x, y, count, coverages, colors, blend, state->opacity );
+            }
+        }
+        else
+#ifdef ARCH_X64
+        if (blend)
+        {
+            // 4 pixels per iteration: coverage, depth test and blending in SIMD, shading per covered lane.
+            __m128 w0v = _mm_add_ps( _mm_set1_ps( w0 ), _mm_mul_ps( laneOffsets, _mm_set1_ps( a12 ) ) );
+            __m128 w1v = _mm_add_ps( _mm_set1_ps( w1 ), _mm_mul_ps( laneOffsets, _mm_set1_ps( a20 ) ) );
+            __m128 w2v = _mm_add_ps( _mm_set1_ps( w2 ), _mm_mul_ps( laneOffsets, _mm_set1_ps( a01 ) ) );
 
-                ix = maxi( 0, mini( ix, texDim - 1 ) );
-                iy = maxi( 0, mini( iy, texDim - 1 ) );
+            for (int x = minx; x <= maxx; x += 4)
+            {
+                const int count = mini( 4, maxx - x + 1 );
+                const __m128 di = _mm_add_ps( _mm_add_ps( _mm_mul_ps( w0v, _mm_set1_ps( z1 ) ), _mm_mul_ps( w1v, _mm_set1_ps( z2 ) ) ), _mm_mul_ps( w2v, _mm_set1_ps( z3 ) ) );
 
-                if (forceColor != 0)
+                __m128 mask = _mm_and_ps( _mm_and_ps( _mm_cmpge_ps( w0v, _mm_set1_ps( w0min ) ), _mm_cmpge_ps( w1v, _mm_set1_ps( w1min ) ) ),
+                                          _mm_cmpge_ps( w2v, _mm_set1_ps( w2min ) ) );
+                mask = _mm_and_ps( mask, _mm_and_ps( _mm_cmpneq_ps( di, zero ), _mm_cmplt_ps( laneOffsets, _mm_set1_ps( (float)count ) ) ) );
+
+                if (_mm_movemask_ps( mask ) != 0)
                 {
-                    target[ x ] = forceColor;
+                    STAT_ADD( StatPixelsTested, statsPopCount4( _mm_movemask_ps( mask ) ) );
+                    mask = _mm_and_ps( mask, _mm_castsi128_ps( depthTest4( depthFormat, targetZ, x, count, _mm_mul_ps( di, _mm_set1_ps( depthScale ) ) ) ) );
                 }
-                else
+
+                const int laneMask = _mm_movemask_ps( mask );
+
+                if (laneMask != 0)
                 {
-                    target[ x ] = texture[ iy * texDim + ix ];
+                    STAT_ADD( StatPixelsPassed, statsPopCount4( laneMask ) );
+
+                    float w0s[ 4 ], w1s[ 4 ], w2s[ 4 ], dis[ 4 ];
+                    _mm_storeu_ps( w0s, w0v );
+                    _mm_storeu_ps( w1s, w1v );
+                    _mm_storeu_ps( w2s, w2v );
+                    _mm_storeu_ps( dis, di );
+
+                    int colors[ 4 ] = { 0 };
+
+                    for (int k = 0; k < 4; ++k)
+                    {
+                        if (laneMask & (1 << k))
+                        {
+                            colors[ k ] = shadePixel( shadeMode, lit, in, state, w0s[ k ], w1s[ k ], w2s[ k ], dis[ k ] );
+                        }
+                    }
+
+                    Uint32 pixels[ 4 ] = { 0 };
+                    memcpy( pixels, &target[ x ], count * sizeof( Uint32 ) );
+
+                    const __m128i src = _mm_loadu_si128( (const __m128i*)colors );
+                    const __m128i dst = _mm_loadu_si128( (const __m128i*)pixels );
+                    const __m128i blended = blendPremultiplied4( src, dst, alpha );
+                    const __m128i laneSelect = _mm_castps_si128( mask );
+                    _mm_storeu_si128( (__m128i*)pixels, _mm_or_si128( _mm_and_si128( laneSelect, blended ), _mm_andnot_si128( laneSelect, dst ) ) );
+                    memcpy( &target[ x ], pixels, count * sizeof( Uint32 ) );
                 }
+
+                w0v = _mm_add_ps( w0v, w0step );
+                w1v = _mm_add_ps( w1v, w1step );
+                w2v = _mm_add_ps( w2v, w2step );
             }
+        }
+        else
+#endif
+        {
+            for (int x = minx; x <= maxx; ++x)
+            {
+                float di = (w0 * z1 + w1 * z2 + w2 * z3);
+                const float depth = di * depthScale;
 
-            w0 += a12;
-            w1 += a20;
-            w2 += a01;
+                // FIXME: looks like di only becomes 0 when object is offscreen, and should already be culled.
+                if (di != 0 && w0 >= w0min && w1 >= w1min && w2 >= w2min)
+                {
+                    STAT_ADD( StatPixelsTested, 1 );
+
+                    if (depthWrite ? depthTestAndWrite( depthFormat, targetZ, x, depth ) : depthTest( depthFormat, targetZ, x, depth ))
+                    {
+                        STAT_ADD( StatPixelsPassed, 1 );
+
+                        if (blend)
+                        {
+                            target[ x ] = blendPremultiplied( shadePixel( shadeMode, lit, in, state, w0, w1, w2, di ), target[ x ], state->opacity );
+                        }
+                        else if (shadeMode != ShadeDepthOnly)
+                        {
+                            target[ x ] = shadePixel( shadeMode, lit, in, state, w0, w1, w2, di );
+                        }
+                    }
+                }
+
+                w0 += a12;
+                w1 += a20;
+                w2 += a01;
+            }
         }
 
         w0row += b12;
         w1row += b20;
         w2row += b01;
 
-        target += WIDTH;
-        targetZ += WIDTH;
+        target = (Uint32*)((Uint8*)target + rowPitch);
+        targetZ += depthBuffer->pitch;
     }
 }
 
-// Vertices must be in CCW order! texture must be a 4-channel 32-bit format.
-// Optimized version of drawTriangle2(). Block-based approach.
-// texture dimension must be square (width == height)
-void drawTriangle3( Vertex* v1, Vertex* v2, Vertex* v3, int rowPitch, int* texture, int texDim, int forceColor, float* zBuffer, int* outBuffer )
+// Triangles whose bounds are at most this many pixels per side are rasterized with stamps, see rasterSmallTrianglesImpl().
+#define SMALL_TRIANGLE_SIZE 4
+
+FORCE_INLINE bool isSmallTriangle( const TriangleSetup* setup )
 {
-    float x1 = v1->x;
-    float x2 = v2->x;
-    float x3 = v3->x;
-    float y1 = v1->y;
-    float y2 = v2->y;
-    float y3 = v3->y;
+    return setup->maxx - setup->minx < SMALL_TRIANGLE_SIZE && setup->maxy - setup->miny < SMALL_TRIANGLE_SIZE;
+}
 
-    float s1 = v1->u / v1->z;
-    float s2 = v2->u / v2->z;
-    float s3 = v3->u / v3->z;
-    float t1 = v1->v / v1->z;
-    float t2 = v2->v / v2->z;
-    float t3 = v3->v / v3->z;
+#ifdef ARCH_X64
+// Depth tests, shades and writes the covered lanes of 4 stamp pixels. Lane k is pixel (xs[ k ], ys[ k ]).
+FORCE_INLINE void rasterStampPixels4( const TriangleSetup* setup, const DrawState* state, Framebuffer* fb, __m128 w0, __m128 w1, __m128 w2,
+                                      const int* xs, const int* ys, int laneMask, const DepthFormat depthFormat, const ShadeMode shadeMode, const int flags )
+{
+    const bool blend = (flags & RasterBlend) != 0 && shadeMode != ShadeDepthOnly;
+    const bool depthWrite = (flags & RasterDepthWrite) != 0 && !blend;
+    const bool lit = (flags & RasterLit) != 0 && shadeMode != ShadeDepthOnly;
+    const __m128 di = _mm_add_ps( _mm_add_ps( _mm_mul_ps( w0, _mm_set1_ps( setup->z1 ) ), _mm_mul_ps( w1, _mm_set1_ps( setup->z2 ) ) ),
+                                  _mm_mul_ps( w2, _mm_set1_ps( setup->z3 ) ) );
+    laneMask &= ~_mm_movemask_ps( _mm_cmpeq_ps( di, _mm_setzero_ps() ) );
+
+    if (laneMask == 0)
+    {
+        return;
+    }
 
-    float z1 = 1.0f / v1->z;
-    float z2 = 1.0f / v2->z;
-    float z3 = 1.0f / v3->z;
+    float w0s[ 4 ], w1s[ 4 ], w2s[ 4 ], dis[ 4 ];
+    _mm_storeu_ps( w0s, w0 );
+    _mm_storeu_ps( w1s, w1 );
+    _mm_storeu_ps( w2s, w2 );
+    _mm_storeu_ps( dis, di );
 
-    int minx = round( fmin( x1, fmin( x2, x3 ) ) );
-    int miny = round( fmin( y1, fmin( y2, y3 ) ) );
-    int maxx = fmax( x1, fmax( x2, x3 ) );
-    int maxy = fmax( y1, fmax( y2, y3 ) );
+    STAT_ADD( StatPixelsTested, statsPopCount4( laneMask ) );
 
-    // Clip against screen bounds
-    minx = fmax( minx, 0 );
-    miny = fmax( miny, 0 );
-    maxx = fmin( maxx, WIDTH - 1 );
-    maxy = fmin( maxy, HEIGHT - 1 );
+    // Blended lanes are gathered and blended together.
+    int* rows[ 4 ] = { NULL };
+    int colors[ 4 ] = { 0 };
+    int dsts[ 4 ] = { 0 };
+    int passedMask = 0;
 
-    float ratio = getRatio( (Vec3){ minx, miny, 0 }, (Vec3){ maxx, maxy, 0 } );
-    bool useBlock = ratio > 0.4f && ratio < 1.6f;
+    for (int k = 0; k < 4; ++k)
+    {
+        if (!(laneMask & (1 << k)))
+        {
+            continue;
+        }
 
-    const int blockDim = 8;
-    
-    // Start in corner of 8x8 block
-    minx &= ~(blockDim - 1);
-    miny &= ~(blockDim - 1);
-    
-    float a01 = y1 - y2, b01 = x2 - x1;
-    float a12 = y2 - y3, b12 = x3 - x2;
-    float a20 = y3 - y1, b20 = x1 - x3;
+        Uint8* rowZ = depthBufferRow( &fb->depth, ys[ k ] );
+        const float depth = dis[ k ] * setup->depthScale;
 
-    // Correct for filling convention. FIXME: Not sure if this is correct!
-    int bias0 = a01 < 0 ? 0 : -1;
-    int bias1 = a12 < 0 ? 0 : -1;
-    int bias2 = a20 < 0 ? 0 : -1;
-    //if (a01 < 0 || (a01 == 0 && b01 < 0)) bias0 = 0;
-    //if (a12 < 0 || (a12 == 0 && b12 < 0)) bias1 = 0;
-    //if (a20 < 0 || (a20 == 0 && b20 < 0)) bias2 = 0;
+        if (depthWrite ? depthTestAndWrite( depthFormat, rowZ, xs[ k ], depth ) : depthTest( depthFormat, rowZ, xs[ k ], depth ))
+        {
+            STAT_ADD( StatPixelsPassed, 1 );
 
-    float w0row = orient2D( x2, y2, x3, y3, minx, miny ) + bias0;
-    float w1row = orient2D( x3, y3, x1, y1, minx, miny ) + bias1;
-    float w2row = orient2D( x1, y1, x2, y2, minx, miny ) + bias2;
+            if (shadeMode != ShadeDepthOnly)
+            {
+                rows[ k ] = (int*)((Uint8*)fb->colorBuffer + ys[ k ] * fb->colorPitch);
+                colors[ k ] = shadePixel( shadeMode, lit, &setup->in, state, w0s[ k ], w1s[ k ], w2s[ k ], dis[ k ] );
+                dsts[ k ] = rows[ k ][ xs[ k ] ];
+                passedMask |= 1 << k;
+            }
+        }
+    }
+
+    if (blend && passedMask != 0)
+    {
+        _mm_storeu_si128( (__m128i*)colors, blendPremultiplied4( _mm_loadu_si128( (const __m128i*)colors ), _mm_loadu_si128( (const __m128i*)dsts ),
+                                                                 blendAlpha( state->opacity ) ) );
+    }
+
+    for (int k = 0; k < 4; ++k)
+    {
+        if (passedMask & (1 << k))
+        {
+            rows[ k ][ xs[ k ] ] = colors[ k ];
+        }
+    }
+}
+
+// Edge function offsets of the samples in lanes, same math as rasterTriangleImpl().
+FORCE_INLINE void msaaEdgeOffsets4( const TriangleSetup* setup, __m128* outW0, __m128* outW1, __m128* outW2 )
+{
+    const __m128 dx = _mm_setr_ps( msaaSampleOffsets[ 0 ][ 0 ] / 16.0f, msaaSampleOffsets[ 1 ][ 0 ] / 16.0f, msaaSampleOffsets[ 2 ][ 0 ] / 16.0f, msaaSampleOffsets[ 3 ][ 0 ] / 16.0f );
+    const __m128 dy = _mm_setr_ps( msaaSampleOffsets[ 0 ][ 1 ] / 16.0f, msaaSampleOffsets[ 1 ][ 1 ] / 16.0f, msaaSampleOffsets[ 2 ][ 1 ] / 16.0f, msaaSampleOffsets[ 3 ][ 1 ] / 16.0f );
+    *outW0 = _mm_add_ps( _mm_mul_ps( _mm_set1_ps( setup->a12 ), dx ), _mm_mul_ps( _mm_set1_ps( setup->b12 ), dy ) );
+    *outW1 = _mm_add_ps( _mm_mul_ps( _mm_set1_ps( setup->a20 ), dx ), _mm_mul_ps( _mm_set1_ps( setup->b20 ), dy ) );
+    *outW2 = _mm_add_ps( _mm_mul_ps( _mm_set1_ps( setup->a01 ), dx ), _mm_mul_ps( _mm_set1_ps( setup->b01 ), dy ) );
+}
+
+// Multisampled pixel (x, y) with edge functions w0, w1, w2 at its sampling point. Its 4 samples are the lanes of one register.
+// row and rowZ are the pixel's color and depth rows.
+FORCE_INLINE void rasterPixelMsaa( const TriangleSetup* setup, const DrawState* state, Framebuffer* fb, int* row, Uint8* rowZ, int x, int y,
+                                   float w0, float w1, float w2, __m128 w0Sample, __m128 w1Sample, __m128 w2Sample,
+                                   const DepthFormat depthFormat, const ShadeMode shadeMode, const int flags )
+{
+    const bool blend = (flags & RasterBlend) != 0 && shadeMode != ShadeDepthOnly;
+    const bool depthWrite = (flags & RasterDepthWrite) != 0 && !blend;
+    const bool lit = (flags & RasterLit) != 0 && shadeMode != ShadeDepthOnly;
+    const __m128 zero = _mm_setzero_ps();
+
+    const __m128 sw0 = _mm_add_ps( _mm_set1_ps( w0 ), w0Sample );
+    const __m128 sw1 = _mm_add_ps( _mm_set1_ps( w1 ), w1Sample );
+    const __m128 sw2 = _mm_add_ps( _mm_set1_ps( w2 ), w2Sample );
+    const __m128 sdi = _mm_add_ps( _mm_add_ps( _mm_mul_ps( sw0, _mm_set1_ps( setup->z1 ) ), _mm_mul_ps( sw1, _mm_set1_ps( setup->z2 ) ) ),
+                                   _mm_mul_ps( sw2, _mm_set1_ps( setup->z3 ) ) );
+    const __m128 inside = _mm_and_ps( _mm_and_ps( _mm_cmpge_ps( sw0, _mm_set1_ps( setup->w0min ) ), _mm_cmpge_ps( sw1, _mm_set1_ps( setup->w1min ) ) ),
+                                      _mm_and_ps( _mm_cmpge_ps( sw2, _mm_set1_ps( setup->w2min ) ), _mm_cmpneq_ps( sdi, zero ) ) );
+    const int sampleMask = _mm_movemask_ps( inside );
+
+    if (sampleMask == 0)
+    {
+        return;
+    }
+
+    float sw0s[ 4 ], sw1s[ 4 ], sw2s[ 4 ], sdis[ 4 ];
+    _mm_storeu_ps( sw0s, sw0 );
+    _mm_storeu_ps( sw1s, sw1 );
+    _mm_storeu_ps( sw2s, sw2 );
+    _mm_storeu_ps( sdis, sdi );
+
+    int coverage = 0;
+    int shadeSample = -1;
+
+    STAT_ADD( StatPixelsTested, statsPopCount4( sampleMask ) );
+
+    for (int s = 0; s < MAX_SAMPLES; ++s)
+    {
+        if ((sampleMask & (1 << s)) &&
+            (depthWrite ? depthTestAndWrite( depthFormat, rowZ, x * MAX_SAMPLES + s, sdis[ s ] * setup->depthScale )
+                        : depthTest( depthFormat, rowZ, x * MAX_SAMPLES + s, sdis[ s ] * setup->depthScale )))
+        {
+            STAT_ADD( StatPixelsPassed, 1 );
+            coverage |= 1 << s;
+            shadeSample = shadeSample < 0 ? s : shadeSample;
+        }
+    }
+
+    if (coverage != 0 && shadeMode != ShadeDepthOnly)
+    {
+        const bool centerInside = w0 >= 0 && w1 >= 0 && w2 >= 0 && (w0 * setup->z1 + w1 * setup->z2 + w2 * setup->z3) != 0;
+        const float cw0 = centerInside ? w0 : sw0s[ shadeSample ];
+        const float cw1 = centerInside ? w1 : sw1s[ shadeSample ];
+        const float cw2 = centerInside ? w2 : sw2s[ shadeSample ];
+        const int color = shadePixel( shadeMode, lit, &setup->in, state, cw0, cw1, cw2, cw0 * setup->z1 + cw1 * setup->z2 + cw2 * setup->z3 );
+
+        writeCoverage( fb, row, x, y, coverage, color, blend, state->opacity );
+    }
+}
+#endif
+
+#ifdef ARCH_X64
+// Multisampled stamp: the 4 samples of each pixel in the bounds are one SIMD op, so a 2x2 stamp is 4 ops.
+// Edge functions are evaluated per pixel like rasterSpansImpl() does.
+FORCE_INLINE void rasterSmallTriangleMsaa( const TriangleSetup* setup, const DrawState* state, Framebuffer* fb,
+                                           const DepthFormat depthFormat, const ShadeMode shadeMode, const int flags )
+{
+    __m128 w0Sample, w1Sample, w2Sample;
+    msaaEdgeOffsets4( setup, &w0Sample, &w1Sample, &w2Sample );
+
+    float w0row = setup->w0row;
+    float w1row = setup->w1row;
+    float w2row = setup->w2row;
+
+    for (int y = setup->miny; y <= setup->maxy; ++y)
+    {
+        int* row = (int*)((Uint8*)fb->colorBuffer + y * fb->colorPitch);
+        Uint8* rowZ = depthBufferRow( &fb->depth, y );
+
+        for (int x = setup->minx; x <= setup->maxx; ++x)
+        {
+            const float k = (float)(x - setup->minx);
+            rasterPixelMsaa( setup, state, fb, row, rowZ, x, y, w0row + setup->a12 * k, w1row + setup->a20 * k, w2row + setup->a01 * k,
+                             w0Sample, w1Sample, w2Sample, depthFormat, shadeMode, flags );
+        }
+
+        w0row += setup->b12;
+        w1row += setup->b20;
+        w2row += setup->b01;
+    }
+}
+#endif
+
+// Rasterizes count small triangles, see isSmallTriangle(). Coverage of a whole 2x2 stamp, or of a 4x4 stamp's row, is one SIMD op,
+// multisampled coverage is one SIMD op per pixel, see rasterSmallTriangleMsaa().
+// Edge functions are accumulated in the same order as rasterTriangleImpl(), so both give identical results.
+// Without SSE, triangles go through rasterTriangle, the same variant's rasterTriangleImpl().
+FORCE_INLINE void rasterSmallTrianglesImpl( const TriangleSetup* setups, unsigned count, const DrawState* state, Framebuffer* fb, RasterTriangleFunc rasterTriangle,
+                                            const DepthFormat depthFormat, const ShadeMode shadeMode, const int flags )
+{
+#ifndef ARCH_X64
+    (void)depthFormat;
+    (void)shadeMode;
+    (void)flags;
+
+    for (unsigned t = 0; t < count; ++t)
+    {
+        rasterTriangle( &setups[ t ], state, fb );
+    }
+#else
+    (void)rasterTriangle;
+    const bool msaa = (flags & RasterMsaa) != 0;
+
+    for (unsigned t = 0; t < count; ++t)
+    {
+        const TriangleSetup* setup = &setups[ t ];
+        assert( isSmallTriangle( setup ) );
+
+        if (msaa)
+        {
+            rasterSmallTriangleMsaa( setup, state, fb, depthFormat, shadeMode, flags );
+            continue;
+        }
+
+        const int minx = setup->minx;
+        const int miny = setup->miny;
+        const int width = setup->maxx - minx + 1;
+        const int height = setup->maxy - miny + 1;
+        const float a01 = setup->a01, b01 = setup->b01;
+        const float a12 = setup->a12, b12 = setup->b12;
+        const float a20 = setup->a20, b20 = setup->b20;
+        const __m128 w0min = _mm_set1_ps( setup->w0min );
+        const __m128 w1min = _mm_set1_ps( setup->w1min );
+        const __m128 w2min = _mm_set1_ps( setup->w2min );
+
+        if (width <= 2 && height <= 2)
+        {
+            // Lanes are pixels (0, 0), (1, 0), (0, 1) and (1, 1) of the stamp.
+            const float w0row1 = setup->w0row + b12;
+            const float w1row1 = setup->w1row + b20;
+            const float w2row1 = setup->w2row + b01;
+            const __m128 w0 = _mm_setr_ps( setup->w0row, setup->w0row + a12, w0row1, w0row1 + a12 );
+            const __m128 w1 = _mm_setr_ps( setup->w1row, setup->w1row + a20, w1row1, w1row1 + a20 );
+            const __m128 w2 = _mm_setr_ps( setup->w2row, setup->w2row + a01, w2row1, w2row1 + a01 );
+            const __m128 inside = _mm_and_ps( _mm_and_ps( _mm_cmpge_ps( w0, w0min ), _mm_cmpge_ps( w1, w1min ) ), _mm_cmpge_ps( w2, w2min ) );
+            const int rowMask = width == 2 ? 0x3 : 0x1;
+            const int stampMask = height == 2 ? rowMask | (rowMask << 2) : rowMask;
+            const int xs[ 4 ] = { minx, minx + 1, minx, minx + 1 };
+            const int ys[ 4 ] = { miny, miny, miny + 1, miny + 1 };
+
+            rasterStampPixels4( setup, state, fb, w0, w1, w2, xs, ys, _mm_movemask_ps( inside ) & stampMask, depthFormat, shadeMode, flags );
+            continue;
+        }
+
+        // 4x4 stamp, one row per register.
+        const int rowMask = (1 << width) - 1;
+        const int xs[ 4 ] = { minx, minx + 1, minx + 2, minx + 3 };
+        float w0row = setup->w0row;
+        float w1row = setup->w1row;
+        float w2row = setup->w2row;
+
+        for (int y = 0; y < height; ++y)
+        {
+            const float w0a = w0row + a12, w0b = w0a + a12;
+            const float w1a = w1row + a20, w1b = w1a + a20;
+            const float w2a = w2row + a01, w2b = w2a + a01;
+            const __m128 w0 = _mm_setr_ps( w0row, w0a, w0b, w0b + a12 );
+            const __m128 w1 = _mm_setr_ps( w1row, w1a, w1b, w1b + a20 );
+            const __m128 w2 = _mm_setr_ps( w2row, w2a, w2b, w2b + a01 );
+            const __m128 inside = _mm_and_ps( _mm_and_ps( _mm_cmpge_ps( w0, w0min ), _mm_cmpge_ps( w1, w1min ) ), _mm_cmpge_ps( w2, w2min ) );
+            const int laneMask = _mm_movemask_ps( inside ) & rowMask;
+
+            if (laneMask != 0)
+            {
+                const int ys[ 4 ] = { miny + y, miny + y, miny + y, miny + y };
+                rasterStampPixels4( setup, state, fb, w0, w1, w2, xs, ys, laneMask, depthFormat, shadeMode, flags );
+            }
+
+            w0row += b12;
+            w1row += b20;
+            w2row += b01;
+        }
+    }
+#endif
+}
+
+// Triangles whose bounds' getRatio() is outside [SLIVER_RATIO_MIN, SLIVER_RATIO_MAX] are rasterized in spans, see rasterSpansImpl().
+#define SLIVER_RATIO_MIN 0.4f
+#define SLIVER_RATIO_MAX 1.6f
+
+FORCE_INLINE bool isSliverTriangle( const TriangleSetup* setup )
+{
+    // Pixel extents, so that one pixel tall bounds don't divide by zero.
+    const float ratio = getRatio( (Vec3){ (float)setup->minx, (float)setup->miny, 0 }, (Vec3){ (float)setup->maxx + 1, (float)setup->maxy + 1, 0 } );
+    return ratio < SLIVER_RATIO_MIN || ratio > SLIVER_RATIO_MAX;
+}
+
+// Rasterizer a triangle is drawn with.
+typedef enum
+{
+    RasterPathSmall,  // Stamps, see isSmallTriangle().
+    RasterPathSliver, // Spans, see isSliverTriangle().
+    RasterPathFull    // Whole bounds.
+} RasterPath;
+
+// Classifies a triangle by its unclipped setup, so that all tiles it touches draw it the same way.
+FORCE_INLINE RasterPath classifyTriangle( const TriangleSetup* setup )
+{
+    if (isSmallTriangle( setup ))
+    {
+        return RasterPathSmall;
+    }
+
+    return isSliverTriangle( setup ) ? RasterPathSliver : RasterPathFull;
+}
+
+// Narrows pixels [*xStart, *xEnd) of a row to where the edge function w + a * (x - minx) can be >= 0.
+// Keeps a pixel of slack on each side because the pixels are tested again with differently rounded edge functions.
+FORCE_INLINE void clipSpanToEdge( float w, float a, int minx, int* xStart, int* xEnd )
+{
+    // Clamped before converting to int, the crossing can be arbitrarily far for edges parallel to x.
+    const float limit = (float)(*xEnd - minx + 2);
+
+    if (a > 0)
+    {
+        const float first = fmaxf( fminf( -w / a, limit ), -2.0f );
+        *xStart = maxi( *xStart, minx + (int)floorf( first ) - 1 );
+    }
+    else if (a < 0)
+    {
+        const float last = fmaxf( fminf( w / -a, limit ), -2.0f );
+        *xEnd = mini( *xEnd, minx + (int)ceilf( last ) + 2 );
+    }
+    else if (w < 0)
+    {
+        *xEnd = *xStart;
+    }
+}
+
+// Pixels [*xStart, *xEnd) of a row that can be inside all edges. w0, w1, w2 are the row's edge functions at minx.
+FORCE_INLINE void spanBounds( const TriangleSetup* setup, float w0, float w1, float w2, int* xStart, int* xEnd )
+{
+    *xStart = setup->minx;
+    *xEnd = setup->maxx + 1;
+    clipSpanToEdge( w0, setup->a12, setup->minx, xStart, xEnd );
+    clipSpanToEdge( w1, setup->a20, setup->minx, xStart, xEnd );
+    clipSpanToEdge( w2, setup->a01, setup->minx, xStart, xEnd );
+}
+
+// Edge-walking rasterizer for long, thin triangles that would waste most of a bounding box sweep.
+// Each row's span comes from the edges' crossings and is tested 4 pixels at a time.
+// Edge functions are evaluated as w + a * x instead of accumulated, so coverage can differ from rasterTriangleImpl()
+// where an edge function rounds to 0.
+FORCE_INLINE void rasterSpansImpl( const TriangleSetup* setup, const DrawState* state, Framebuffer* fb,
+                                   const DepthFormat depthFormat, const ShadeMode shadeMode, const int flags )
+{
+#ifdef ARCH_X64
+    const bool blend = (flags & RasterBlend) != 0 && shadeMode != ShadeDepthOnly;
+    const bool writeDepth = (flags & RasterDepthWrite) != 0 && !blend;
+    const bool lit = (flags & RasterLit) != 0 && shadeMode != ShadeDepthOnly;
+    const bool msaa = (flags & RasterMsaa) != 0;
+    const int alpha = blend ? blendAlpha( state->opacity ) : 0;
+    const int minx = setup->minx;
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 laneOffsets = _mm_setr_ps( 0, 1, 2, 3 );
+    const __m128 a12 = _mm_set1_ps( setup->a12 );
+    const __m128 a20 = _mm_set1_ps( setup->a20 );
+    const __m128 a01 = _mm_set1_ps( setup->a01 );
+    const __m128 z1 = _mm_set1_ps( setup->z1 );
+    const __m128 z2 = _mm_set1_ps( setup->z2 );
+    const __m128 z3 = _mm_set1_ps( setup->z3 );
+    const __m128 w0min = _mm_set1_ps( setup->w0min );
+    const __m128 w1min = _mm_set1_ps( setup->w1min );
+    const __m128 w2min = _mm_set1_ps( setup->w2min );
+
+    __m128 w0Sample = zero, w1Sample = zero, w2Sample = zero;
+    float w0Samples[ 4 ], w1Samples[ 4 ], w2Samples[ 4 ];
+
+    if (msaa)
+    {
+        msaaEdgeOffsets4( setup, &w0Sample, &w1Sample, &w2Sample );
+        _mm_storeu_ps( w0Samples, w0Sample );
+        _mm_storeu_ps( w1Samples, w1Sample );
+        _mm_storeu_ps( w2Samples, w2Sample );
+    }
+
+    float w0row = setup->w0row;
+    float w1row = setup->w1row;
+    float w2row = setup->w2row;
+
+    for (int y = setup->miny; y <= setup->maxy; ++y)
+    {
+        int* row = (int*)((Uint8*)fb->colorBuffer + y * fb->colorPitch);
+        Uint8* rowZ = depthBufferRow( &fb->depth, y );
+        int xStart;
+        int xEnd;
+
+        if (msaa)
+        {
+            // Samples are offset vertically too, so the span is the union of each sample's span.
+            xStart = setup->maxx + 1;
+            xEnd = minx;
+
+            for (int s = 0; s < MAX_SAMPLES; ++s)
+            {
+                int sampleStart;
+                int sampleEnd;
+                spanBounds( setup, w0row + w0Samples[ s ], w1row + w1Samples[ s ], w2row + w2Samples[ s ], &sampleStart, &sampleEnd );
+
+                if (sampleStart < sampleEnd)
+                {
+                    xStart = mini( xStart, sampleStart );
+                    xEnd = maxi( xEnd, sampleEnd );
+                }
+            }
+
+            for (int x = xStart; x < xEnd; ++x)
+            {
+                const float k = (float)(x - minx);
+                rasterPixelMsaa( setup, state, fb, row, rowZ, x, y, w0row + setup->a12 * k, w1row + setup->a20 * k, w2row + setup->a01 * k,
+                                 w0Sample, w1Sample, w2Sample, depthFormat, shadeMode, flags );
+            }
+        }
+        else
+        {
+            spanBounds( setup, w0row, w1row, w2row, &xStart, &xEnd );
+
+            for (int x = xStart; x < xEnd; x += 4)
+            {
+                const int count = mini( 4, xEnd - x );
+                const __m128 k = _mm_add_ps( _mm_set1_ps( (float)(x - minx) ), laneOffsets );
+                const __m128 w0 = _mm_add_ps( _mm_set1_ps( w0row ), _mm_mul_ps( a12, k ) );
+                const __m128 w1 = _mm_add_ps( _mm_set1_ps( w1row ), _mm_mul_ps( a20, k ) );
+                const __m128 w2 = _mm_add_ps( _mm_set1_ps( w2row ), _mm_mul_ps( a01, k ) );
+                const __m128 di = _mm_add_ps( _mm_add_ps( _mm_mul_ps( w0, z1 ), _mm_mul_ps( w1, z2 ) ), _mm_mul_ps( w2, z3 ) );
+
+                __m128 mask = _mm_and_ps( _mm_and_ps( _mm_cmpge_ps( w0, w0min ), _mm_cmpge_ps( w1, w1min ) ), _mm_cmpge_ps( w2, w2min ) );
+                mask = _mm_and_ps( mask, _mm_and_ps( _mm_cmpneq_ps( di, zero ), _mm_cmplt_ps( laneOffsets, _mm_set1_ps( (float)count ) ) ) );
+
+                if (_mm_movemask_ps( mask ) == 0)
+                {
+                    continue;
+                }
+
+                STAT_ADD( StatPixelsTested, statsPopCount4( _mm_movemask_ps( mask ) ) );
+
+                const __m128 depth = _mm_mul_ps( di, _mm_set1_ps( setup->depthScale ) );
+                const int laneMask = _mm_movemask_ps( _mm_and_ps( mask, _mm_castsi128_ps( depthTest4( depthFormat, rowZ, x, count, depth ) ) ) );
+
+                if (laneMask == 0)
+                {
+                    continue;
+                }
+
+                STAT_ADD( StatPixelsPassed, statsPopCount4( laneMask ) );
+
+                float w0s[ 4 ], w1s[ 4 ], w2s[ 4 ], dis[ 4 ], depths[ 4 ];
+                _mm_storeu_ps( w0s, w0 );
+                _mm_storeu_ps( w1s, w1 );
+                _mm_storeu_ps( w2s, w2 );
+                _mm_storeu_ps( dis, di );
+                _mm_storeu_ps( depths, depth );
+
+                int colors[ 4 ] = { 0 };
+
+                for (int lane = 0; lane < 4; ++lane)
+                {
+                    if (!(laneMask & (1 << lane)))
+                    {
+                        continue;
+                    }
+
+                    if (writeDepth)
+                    {
+                        depthWrite( depthFormat, rowZ, x + lane, depths[ lane ] );
+                    }
+
+                    if (shadeMode != ShadeDepthOnly)
+                    {
+                        colors[ lane ] = shadePixel( shadeMode, lit, &setup->in, state, w0s[ lane ], w1s[ lane ], w2s[ lane ], dis[ lane ] );
+
+                        if (!blend)
+                        {
+                            row[ x + lane ] = colors[ lane ];
+                        }
+                    }
+                }
+
+                if (blend)
+                {
+                    Uint32 pixels[ 4 ] = { 0 };
+                    memcpy( pixels, &row[ x ], count * sizeof( Uint32 ) );
+
+                    const __m128i dst = _mm_loadu_si128( (const __m128i*)pixels );
+                    _mm_storeu_si128( (__m128i*)pixels, blendPremultipliedMasked4( _mm_loadu_si128( (const __m128i*)colors ), dst, alpha, laneMask ) );
+                    memcpy( &row[ x ], pixels, count * sizeof( Uint32 ) );
+                }
+            }
+        }
+
+        w0row += setup->b12;
+        w1row += setup->b20;
+        w2row += setup->b01;
+    }
+#else
+    rasterTriangleImpl( setup, state, fb, depthFormat, shadeMode, flags );
+#endif
+}
+
+// Flags that are branched on instead of selecting a variant. They come from the draw's state and framebuffer.
+FORCE_INLINE int rasterRuntimeFlags( const DrawState* state, const Framebuffer* fb )
+{
+    return (state->lighting ? RasterLit : 0) | (fb->sampleCount > 1 ? RasterMsaa : 0);
+}
+
+// Body of the drawTriangle2 variants, which only differ in rasterTriangle.
+static void setupAndRasterTriangle( Vertex* v1, Vertex* v2, Vertex* v3, const DrawState* state, Framebuffer* fb, ShadeMode shadeMode, RasterTriangleFunc rasterTriangle )
+{
+    const int flags = rasterRuntimeFlags( state, fb );
+    TriangleSetup setup;
+
+    if (setupTriangle( v1, v2, v3, fb->width, fb->height, (flags & RasterMsaa) != 0, setupTexScale( state, shadeMode ), (flags & RasterLit) != 0 && shadeMode != ShadeDepthOnly, &setup ))
+    {
+        rasterTriangle( &setup, state, fb );
+    }
+}
+
+// Generates the rasterizers of one depth format, shade mode and variant flags for any triangle, small triangles and slivers,
+// and a drawTriangle2 variant that sets up a single triangle and rasterizes it.
+#define DEFINE_DRAW_TRIANGLE2( depthFormat, shadeMode, flags ) \
+    void rasterTriangle_##depthFormat##_##shadeMode##_##flags( const TriangleSetup* setup, const DrawState* state, Framebuffer* fb ) \
+    { \
+        rasterTriangleImpl( setup, state, fb, depthFormat, shadeMode, flags | rasterRuntimeFlags( state, fb ) ); \
+    } \
+    void rasterSmallTriangles_##depthFormat##_##shadeMode##_##flags( const TriangleSetup* setups, unsigned count, const DrawState* state, Framebuffer* fb ) \
+    { \
+        rasterSmallTrianglesImpl( setups, count, state, fb, rasterTriangle_##depthFormat##_##shadeMode##_##flags, depthFormat, shadeMode, \
+                                  flags | rasterRuntimeFlags( state, fb ) ); \
+    } \
+    void rasterSpans_##depthFormat##_##shadeMode##_##flags( const TriangleSetup* setup, const DrawState* state, Framebuffer* fb ) \
+    { \
+        rasterSpansImpl( setup, state, fb, depthFormat, shadeMode, flags | rasterRuntimeFlags( state, fb ) ); \
+    } \
+    void drawTriangle2_##depthFormat##_##shadeMode##_##flags( Vertex* v1, Vertex* v2, Vertex* v3, const DrawState* state, Framebuffer* fb ) \
+    { \
+        setupAndRasterTriangle( v1, v2, v3, state, fb, shadeMode, rasterTriangle_##depthFormat##_##shadeMode##_##flags ); \
+    }
+
+// Variant flags are 0, 1 (RasterDepthWrite) and 4 (RasterBlend). Depth-only draws don't blend.
+#define DEFINE_DRAW_TRIANGLE2_FLAGS( depthFormat, shadeMode ) \
+    DEFINE_DRAW_TRIANGLE2( depthFormat, shadeMode, 0 ) \
+    DEFINE_DRAW_TRIANGLE2( depthFormat, shadeMode, 1 ) \
+    DEFINE_DRAW_TRIANGLE2( depthFormat, shadeMode, 4 )
+
+#define DEFINE_DRAW_TRIANGLE2_SHADE_MODES( depthFormat ) \
+    DEFINE_DRAW_TRIANGLE2( depthFormat, ShadeDepthOnly, 0 ) \
+    DEFINE_DRAW_TRIANGLE2( depthFormat, ShadeDepthOnly, 1 ) \
+    DEFINE_DRAW_TRIANGLE2_FLAGS( depthFormat, ShadeFlat ) \
+    DEFINE_DRAW_TRIANGLE2_FLAGS( depthFormat, ShadeTextureNearest ) \
+    DEFINE_DRAW_TRIANGLE2_FLAGS( depthFormat, ShadeTextureBilinear )
+
+DEFINE_DRAW_TRIANGLE2_SHADE_MODES( DepthFloat32 )
+DEFINE_DRAW_TRIANGLE2_SHADE_MODES( DepthUnorm24 )
+DEFINE_DRAW_TRIANGLE2_SHADE_MODES( DepthUnorm16 )
+
+#define DRAW_TRIANGLE2_FLAGS( func, depthFormat, shadeMode ) \
+    { func##_##depthFormat##_##shadeMode##_0, func##_##depthFormat##_##shadeMode##_1, func##_##depthFormat##_##shadeMode##_4 }
+
+#define DRAW_TRIANGLE2_SHADE_MODES( func, depthFormat ) \
+    { \
+        { func##_##depthFormat##_ShadeDepthOnly_0, func##_##depthFormat##_ShadeDepthOnly_1, func##_##depthFormat##_ShadeDepthOnly_0 }, \
+        DRAW_TRIANGLE2_FLAGS( func, depthFormat, ShadeFlat ), \
+        DRAW_TRIANGLE2_FLAGS( func, depthFormat, ShadeTextureNearest ), \
+        DRAW_TRIANGLE2_FLAGS( func, depthFormat, ShadeTextureBilinear ) \
+    }
+
+// Indexed by [DepthFormat][ShadeMode][RasterVariant].
+static const DrawTriangle2Func drawTriangle2Variants[ DepthFormatCount ][ ShadeModeCount ][ RasterVariantCount ] =
+{
+    DRAW_TRIANGLE2_SHADE_MODES( drawTriangle2, DepthFloat32 ),
+    DRAW_TRIANGLE2_SHADE_MODES( drawTriangle2, DepthUnorm24 ),
+    DRAW_TRIANGLE2_SHADE_MODES( drawTriangle2, DepthUnorm16 )
+};
+
+// Indexed by [DepthFormat][ShadeMode][RasterVariant].
+static const RasterTriangleFunc rasterTriangleVariants[ DepthFormatCount ][ ShadeModeCount ][ RasterVariantCount ] =
+{
+    DRAW_TRIANGLE2_SHADE_MODES( rasterTriangle, DepthFloat32 ),
+    DRAW_TRIANGLE2_SHADE_MODES( rasterTriangle, DepthUnorm24 ),
+    DRAW_TRIANGLE2_SHADE_MODES( rasterTriangle, DepthUnorm16 )
+};
+
+// Folds flags into the variant that draws them. Blending never writes depth, and depth-only draws have nothing to blend.
+FORCE_INLINE RasterVariant rasterVariant( ShadeMode shadeMode, int flags )
+{
+    if ((flags & RasterBlend) && shadeMode != ShadeDepthOnly)
+    {
+        return RasterVariantBlend;
+    }
+
+    return (flags & RasterDepthWrite) ? RasterVariantDepthWrite : RasterVariantNone;
+}
+
+DrawTriangle2Func selectDrawTriangle2( DepthFormat depthFormat, ShadeMode shadeMode, int flags )
+{
+    return drawTriangle2Variants[ depthFormat ][ shadeMode ][ rasterVariant( shadeMode, flags ) ];
+}
+
+// Indexed by [DepthFormat][ShadeMode][RasterVariant].
+static const RasterSmallTrianglesFunc rasterSmallTrianglesVariants[ DepthFormatCount ][ ShadeModeCount ][ RasterVariantCount ] =
+{
+    DRAW_TRIANGLE2_SHADE_MODES( rasterSmallTriangles, DepthFloat32 ),
+    DRAW_TRIANGLE2_SHADE_MODES( rasterSmallTriangles, DepthUnorm24 ),
+    DRAW_TRIANGLE2_SHADE_MODES( rasterSmallTriangles, DepthUnorm16 )
+};
+
+// Indexed by [DepthFormat][ShadeMode][RasterVariant].
+static const RasterTriangleFunc rasterSpansVariants[ DepthFormatCount ][ ShadeModeCount ][ RasterVariantCount ] =
+{
+    DRAW_TRIANGLE2_SHADE_MODES( rasterSpans, DepthFloat32 ),
+    DRAW_TRIANGLE2_SHADE_MODES( rasterSpans, DepthUnorm24 ),
+    DRAW_TRIANGLE2_SHADE_MODES( rasterSpans, DepthUnorm16 )
+};
+
+RasterTriangleFunc selectRasterTriangle( DepthFormat depthFormat, ShadeMode shadeMode, int flags )
+{
+    return rasterTriangleVariants[ depthFormat ][ shadeMode ][ rasterVariant( shadeMode, flags ) ];
+}
+
+RasterSmallTrianglesFunc selectRasterSmallTriangles( DepthFormat depthFormat, ShadeMode shadeMode, int flags )
+{
+    return rasterSmallTrianglesVariants[ depthFormat ][ shadeMode ][ rasterVariant( shadeMode, flags ) ];
+}
+
+RasterTriangleFunc selectRasterSpans( DepthFormat depthFormat, ShadeMode shadeMode, int flags )
+{
+    return rasterSpansVariants[ depthFormat ][ shadeMode ][ rasterVariant( shadeMode, flags ) ];
+}
+
+// Convenience entry point that selects the variant per call. flatColor != 0 draws flat color, otherwise nearest-sampled texture.
+void drawTriangle2( Vertex* v1, Vertex* v2, Vertex* v3, int rowPitch, int* texture, int texDim, int flatColor, DepthBuffer* depthBuffer, int* outBuffer )
+{
+    DrawState state = { 0 };
+    state.shadeMode = flatColor != 0 ? ShadeFlat : ShadeTextureNearest;
+    state.depthWrite = true;
+    state.flatColor = flatColor;
+    state.texture = texture;
+    state.texDim = texDim;
+
+    // Single-sampled view of the caller's buffers. Tile states aren't used without multisampling.
+    Framebuffer fb = { 0 };
+    fb.colorBuffer = outBuffer;
+    fb.colorPitch = rowPitch;
+    fb.depth = *depthBuffer;
+    fb.sampleCount = 1;
+    fb.width = depthBuffer->width;
+    fb.height = depthBuffer->height;
+
+    selectDrawTriangle2( depthBuffer->format, state.shadeMode, RasterDepthWrite )( v1, v2, v3, &state, &fb );
+}
+
+// Vertices must be in CCW order! texture must be a 4-channel 32-bit format.
+// Optimized version of drawTriangle2(). Block-based approach.
+// texture dimension must be square (width == height)
+void drawTriangle3( Vertex* v1, Vertex* v2, Vertex* v3, int rowPitch, int* texture, int texDim, int forceColor, DepthBuffer* depthBuffer, int* outBuffer )
+{
+    float x1 = v1->x;
+    float x2 = v2->x;
+    float x3 = v3->x;
+    float y1 = v1->y;
+    float y2 = v2->y;
+    float y3 = v3->y;
+
+    float s1 = v1->u / v1->z;
+    float s2 = v2->u / v2->z;
+    float s3 = v3->u / v3->z;
+    float t1 = v1->v / v1->z;
+    float t2 = v2->v / v2->z;
+    float t3 = v3->v / v3->z;
+
+    float z1 = 1.0f / v1->z;
+    float z2 = 1.0f / v2->z;
+    float z3 = 1.0f / v3->z;
+
+    int minx = round( fmin( x1, fmin( x2, x3 ) ) );
+    int miny = round( fmin( y1, fmin( y2, y3 ) ) );
+    int maxx = fmax( x1, fmax( x2, x3 ) );
+    int maxy = fmax( y1, fmax( y2, y3 ) );
+
+    // Clip against screen bounds
+    minx = fmax( minx, 0 );
+    miny = fmax( miny, 0 );
+    maxx = fmin( maxx, depthBuffer->width - 1 );
+    maxy = fmin( maxy, depthBuffer->height - 1 );
+
+    float ratio = getRatio( (Vec3){ minx, miny, 0 }, (Vec3){ maxx, maxy, 0 } );
+    bool useBlock = ratio > 0.4f && ratio < 1.6f;
+
+    const int blockDim = 8;
+    
+    // Start in corner of 8x8 block
+    minx &= ~(blockDim - 1);
+    miny &= ~(blockDim - 1);
+    
+    float a01 = y1 - y2, b01 = x2 - x1;
+    float a12 = y2 - y3, b12 = x3 - x2;
+    float a20 = y3 - y1, b20 = x1 - x3;
+
+    // Correct for filling convention. FIXME: Not sure if this is correct!
+    int bias0 = a01 < 0 ? 0 : -1;
+    int bias1 = a12 < 0 ? 0 : -1;
+    int bias2 = a20 < 0 ? 0 : -1;
+    //if (a01 < 0 || (a01 == 0 && b01 < 0)) bias0 = 0;
+    //if (a12 < 0 || (a12 == 0 && b12 < 0)) bias1 = 0;
+    //if (a20 < 0 || (a20 == 0 && b20 < 0)) bias2 = 0;
+
+    float w0row = orient2D( x2, y2, x3, y3, minx, miny ) + bias0;
+    float w1row = orient2D( x3, y3, x1, y1, minx, miny ) + bias1;
+    float w2row = orient2D( x1, y1, x2, y2, minx, miny ) + bias2;
+
+    const float depthScale = DEPTH_NEAR_Z / orient2D( x1, y1, x2, y2, x3, y3 );
 
     Uint32* target = (Uint32*)((Uint8*)outBuffer + miny * rowPitch);
-    float* targetZ = (float*)((Uint8*)zBuffer + miny * rowPitch);
+    Uint8* targetZ = depthBufferRow( depthBuffer, miny );
 
     int c1 = (y1 - y2) * x1 - (x1 - x2) * y1;
     int c2 = (y2 - y3) * x2 - (x2 - x3) * y2;
@@ -332,11 +1515,11 @@ void drawTriangle3( Vertex* v1, Vertex* v2, Vertex* v3, int rowPitch, int* textu
             int a02 = edgeFunction( x0, y0, x1, y1, x, y ) + bias0;
             int a03 = edgeFunction( x0, y0, x1, y1, x, y ) + bias0;
 
-            float z = 1.0f / (w0 * z1 + w1 * z2 + w2 * z3);
+            float di = (w0 * z1 + w1 * z2 + w2 * z3);
 
-            if (z > targetZ[ x ] && w0 >= 0 && w1 >= 0 && w2 >= 0)
+            if (w0 >= 0 && w1 >= 0 && w2 >= 0 && depthTestAndWrite( depthBuffer->format, targetZ, x, di * depthScale ))
             {
-                targetZ[ x ] = z;
+                float z = 1.0f / di;
 
                 float s = w0 * s1 + w1 * s2 + w2 * s3;
                 float t = w0 * t1 + w1 * t2 + w2 * t3;
@@ -368,90 +1551,803 @@ void drawTriangle3( Vertex* v1, Vertex* v2, Vertex* v3, int rowPitch, int* textu
         w1row += b20;
         w2row += b01;
 
-        target += WIDTH;
-        targetZ += WIDTH;
+        target = (Uint32*)((Uint8*)target + rowPitch);
+        targetZ += depthBuffer->pitch;
     }
 }
 
-void renderMesh( Mesh* mesh, Matrix44* localToClip, int pitch, int* texture, int texDim, float* zBuffer, int* outBuffer )
+// Batched vertex pass: transforms mesh's vertices [begin, end) into the raster space of a width x height render target
+// and evaluates vertex lighting if lighting != NULL. localToWorld is only needed for lighting.
+// Ranges that start at a multiple of 4 give the same results as transforming the whole mesh at once.
+void transformVertices( const Mesh* mesh, unsigned begin, unsigned end, const Matrix44* localToWorld, const Matrix44* localToClip, int width, int height,
+                        const Lighting* lighting, Vertex* outVertices )
 {
-    double accumTriangleTime = 0;
-    int renderedTriangleCount = 0;
-    uint64_t accumCycles = 0;
-    
-    //int positionCount[ 32 ] = { 0 };
-
-    for (unsigned f = 0; f < mesh->faceCount; ++f)
-    {
-        Vertex cv0;
-        Vertex cv1;
-        Vertex cv2;
-
-        //positionCount[ mesh->faces[ f ].a ]++;
-        //positionCount[ mesh->faces[ f ].b ]++;
-        //positionCount[ mesh->faces[ f ].c ]++;
-
-        Vec3 v = localToRaster( mesh->positions[ mesh->faces[ f ].a ], localToClip );
-        cv0.x = v.x;
-        cv0.y = v.y;
-        cv0.z = v.z;
-        cv0.u = mesh->uvs[ mesh->faces[ f ].a ].u;
-        cv0.v = mesh->uvs[ mesh->faces[ f ].a ].v;
-
-        v = localToRaster( mesh->positions[ mesh->faces[ f ].b ], localToClip );
-        cv1.x = v.x;
-        cv1.y = v.y;
-        cv1.z = v.z;
-        cv1.u = mesh->uvs[ mesh->faces[ f ].b ].u;
-        cv1.v = mesh->uvs[ mesh->faces[ f ].b ].v;
-
-        v = localToRaster( mesh->positions[ mesh->faces[ f ].c ], localToClip );
-        cv2.x = v.x;
-        cv2.y = v.y;
-        cv2.z = v.z;
-        cv2.u = mesh->uvs[ mesh->faces[ f ].c ].u;
-        cv2.v = mesh->uvs[ mesh->faces[ f ].c ].v;
-
-        uint64_t startTime = SDL_GetPerformanceCounter();
-        uint64_t startCycles = __rdtsc();
-        
-        // Unoptimized:
-        /*if (isBackface( cv0.x, cv0.y, cv1.x, cv1.y, cv2.x, cv2.y))
+    unsigned i = begin;
+
+#ifdef ARCH_X64
+    const float* c = localToClip->m;
+    const float* w = localToWorld->m;
+    const __m128 halfWidth = _mm_set1_ps( width * 0.5f );
+    const __m128 halfHeight = _mm_set1_ps( height * 0.5f );
+
+    for (; i + 4 <= end; i += 4)
+    {
+        const Vec3* p = &mesh->positions[ i ];
+        const __m128 px = _mm_set_ps( p[ 3 ].x, p[ 2 ].x, p[ 1 ].x, p[ 0 ].x );
+        const __m128 py = _mm_set_ps( p[ 3 ].y, p[ 2 ].y, p[ 1 ].y, p[ 0 ].y );
+        const __m128 pz = _mm_set_ps( p[ 3 ].z, p[ 2 ].z, p[ 1 ].z, p[ 0 ].z );
+
+        // Same math as localToRaster().
+        const __m128 clipX = _mm_add_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_set1_ps( c[ 0 ] ), px ), _mm_mul_ps( _mm_set1_ps( c[ 4 ] ), py ) ), _mm_mul_ps( _mm_set1_ps( c[ 8 ] ), pz ) ), _mm_set1_ps( c[ 12 ] ) );
+        const __m128 clipY = _mm_add_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_set1_ps( c[ 1 ] ), px ), _mm_mul_ps( _mm_set1_ps( c[ 5 ] ), py ) ), _mm_mul_ps( _mm_set1_ps( c[ 9 ] ), pz ) ), _mm_set1_ps( c[ 13 ] ) );
+        const __m128 clipZ = _mm_add_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_set1_ps( c[ 2 ] ), px ), _mm_mul_ps( _mm_set1_ps( c[ 6 ] ), py ) ), _mm_mul_ps( _mm_set1_ps( c[ 10 ] ), pz ) ), _mm_set1_ps( c[ 14 ] ) );
+
+        float xs[ 4 ], ys[ 4 ], zs[ 4 ];
+        _mm_storeu_ps( xs, _mm_add_ps( halfWidth, _mm_div_ps( _mm_mul_ps( clipX, halfWidth ), clipZ ) ) );
+        _mm_storeu_ps( ys, _mm_add_ps( halfHeight, _mm_div_ps( _mm_mul_ps( clipY, halfHeight ), clipZ ) ) );
+        _mm_storeu_ps( zs, clipZ );
+
+        float rs[ 4 ] = { 1, 1, 1, 1 };
+        float gs[ 4 ] = { 1, 1, 1, 1 };
+        float bs[ 4 ] = { 1, 1, 1, 1 };
+
+        if (lighting)
         {
-            drawTriangle( &cv0, &cv1, &cv2, pitch, texture, texDim, zBuffer, outBuffer );
-            ++renderedTriangleCount;
-        }*/
+            const Vec3* n = &mesh->normals[ i ];
+            const __m128 nx = _mm_set_ps( n[ 3 ].x, n[ 2 ].x, n[ 1 ].x, n[ 0 ].x );
+            const __m128 ny = _mm_set_ps( n[ 3 ].y, n[ 2 ].y, n[ 1 ].y, n[ 0 ].y );
+            const __m128 nz = _mm_set_ps( n[ 3 ].z, n[ 2 ].z, n[ 1 ].z, n[ 0 ].z );
+
+            const __m128 worldX = _mm_add_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_set1_ps( w[ 0 ] ), px ), _mm_mul_ps( _mm_set1_ps( w[ 4 ] ), py ) ), _mm_mul_ps( _mm_set1_ps( w[ 8 ] ), pz ) ), _mm_set1_ps( w[ 12 ] ) );
+            const __m128 worldY = _mm_add_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_set1_ps( w[ 1 ] ), px ), _mm_mul_ps( _mm_set1_ps( w[ 5 ] ), py ) ), _mm_mul_ps( _mm_set1_ps( w[ 9 ] ), pz ) ), _mm_set1_ps( w[ 13 ] ) );
+            const __m128 worldZ = _mm_add_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_set1_ps( w[ 2 ] ), px ), _mm_mul_ps( _mm_set1_ps( w[ 6 ] ), py ) ), _mm_mul_ps( _mm_set1_ps( w[ 10 ] ), pz ) ), _mm_set1_ps( w[ 14 ] ) );
+
+            // Assumes localToWorld has no non-uniform scale.
+            __m128 normalX = _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_set1_ps( w[ 0 ] ), nx ), _mm_mul_ps( _mm_set1_ps( w[ 4 ] ), ny ) ), _mm_mul_ps( _mm_set1_ps( w[ 8 ] ), nz ) );
+            __m128 normalY = _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_set1_ps( w[ 1 ] ), nx ), _mm_mul_ps( _mm_set1_ps( w[ 5 ] ), ny ) ), _mm_mul_ps( _mm_set1_ps( w[ 9 ] ), nz ) );
+            __m128 normalZ = _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_set1_ps( w[ 2 ] ), nx ), _mm_mul_ps( _mm_set1_ps( w[ 6 ] ), ny ) ), _mm_mul_ps( _mm_set1_ps( w[ 10 ] ), nz ) );
+            const __m128 invLength = _mm_div_ps( _mm_set1_ps( 1.0f ), _mm_sqrt_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( normalX, normalX ), _mm_mul_ps( normalY, normalY ) ), _mm_mul_ps( normalZ, normalZ ) ) ) );
+            normalX = _mm_mul_ps( normalX, invLength );
+            normalY = _mm_mul_ps( normalY, invLength );
+            normalZ = _mm_mul_ps( normalZ, invLength );
+
+            __m128 r, g, b;
+            lightVertices4( lighting, worldX, worldY, worldZ, normalX, normalY, normalZ, &r, &g, &b );
+            _mm_storeu_ps( rs, r );
+            _mm_storeu_ps( gs, g );
+            _mm_storeu_ps( bs, b );
+        }
 
-        // Optimized:
-        if (!isBackface( cv0.x, cv0.y, cv2.x, cv2.y, cv1.x, cv1.y) &&
-            cv0.x < 2000 && cv0.x > -2000 && cv1.x < 2000 && cv1.x > -2000 && cv2.x < 2000 && cv2.x > -2000)
+        for (unsigned k = 0; k < 4; ++k)
         {
-            int forceColor = 0x000000FF;
-            
-            if (f == 0) forceColor = 0x00FF0000;
-            if (f == 1) forceColor = 0x00FF0000;
-            if (f == 3) forceColor = 0x00FF0000;
-            if (f == 4) forceColor = 0x00FF0000;
-            if (f == 5) forceColor = 0x00FF0000;
-            
-            forceColor = 0;
+            Vertex* out = &outVertices[ i + k ];
+            out->x = xs[ k ];
+            out->y = ys[ k ];
+            out->z = zs[ k ];
+            out->u = mesh->uvs[ i + k ].u;
+            out->v = mesh->uvs[ i + k ].v;
+            out->r = rs[ k ];
+            out->g = gs[ k ];
+            out->b = bs[ k ];
+        }
+    }
+#endif
 
-            drawTriangle2( &cv0, &cv2, &cv1, pitch, texture, texDim, forceColor, zBuffer, outBuffer );
-            
-            ++renderedTriangleCount;
+    for (; i < end; ++i)
+    {
+        const Vec3 v = localToRaster( mesh->positions[ i ], localToClip, width, height );
+        Vertex* out = &outVertices[ i ];
+        out->x = v.x;
+        out->y = v.y;
+        out->z = v.z;
+        out->u = mesh->uvs[ i ].u;
+        out->v = mesh->uvs[ i ].v;
+        out->r = out->g = out->b = 1;
+
+        if (lighting)
+        {
+            Vec3 worldPosition;
+            Vec3 worldNormal;
+            transformPoint( mesh->positions[ i ], localToWorld, &worldPosition );
+            transformDirection( mesh->normals[ i ], localToWorld, &worldNormal );
+            const Vec3 light = lightVertex( lighting, worldPosition, normalized( worldNormal ) );
+            out->r = light.x;
+            out->g = light.y;
+            out->b = light.z;
+        }
+    }
+}
+
+// Faces are set up in batches of this many before rasterizing, see setupMeshTriangles().
+// A batch is a cluster, so culled clusters skip whole batches.
+#define SETUP_BATCH_SIZE MESH_CLUSTER_SIZE
+
+// Culls face f of mesh and sets it up. Returns false if it was culled.
+FORCE_INLINE bool setupMeshTriangle( const Mesh* mesh, const Vertex* vertices, unsigned f, int width, int height, const bool msaa, const float texScale, const bool lit,
+                                      TriangleSetup* out )
+{
+    const Vertex* cv0 = &vertices[ mesh->faces[ f ].a ];
+    const Vertex* cv1 = &vertices[ mesh->faces[ f ].b ];
+    const Vertex* cv2 = &vertices[ mesh->faces[ f ].c ];
+
+    STAT_ADD( StatTrianglesSubmitted, 1 );
+
+    // Same expression as isBackface( cv0->x, cv0->y, cv2->x, cv2->y, cv1->x, cv1->y ).
+    const float area = (cv1->x - cv0->x) * (cv1->y - cv2->y) - (cv1->x - cv2->x) * (cv1->y - cv0->y);
+
+    if (area < 0)
+    {
+        STAT_ADD( StatTrianglesCulledBackface, 1 );
+        return false;
+    }
+
+    if (area == 0)
+    {
+        STAT_ADD( StatTrianglesCulledZeroArea, 1 );
+        return false;
+    }
+
+    if (!(cv0->x < 2000 && cv0->x > -2000 && cv1->x < 2000 && cv1->x > -2000 && cv2->x < 2000 && cv2->x > -2000))
+    {
+        STAT_ADD( StatTrianglesCulledFrustum, 1 );
+        return false;
+    }
+
+    if (!setupTriangle( cv0, cv2, cv1, width, height, msaa, texScale, lit, out ))
+    {
+        STAT_ADD( StatTrianglesCulledFrustum, 1 );
+        return false;
+    }
+
+    return true;
+}
+
+#ifdef ARCH_X64
+// Attributes of 4 vertices, one vertex per lane.
+typedef struct
+{
+    __m128 x, y, z, u, v, r, g, b;
+} VertexLanes;
+
+// Vertex is 8 floats, so two 4x4 transposes turn 4 vertices into SoA form.
+FORCE_INLINE VertexLanes loadVertexLanes( const Vertex* v0, const Vertex* v1, const Vertex* v2, const Vertex* v3 )
+{
+    VertexLanes lanes;
+
+    lanes.x = _mm_loadu_ps( &v0->x );
+    lanes.y = _mm_loadu_ps( &v1->x );
+    lanes.z = _mm_loadu_ps( &v2->x );
+    lanes.u = _mm_loadu_ps( &v3->x );
+    _MM_TRANSPOSE4_PS( lanes.x, lanes.y, lanes.z, lanes.u );
+
+    lanes.v = _mm_loadu_ps( &v0->v );
+    lanes.r = _mm_loadu_ps( &v1->v );
+    lanes.g = _mm_loadu_ps( &v2->v );
+    lanes.b = _mm_loadu_ps( &v3->v );
+    _MM_TRANSPOSE4_PS( lanes.v, lanes.r, lanes.g, lanes.b );
+
+    return lanes;
+}
+
+// edgeThreshold() for 4 edges. excludedMin is FLT_MIN in all lanes.
+FORCE_INLINE __m128 edgeThreshold4( __m128 a, __m128 b, __m128 excludedMin )
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 topLeft = _mm_or_ps( _mm_cmplt_ps( a, zero ), _mm_and_ps( _mm_cmpeq_ps( a, zero ), _mm_cmplt_ps( b, zero ) ) );
+    return _mm_andnot_ps( topLeft, excludedMin );
+}
+
+// orient2D() for 4 triangles.
+FORCE_INLINE __m128 orient2D4( __m128 ax, __m128 ay, __m128 bx, __m128 by, __m128 cx, __m128 cy )
+{
+    return _mm_sub_ps( _mm_mul_ps( _mm_sub_ps( bx, ax ), _mm_sub_ps( cy, ay ) ), _mm_mul_ps( _mm_sub_ps( by, ay ), _mm_sub_ps( cx, ax ) ) );
+}
+#endif
+
+// Batched triangle setup: culls faces [firstFace, firstFace + faceCount) of mesh and sets up the rest, 4 faces at a time in SoA form.
+// Writes a setup record and the face index of each surviving triangle and returns their count. faceCount must be at most SETUP_BATCH_SIZE.
+unsigned setupMeshTriangles( const Mesh* mesh, const Vertex* vertices, unsigned firstFace, unsigned faceCount, int width, int height, const bool msaa,
+                             const float texScale, const bool lit, TriangleSetup* outSetups, unsigned* outFaces )
+{
+    assert( faceCount <= SETUP_BATCH_SIZE );
+
+    unsigned count = 0;
+    unsigned i = 0;
+
+#ifdef ARCH_X64
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps( 1.0f );
+    const __m128 guard = _mm_set1_ps( 2000.0f );
+    const __m128 negativeGuard = _mm_set1_ps( -2000.0f );
+    const __m128 texScale4 = _mm_set1_ps( texScale );
+    const __m128 excludedMin = _mm_set1_ps( FLT_MIN );
+
+    for (; i + 4 <= faceCount; i += 4)
+    {
+        const VertexInd* faces = &mesh->faces[ firstFace + i ];
+
+        // Rasterizer's vertex order is a, c, b.
+        const VertexLanes p1 = loadVertexLanes( &vertices[ faces[ 0 ].a ], &vertices[ faces[ 1 ].a ], &vertices[ faces[ 2 ].a ], &vertices[ faces[ 3 ].a ] );
+        const VertexLanes p2 = loadVertexLanes( &vertices[ faces[ 0 ].c ], &vertices[ faces[ 1 ].c ], &vertices[ faces[ 2 ].c ], &vertices[ faces[ 3 ].c ] );
+        const VertexLanes p3 = loadVertexLanes( &vertices[ faces[ 0 ].b ], &vertices[ faces[ 1 ].b ], &vertices[ faces[ 2 ].b ], &vertices[ faces[ 3 ].b ] );
+
+        // Same culling as setupMeshTriangle().
+        const __m128 area = _mm_sub_ps( _mm_mul_ps( _mm_sub_ps( p3.x, p1.x ), _mm_sub_ps( p3.y, p2.y ) ), _mm_mul_ps( _mm_sub_ps( p3.x, p2.x ), _mm_sub_ps( p3.y, p1.y ) ) );
+        const __m128 insideGuard = _mm_and_ps( _mm_and_ps( _mm_and_ps( _mm_cmplt_ps( p1.x, guard ), _mm_cmpgt_ps( p1.x, negativeGuard ) ),
+                                                           _mm_and_ps( _mm_cmplt_ps( p3.x, guard ), _mm_cmpgt_ps( p3.x, negativeGuard ) ) ),
+                                               _mm_and_ps( _mm_cmplt_ps( p2.x, guard ), _mm_cmpgt_ps( p2.x, negativeGuard ) ) );
+        // Entirely behind the camera, setupTriangle() rejects these too.
+        const __m128 behind = _mm_and_ps( _mm_and_ps( _mm_cmplt_ps( p1.z, zero ), _mm_cmplt_ps( p2.z, zero ) ), _mm_cmplt_ps( p3.z, zero ) );
+
+        const int backfaceMask = _mm_movemask_ps( _mm_cmplt_ps( area, zero ) );
+        const int zeroAreaMask = _mm_movemask_ps( _mm_cmpeq_ps( area, zero ) ) & ~backfaceMask;
+        const int guardMask = (~_mm_movemask_ps( insideGuard ) | _mm_movemask_ps( behind )) & 0xF & ~backfaceMask & ~zeroAreaMask;
+        int laneMask = 0xF & ~(backfaceMask | zeroAreaMask | guardMask);
+
+        STAT_ADD( StatTrianglesSubmitted, 4 );
+        STAT_ADD( StatTrianglesCulledBackface, statsPopCount4( backfaceMask ) );
+        STAT_ADD( StatTrianglesCulledZeroArea, statsPopCount4( zeroAreaMask ) );
+        STAT_ADD( StatTrianglesCulledFrustum, statsPopCount4( guardMask ) );
+
+        if (laneMask == 0)
+        {
+            continue;
+        }
+
+        // Bounds are rounded per lane because SSE2 has no round-half-away-from-zero, floor or ceil.
+        float minxs[ 4 ], minys[ 4 ], maxxs[ 4 ], maxys[ 4 ];
+        _mm_storeu_ps( minxs, _mm_min_ps( p1.x, _mm_min_ps( p2.x, p3.x ) ) );
+        _mm_storeu_ps( minys, _mm_min_ps( p1.y, _mm_min_ps( p2.y, p3.y ) ) );
+        _mm_storeu_ps( maxxs, _mm_max_ps( p1.x, _mm_max_ps( p2.x, p3.x ) ) );
+        _mm_storeu_ps( maxys, _mm_max_ps( p1.y, _mm_max_ps( p2.y, p3.y ) ) );
+
+        int bounds[ 4 ][ 4 ];
+
+        for (int k = 0; k < 4; ++k)
+        {
+            // Same rounding and clipping as setupTriangle().
+            int* b = bounds[ k ];
+            b[ 0 ] = maxi( msaa ? (int)floorf( minxs[ k ] ) : (int)roundf( minxs[ k ] ), 0 );
+            b[ 1 ] = maxi( msaa ? (int)floorf( minys[ k ] ) : (int)roundf( minys[ k ] ), 0 );
+            b[ 2 ] = mini( msaa ? (int)ceilf( maxxs[ k ] ) : (int)maxxs[ k ], width - 1 );
+            b[ 3 ] = mini( msaa ? (int)ceilf( maxys[ k ] ) : (int)maxys[ k ], height - 1 );
+
+            if ((laneMask & (1 << k)) && (b[ 0 ] > b[ 2 ] || b[ 1 ] > b[ 3 ]))
+            {
+                STAT_ADD( StatTrianglesCulledFrustum, 1 );
+                laneMask &= ~(1 << k);
+            }
+
+            minxs[ k ] = (float)b[ 0 ];
+            minys[ k ] = (float)b[ 1 ];
+        }
+
+        if (laneMask == 0)
+        {
+            continue;
+        }
+
+        const __m128 minx = _mm_loadu_ps( minxs );
+        const __m128 miny = _mm_loadu_ps( minys );
+
+        const __m128 a01 = _mm_sub_ps( p1.y, p2.y ), b01 = _mm_sub_ps( p2.x, p1.x );
+        const __m128 a12 = _mm_sub_ps( p2.y, p3.y ), b12 = _mm_sub_ps( p3.x, p2.x );
+        const __m128 a20 = _mm_sub_ps( p3.y, p1.y ), b20 = _mm_sub_ps( p1.x, p3.x );
+
+        const __m128 w0row = orient2D4( p2.x, p2.y, p3.x, p3.y, minx, miny );
+        const __m128 w1row = orient2D4( p3.x, p3.y, p1.x, p1.y, minx, miny );
+        const __m128 w2row = orient2D4( p1.x, p1.y, p2.x, p2.y, minx, miny );
+        const __m128 depthScale = _mm_div_ps( _mm_set1_ps( DEPTH_NEAR_Z ), orient2D4( p1.x, p1.y, p2.x, p2.y, p3.x, p3.y ) );
+
+        const __m128 z1 = _mm_div_ps( one, p1.z );
+        const __m128 z2 = _mm_div_ps( one, p2.z );
+        const __m128 z3 = _mm_div_ps( one, p3.z );
+
+        // Field order follows TriangleSetup.
+        float lanes[ 31 ][ 4 ];
+        _mm_storeu_ps( lanes[ 0 ], a01 );
+        _mm_storeu_ps( lanes[ 1 ], b01 );
+        _mm_storeu_ps( lanes[ 2 ], a12 );
+        _mm_storeu_ps( lanes[ 3 ], b12 );
+        _mm_storeu_ps( lanes[ 4 ], a20 );
+        _mm_storeu_ps( lanes[ 5 ], b20 );
+        _mm_storeu_ps( lanes[ 6 ], w0row );
+        _mm_storeu_ps( lanes[ 7 ], w1row );
+        _mm_storeu_ps( lanes[ 8 ], w2row );
+        _mm_storeu_ps( lanes[ 9 ], z1 );
+        _mm_storeu_ps( lanes[ 10 ], z2 );
+        _mm_storeu_ps( lanes[ 11 ], z3 );
+        _mm_storeu_ps( lanes[ 12 ], depthScale );
+        _mm_storeu_ps( lanes[ 13 ], _mm_div_ps( _mm_mul_ps( p1.u, texScale4 ), p1.z ) );
+        _mm_storeu_ps( lanes[ 14 ], _mm_div_ps( _mm_mul_ps( p2.u, texScale4 ), p2.z ) );
+        _mm_storeu_ps( lanes[ 15 ], _mm_div_ps( _mm_mul_ps( p3.u, texScale4 ), p3.z ) );
+        _mm_storeu_ps( lanes[ 16 ], _mm_div_ps( _mm_mul_ps( p1.v, texScale4 ), p1.z ) );
+        _mm_storeu_ps( lanes[ 17 ], _mm_div_ps( _mm_mul_ps( p2.v, texScale4 ), p2.z ) );
+        _mm_storeu_ps( lanes[ 18 ], _mm_div_ps( _mm_mul_ps( p3.v, texScale4 ), p3.z ) );
+
+        const __m128 litMask = lit ? _mm_castsi128_ps( _mm_set1_epi32( -1 ) ) : zero;
+        _mm_storeu_ps( lanes[ 19 ], _mm_and_ps( litMask, _mm_mul_ps( p1.r, z1 ) ) );
+        _mm_storeu_ps( lanes[ 20 ], _mm_and_ps( litMask, _mm_mul_ps( p2.r, z2 ) ) );
+        _mm_storeu_ps( lanes[ 21 ], _mm_and_ps( litMask, _mm_mul_ps( p3.r, z3 ) ) );
+        _mm_storeu_ps( lanes[ 22 ], _mm_and_ps( litMask, _mm_mul_ps( p1.g, z1 ) ) );
+        _mm_storeu_ps( lanes[ 23 ], _mm_and_ps( litMask, _mm_mul_ps( p2.g, z2 ) ) );
+        _mm_storeu_ps( lanes[ 24 ], _mm_and_ps( litMask, _mm_mul_ps( p3.g, z3 ) ) );
+        _mm_storeu_ps( lanes[ 25 ], _mm_and_ps( litMask, _mm_mul_ps( p1.b, z1 ) ) );
+        _mm_storeu_ps( lanes[ 26 ], _mm_and_ps( litMask, _mm_mul_ps( p2.b, z2 ) ) );
+        _mm_storeu_ps( lanes[ 27 ], _mm_and_ps( litMask, _mm_mul_ps( p3.b, z3 ) ) );
+        _mm_storeu_ps( lanes[ 28 ], edgeThreshold4( a12, b12, excludedMin ) );
+        _mm_storeu_ps( lanes[ 29 ], edgeThreshold4( a20, b20, excludedMin ) );
+        _mm_storeu_ps( lanes[ 30 ], edgeThreshold4( a01, b01, excludedMin ) );
+
+        for (int k = 0; k < 4; ++k)
+        {
+            if (!(laneMask & (1 << k)))
+            {
+                continue;
+            }
+
+            TriangleSetup* out = &outSetups[ count ];
+            outFaces[ count ] = firstFace + i + k;
+            ++count;
+
+            out->minx = bounds[ k ][ 0 ];
+            out->miny = bounds[ k ][ 1 ];
+            out->maxx = bounds[ k ][ 2 ];
+            out->maxy = bounds[ k ][ 3 ];
+            out->a01 = lanes[ 0 ][ k ]; out->b01 = lanes[ 1 ][ k ];
+            out->a12 = lanes[ 2 ][ k ]; out->b12 = lanes[ 3 ][ k ];
+            out->a20 = lanes[ 4 ][ k ]; out->b20 = lanes[ 5 ][ k ];
+            out->w0row = lanes[ 6 ][ k ];
+            out->w1row = lanes[ 7 ][ k ];
+            out->w2row = lanes[ 8 ][ k ];
+            out->w0min = lanes[ 28 ][ k ];
+            out->w1min = lanes[ 29 ][ k ];
+            out->w2min = lanes[ 30 ][ k ];
+            out->z1 = lanes[ 9 ][ k ];
+            out->z2 = lanes[ 10 ][ k ];
+            out->z3 = lanes[ 11 ][ k ];
+            out->depthScale = lanes[ 12 ][ k ];
+            out->in.s1 = lanes[ 13 ][ k ]; out->in.s2 = lanes[ 14 ][ k ]; out->in.s3 = lanes[ 15 ][ k ];
+            out->in.t1 = lanes[ 16 ][ k ]; out->in.t2 = lanes[ 17 ][ k ]; out->in.t3 = lanes[ 18 ][ k ];
+            out->in.r1 = lanes[ 19 ][ k ]; out->in.r2 = lanes[ 20 ][ k ]; out->in.r3 = lanes[ 21 ][ k ];
+            out->in.g1 = lanes[ 22 ][ k ]; out->in.g2 = lanes[ 23 ][ k ]; out->in.g3 = lanes[ 24 ][ k ];
+            out->in.b1 = lanes[ 25 ][ k ]; out->in.b2 = lanes[ 26 ][ k ]; out->in.b3 = lanes[ 27 ][ k ];
+        }
+    }
+#endif
+
+    for (; i < faceCount; ++i)
+    {
+        if (setupMeshTriangle( mesh, vertices, firstFace + i, width, height, msaa, texScale, lit, &outSetups[ count ] ))
+        {
+            outFaces[ count ] = firstFace + i;
+            ++count;
+        }
+    }
+
+    return count;
+}
+
+// Restricts setup to a pixel rectangle, eg. a tile. Returns false if they don't overlap.
+FORCE_INLINE bool clipTriangleSetup( const TriangleSetup* setup, int minx, int miny, int maxx, int maxy, TriangleSetup* out )
+{
+    *out = *setup;
+    out->minx = maxi( setup->minx, minx );
+    out->miny = maxi( setup->miny, miny );
+    out->maxx = mini( setup->maxx, maxx );
+    out->maxy = mini( setup->maxy, maxy );
+
+    if (out->minx > out->maxx || out->miny > out->maxy)
+    {
+        return false;
+    }
+
+    // Edge functions are linear, so they are stepped to the new corner. An unclipped corner keeps exact values.
+    const float dx = (float)(out->minx - setup->minx);
+    const float dy = (float)(out->miny - setup->miny);
+    out->w0row += setup->a12 * dx + setup->b12 * dy;
+    out->w1row += setup->a20 * dx + setup->b20 * dy;
+    out->w2row += setup->a01 * dx + setup->b01 * dy;
+
+    return true;
+}
+
+// Work items per job of renderMesh()'s stages. TRANSFORM_BLOCK must be a multiple of 4, see transformVertices().
+#define TRANSFORM_BLOCK 64   // Vertices transformed or skipped together.
+#define TRANSFORM_GRAIN 16   // Blocks of TRANSFORM_BLOCK vertices.
+#define SETUP_GRAIN 4        // Batches of SETUP_BATCH_SIZE faces.
+#define RASTER_GRAIN 1       // Tiles.
+
+// State of the mesh being drawn, shared by renderMesh()'s jobs. Buffers are in the frame arena.
+typedef struct
+{
+    const Mesh* mesh;
+    const Matrix44* localToWorld;
+    const Matrix44* localToClip;
+    const DrawState* state;
+    Framebuffer* fb;
+    RasterTriangleFunc rasterFunc;
+    RasterSmallTrianglesFunc rasterSmallFunc;
+    RasterTriangleFunc rasterSpansFunc;
+    float texScale;
+    bool lit;
+    bool msaa;
+
+    bool* visibleClusters; // Clusters that aren't facing away, one per setup batch.
+    bool* transformBlocks; // Blocks of TRANSFORM_BLOCK vertices that visible clusters use.
+    Vertex* vertices; // Post-transform vertices. Only blocks in transformBlocks are written.
+    TriangleSetup* setups; // Batch b's records start at b * SETUP_BATCH_SIZE, setupCounts[ b ] of them are valid.
+    unsigned* setupFaces;
+    unsigned* setupCounts;
+    unsigned* tileBinStarts; // Tile t's setups are tileBins[ tileBinStarts[ t ] ] .. tileBins[ tileBinStarts[ t + 1 ] - 1 ].
+    unsigned* activeTiles; // Tiles with a non-empty bin.
+    unsigned activeTileCount;
+    unsigned* tileBins;
+} MeshDraw;
+
+static void transformVerticesJob( void* data, unsigned begin, unsigned end )
+{
+    const MeshDraw* draw = (const MeshDraw*)data;
+
+    for (unsigned block = begin; block < end; ++block)
+    {
+        if (draw->transformBlocks[ block ])
+        {
+            transformVertices( draw->mesh, block * TRANSFORM_BLOCK, mini( (block + 1) * TRANSFORM_BLOCK, draw->mesh->vertexCount ),
+                               draw->localToWorld, draw->localToClip, draw->fb->width, draw->fb->height, draw->state->lighting, draw->vertices );
         }
+    }
+}
 
-        uint64_t currTime = SDL_GetPerformanceCounter();
-        double elapsedTime = (double)((currTime - startTime) / (double)(SDL_GetPerformanceFrequency()));
+static void setupTrianglesJob( void* data, unsigned begin, unsigned end )
+{
+    MeshDraw* draw = (MeshDraw*)data;
+
+    for (unsigned batch = begin; batch < end; ++batch)
+    {
+        if (!draw->visibleClusters[ batch ])
+        {
+            draw->setupCounts[ batch ] = 0;
+            continue;
+        }
 
-        accumTriangleTime += elapsedTime;
-        accumCycles += __rdtsc() - startCycles;
+        const unsigned firstFace = batch * SETUP_BATCH_SIZE;
+        const unsigned faceCount = mini( SETUP_BATCH_SIZE, draw->mesh->faceCount - firstFace );
+        draw->setupCounts[ batch ] = setupMeshTriangles( draw->mesh, draw->vertices, firstFace, faceCount, draw->fb->width, draw->fb->height,
+                                                         draw->msaa, draw->texScale, draw->lit, &draw->setups[ firstFace ], &draw->setupFaces[ firstFace ] );
     }
+}
+
+// Sorts the set up triangles into the tiles their bounds overlap. Bins keep submission order,
+// so every tile draws its triangles in the same order as a single thread would.
+static void binTriangles( MeshDraw* draw, unsigned batchCount )
+{
+    const Framebuffer* fb = draw->fb;
+    const unsigned tileCount = fb->tileCountX * fb->tileCountY;
 
-    /*for (int i = 0; i < mesh->faceCount; ++i)
+    Arena* arena = draw->state->frameArena;
+    draw->tileBinStarts = arenaAlloc( arena, (tileCount + 1) * sizeof( unsigned ) );
+    draw->activeTiles = arenaAlloc( arena, tileCount * sizeof( unsigned ) );
+    memset( draw->tileBinStarts, 0, (tileCount + 1) * sizeof( unsigned ) );
+
+    unsigned* starts = draw->tileBinStarts;
+
+    for (unsigned batch = 0; batch < batchCount; ++batch)
     {
-        printf( "position %d hit rate: %d\n", i, positionCount[ i ] );
-    }*/
+        for (unsigned t = 0; t < draw->setupCounts[ batch ]; ++t)
+        {
+            const TriangleSetup* setup = &draw->setups[ batch * SETUP_BATCH_SIZE + t ];
+
+            for (int tileY = setup->miny / TILE_SIZE; tileY <= setup->maxy / TILE_SIZE; ++tileY)
+            {
+                for (int tileX = setup->minx / TILE_SIZE; tileX <= setup->maxx / TILE_SIZE; ++tileX)
+                {
+                    ++starts[ tileY * fb->tileCountX + tileX ];
+                }
+            }
+        }
+    }
+
+    // Turns counts into bin ends. Filling in reverse order then leaves starts[ t ] at bin t's beginning.
+    unsigned binCount = 0;
+    draw->activeTileCount = 0;
+
+    for (unsigned tile = 0; tile < tileCount; ++tile)
+    {
+        if (starts[ tile ] > 0)
+        {
+            draw->activeTiles[ draw->activeTileCount++ ] = tile;
+        }
+
+        binCount += starts[ tile ];
+        starts[ tile ] = binCount;
+    }
+
+    starts[ tileCount ] = binCount;
+    draw->tileBins = arenaAlloc( arena, binCount * sizeof( unsigned ) );
+
+    for (unsigned batch = batchCount; batch-- > 0;)
+    {
+        for (unsigned t = draw->setupCounts[ batch ]; t-- > 0;)
+        {
+            const unsigned index = batch * SETUP_BATCH_SIZE + t;
+            const TriangleSetup* setup = &draw->setups[ index ];
+
+            for (int tileY = setup->miny / TILE_SIZE; tileY <= setup->maxy / TILE_SIZE; ++tileY)
+            {
+                for (int tileX = setup->minx / TILE_SIZE; tileX <= setup->maxx / TILE_SIZE; ++tileX)
+                {
+                    draw->tileBins[ --starts[ tileY * fb->tileCountX + tileX ] ] = index;
+                }
+            }
+        }
+    }
+}
+
+// Rasterizes active tiles [begin, end). Each tile is only written by the job that owns it.
+static void rasterTilesJob( void* data, unsigned begin, unsigned end )
+{
+    const MeshDraw* draw = (const MeshDraw*)data;
+    Framebuffer* fb = draw->fb;
+    // Without a job system everything runs on the calling thread, which owns the frame arena.
+    Arena* scratch = draw->state->jobs ? jobsScratch( draw->state->jobs ) : draw->state->frameArena;
+    const ArenaMark mark = arenaMark( scratch );
+
+    for (unsigned i = begin; i < end; ++i)
+    {
+        const unsigned tile = draw->activeTiles[ i ];
+        const int tileMinx = (int)(tile % fb->tileCountX) * TILE_SIZE;
+        const int tileMiny = (int)(tile / fb->tileCountX) * TILE_SIZE;
+        const int tileMaxx = mini( tileMinx + TILE_SIZE, fb->width ) - 1;
+        const int tileMaxy = mini( tileMiny + TILE_SIZE, fb->height ) - 1;
+        const unsigned binStart = draw->tileBinStarts[ tile ];
+        const unsigned binEnd = draw->tileBinStarts[ tile + 1 ];
+
+        // The tile's setups are clipped into one array so that a run of small triangles is one call.
+        TriangleSetup* clipped = arenaAlloc( scratch, (binEnd - binStart) * sizeof( TriangleSetup ) );
+        RasterPath* paths = arenaAlloc( scratch, (binEnd - binStart) * sizeof( RasterPath ) );
+        unsigned clippedCount = 0;
+
+        for (unsigned b = binStart; b < binEnd; ++b)
+        {
+            const TriangleSetup* setup = &draw->setups[ draw->tileBins[ b ] ];
+
+            if (clipTriangleSetup( setup, tileMinx, tileMiny, tileMaxx, tileMaxy, &clipped[ clippedCount ] ))
+            {
+                paths[ clippedCount ] = classifyTriangle( setup );
+                ++clippedCount;
+            }
+        }
+
+        framebufferTouch( fb, tileMinx, tileMiny, tileMaxx, tileMaxy );
+
+        for (unsigned t = 0; t < clippedCount;)
+        {
+            // Consecutive small triangles go to the stamp rasterizer in one call, slivers to the span rasterizer.
+            unsigned smallCount = 0;
+
+            while (t + smallCount < clippedCount && paths[ t + smallCount ] == RasterPathSmall)
+            {
+                ++smallCount;
+            }
+
+            if (smallCount > 0)
+            {
+                draw->rasterSmallFunc( &clipped[ t ], smallCount, draw->state, fb );
+                t += smallCount;
+                continue;
+            }
+
+            if (paths[ t ] == RasterPathSliver)
+            {
+                draw->rasterSpansFunc( &clipped[ t ], draw->state, fb );
+            }
+            else
+            {
+                draw->rasterFunc( &clipped[ t ], draw->state, fb );
+            }
+
+            ++t;
+        }
+
+        arenaRelease( scratch, mark );
+    }
+}
+
+// Records setup in the debug views as a triangle that took cycles to rasterize. Coverage is tested like the rasterizers do,
+// with the fill convention thresholds and, if sampleCount is above 1, at the sample positions. A pixel counts once if any
+// of its samples is covered.
+void debugViewsAddTriangle( DebugViews* debug, const TriangleSetup* setup, int sampleCount, uint64_t cycles )
+{
+    const int maxx = mini( setup->maxx, debug->width - 1 );
+    const int maxy = mini( setup->maxy, debug->height - 1 );
+    float w0Sample[ MAX_SAMPLES ] = { 0 }, w1Sample[ MAX_SAMPLES ] = { 0 }, w2Sample[ MAX_SAMPLES ] = { 0 };
+
+    for (int s = 0; sampleCount > 1 && s < sampleCount; ++s)
+    {
+        const float dx = msaaSampleOffsets[ s ][ 0 ] / 16.0f;
+        const float dy = msaaSampleOffsets[ s ][ 1 ] / 16.0f;
+        w0Sample[ s ] = setup->a12 * dx + setup->b12 * dy;
+        w1Sample[ s ] = setup->a20 * dx + setup->b20 * dy;
+        w2Sample[ s ] = setup->a01 * dx + setup->b01 * dy;
+    }
+
+    float w0row = setup->w0row;
+    float w1row = setup->w1row;
+    float w2row = setup->w2row;
+    int coveredPixels = 0;
+
+    for (int y = setup->miny; y <= maxy; ++y)
+    {
+        float w0 = w0row;
+        float w1 = w1row;
+        float w2 = w2row;
+
+        for (int x = setup->minx; x <= maxx; ++x)
+        {
+            for (int s = 0; s < sampleCount; ++s)
+            {
+                if (w0 + w0Sample[ s ] >= setup->w0min && w1 + w1Sample[ s ] >= setup->w1min && w2 + w2Sample[ s ] >= setup->w2min)
+                {
+                    debugViewsAddPixel( debug, x, y );
+                    ++coveredPixels;
+                    break;
+                }
+            }
+
+            w0 += setup->a12;
+            w1 += setup->a20;
+            w2 += setup->a01;
+        }
+
+        w0row += setup->b12;
+        w1row += setup->b20;
+        w2row += setup->b01;
+    }
+
+    if (setup->minx <= maxx && setup->miny <= maxy)
+    {
+        debugViewsEndTriangle( debug, setup->minx, setup->miny, maxx, maxy, coveredPixels, cycles );
+    }
+}
+
+// The debug views time each triangle and record it over its whole bounds, so they draw on the calling thread without tiles.
+static void rasterTrianglesTimed( const MeshDraw* draw, unsigned batchCount )
+{
+    for (unsigned batch = 0; batch < batchCount; ++batch)
+    {
+        for (unsigned t = 0; t < draw->setupCounts[ batch ]; ++t)
+        {
+            const unsigned index = batch * SETUP_BATCH_SIZE + t;
+            const TriangleSetup* setup = &draw->setups[ index ];
+            framebufferTouch( draw->fb, setup->minx, setup->miny, setup->maxx, setup->maxy );
+
+            const uint64_t startCycles = readCycleCounter();
+
+            const RasterPath path = classifyTriangle( setup );
+
+            if (path == RasterPathSmall)
+            {
+                draw->rasterSmallFunc( setup, 1, draw->state, draw->fb );
+            }
+            else if (path == RasterPathSliver)
+            {
+                draw->rasterSpansFunc( setup, draw->state, draw->fb );
+            }
+            else
+            {
+                draw->rasterFunc( setup, draw->state, draw->fb );
+            }
+
+            debugViewsAddTriangle( draw->state->debugViews, setup, draw->fb->sampleCount, readCycleCounter() - startCycles );
+        }
+    }
+}
+
+// Returns true if every face of cluster faces away from eye, the projection center in the mesh's space.
+// For faces in front of the eye the rasterizer's screen space backface test is the same plane test, so culled faces would be culled there too.
+FORCE_INLINE bool clusterIsBackfacing( const MeshCluster* cluster, Vec3 eye )
+{
+    if (cluster->coneCos <= 0)
+    {
+        return false;
+    }
+
+    // Smallest dot( normal, point - eye ) of any normal in the cone and any point in the sphere.
+    const Vec3 toCenter = sub( cluster->center, eye );
+    const float along = dot( toCenter, cluster->coneAxis );
+    const float across = sqrtf( fmaxf( 0.0f, dot( toCenter, toCenter ) - along * along ) );
+
+    return along * cluster->coneCos - across * cluster->coneSin > cluster->radius;
+}
+
+// Culls clusters and marks the vertex blocks the rest use. Runs before any vertex work.
+static void cullClusters( MeshDraw* draw, unsigned batchCount )
+{
+    const Mesh* mesh = draw->mesh;
+    const unsigned blockCount = (mesh->vertexCount + TRANSFORM_BLOCK - 1) / TRANSFORM_BLOCK;
+    Vec3 eye;
+    const bool canCull = projectionCenter( draw->localToClip, &eye );
+
+    draw->visibleClusters = arenaAlloc( draw->state->frameArena, batchCount * sizeof( bool ) );
+    draw->transformBlocks = arenaAlloc( draw->state->frameArena, blockCount * sizeof( bool ) );
+    memset( draw->transformBlocks, 0, blockCount * sizeof( bool ) );
+
+    for (unsigned batch = 0; batch < batchCount; ++batch)
+    {
+        const MeshCluster* cluster = &mesh->clusters[ batch ];
+        draw->visibleClusters[ batch ] = !canCull || !clusterIsBackfacing( cluster, eye );
+
+        if (draw->visibleClusters[ batch ])
+        {
+            for (unsigned block = cluster->firstVertex / TRANSFORM_BLOCK; block * TRANSFORM_BLOCK < cluster->endVertex; ++block)
+            {
+                draw->transformBlocks[ block ] = true;
+            }
+        }
+        else
+        {
+            const unsigned faceCount = mini( SETUP_BATCH_SIZE, mesh->faceCount - batch * SETUP_BATCH_SIZE );
+            STAT_ADD( StatTrianglesSubmitted, faceCount );
+            STAT_ADD( StatTrianglesCulledCone, faceCount );
+        }
+    }
+}
+
+// Vertex transform, triangle setup and tile rasterization run as jobs on state->jobs. Cluster culling and binning run on the calling thread.
+void renderMesh( const Mesh* mesh, const Matrix44* localToWorld, const Matrix44* localToClip, const DrawState* state, Framebuffer* fb )
+{
+    const int flags = (state->blend ? RasterBlend : (state->depthWrite ? RasterDepthWrite : 0)) | (state->lighting ? RasterLit : 0) |
+                      (fb->sampleCount > 1 ? RasterMsaa : 0);
+    const unsigned batchCount = (mesh->faceCount + SETUP_BATCH_SIZE - 1) / SETUP_BATCH_SIZE;
+    MeshDraw drawStorage;
+    MeshDraw* draw = &drawStorage;
+
+    draw->mesh = mesh;
+    draw->localToWorld = localToWorld;
+    draw->localToClip = localToClip;
+    draw->state = state;
+    draw->fb = fb;
+    draw->rasterFunc = selectRasterTriangle( fb->depth.format, state->shadeMode, flags );
+    draw->rasterSmallFunc = selectRasterSmallTriangles( fb->depth.format, state->shadeMode, flags );
+    draw->rasterSpansFunc = selectRasterSpans( fb->depth.format, state->shadeMode, flags );
+    draw->texScale = setupTexScale( state, state->shadeMode );
+    draw->lit = state->lighting != NULL && state->shadeMode != ShadeDepthOnly;
+    draw->msaa = (flags & RasterMsaa) != 0;
+
+    assert( state->frameArena && "renderMesh needs a frame arena" );
+    draw->vertices = arenaAlloc( state->frameArena, mesh->vertexCount * sizeof( Vertex ) );
+    draw->setups = arenaAlloc( state->frameArena, batchCount * SETUP_BATCH_SIZE * sizeof( TriangleSetup ) );
+    draw->setupFaces = arenaAlloc( state->frameArena, batchCount * SETUP_BATCH_SIZE * sizeof( unsigned ) );
+    draw->setupCounts = arenaAlloc( state->frameArena, batchCount * sizeof( unsigned ) );
+
+    TRACE_BEGIN( "cluster culling" );
+    cullClusters( draw, batchCount );
+    TRACE_END( "cluster culling" );
+
+    jobsParallelFor( state->jobs, "vertex transform", (mesh->vertexCount + TRANSFORM_BLOCK - 1) / TRANSFORM_BLOCK, TRANSFORM_GRAIN, transformVerticesJob, draw );
+    jobsParallelFor( state->jobs, "triangle setup", batchCount, SETUP_GRAIN, setupTrianglesJob, draw );
+
+    unsigned setupCount = 0;
+
+    for (unsigned batch = 0; batch < batchCount; ++batch)
+    {
+        setupCount += draw->setupCounts[ batch ];
+    }
+
+    STAT_ADD( StatTrianglesRasterized, setupCount );
+
+    if (state->debugViews && state->debugViews->view != DebugViewNone)
+    {
+        TRACE_BEGIN( "rasterize" );
+        rasterTrianglesTimed( draw, batchCount );
+        TRACE_END( "rasterize" );
+        return;
+    }
+
+    TRACE_BEGIN( "binning" );
+    binTriangles( draw, batchCount );
+    TRACE_END( "binning" );
 
-    //printf( "One mesh's triangle rendering time: %f seconds, %llu cycles. Rendered triangle count: %d\n", accumTriangleTime, accumCycles, renderedTriangleCount );
+    jobsParallelFor( state->jobs, "rasterize", draw->activeTileCount, RASTER_GRAIN, rasterTilesJob, draw );
 }
@@ -0,0 +1,193 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+// Dynamic resolution. The controller picks the render size from recent frame times, the frame is rendered at that size
+// and upscaleBilinear() stretches it to the output. Rendering cost grows with the pixel count, so the scale per axis
+// goes with the square root of the frame time ratio.
+#define RESOLUTION_MIN_SCALE 0.5f // Per axis, of the output size.
+#define RESOLUTION_MAX_STEP 0.05f // Largest scale change per update, keeps the size from oscillating.
+#define RESOLUTION_SETTLE_FRAMES 8 // Frames to measure after a size change before the next one.
+#define UPSCALE_GRAIN 16 // Rows per upscaleBilinear() job.
+
+typedef struct
+{
+    float targetMs; // Frame time to hold.
+    float averageMs; // Exponential moving average of frame times, 0 before the first frame.
+    float scale; // Render size / output size, per axis.
+    int settleFrames; // Frames until the next change is allowed.
+    int outputWidth;
+    int outputHeight;
+    int width; // Render size.
+    int height;
+} ResolutionController;
+
+void resolutionInit( ResolutionController* controller, int outputWidth, int outputHeight, float targetMs )
+{
+    controller->targetMs = targetMs;
+    controller->averageMs = 0;
+    controller->scale = 1;
+    controller->settleFrames = RESOLUTION_SETTLE_FRAMES;
+    controller->outputWidth = outputWidth;
+    controller->outputHeight = outputHeight;
+    controller->width = outputWidth;
+    controller->height = outputHeight;
+}
+
+// Sets the render size to scale times the output size, rounded to a multiple of 4 pixels.
+void resolutionSetScale( ResolutionController* controller, float scale )
+{
+    controller->scale = fminf( fmaxf( scale, RESOLUTION_MIN_SCALE ), 1.0f );
+    controller->width = controller->scale == 1 ? controller->outputWidth : maxi( 4, (int)(controller->outputWidth * controller->scale + 2) & ~3 );
+    controller->height = controller->scale == 1 ? controller->outputHeight : maxi( 4, (int)(controller->outputHeight * controller->scale + 2) & ~3 );
+    controller->averageMs = 0;
+    controller->settleFrames = RESOLUTION_SETTLE_FRAMES;
+}
+
+// Feeds the time of the frame that was just rendered. Returns true if the render size changed.
+bool resolutionUpdate( ResolutionController* controller, float frameMs )
+{
+    controller->averageMs = controller->averageMs == 0 ? frameMs : controller->averageMs + 0.1f * (frameMs - controller->averageMs);
+
+    if (--controller->settleFrames > 0)
+    {
+        return false;
+    }
+
+    // Scales up only with some headroom, so that a frame time right at the target doesn't flip between sizes.
+    const float ratio = controller->targetMs / controller->averageMs;
+
+    if (ratio > 0.98f && ratio < 1.2f)
+    {
+        return false;
+    }
+
+    const float step = fminf( fmaxf( controller->scale * sqrtf( ratio ) - controller->scale, -RESOLUTION_MAX_STEP ), RESOLUTION_MAX_STEP );
+    const int oldWidth = controller->width;
+    const int oldHeight = controller->height;
+    resolutionSetScale( controller, controller->scale + step );
+
+    return controller->width != oldWidth || controller->height != oldHeight;
+}
+
+typedef struct
+{
+    const int* src;
+    int srcWidth;
+    int srcHeight;
+    int srcPitch; // In bytes.
+    int* dst;
+    int dstWidth;
+    int dstPitch;
+    float yScale; // Source rows per destination row.
+    const int* columns; // Left source pixel of each destination pixel.
+    const Uint16* columnWeights; // Weight of the right source pixel in 1/256, repeated for each channel.
+} UpscaleJob;
+
+// Returns the weight of pixel *outFirst + 1 in 1/256 for a sample at position, clamped to pixels [0, maxIndex].
+// Channels are 16-bit lanes in the SIMD path: a * (256 - w) + b * w is at most 255 * 256.
+FORCE_INLINE unsigned upscaleWeight( float position, int* outFirst, int maxIndex )
+{
+    position = fminf( fmaxf( position, 0.0f ), (float)maxIndex );
+    *outFirst = mini( (int)position, maxIndex - 1 );
+    return mini( (int)((position - (float)*outFirst) * 256.0f + 0.5f), 256 );
+}
+
+// Upscales destination rows [begin, end).
+static void upscaleRowsJob( void* data, unsigned begin, unsigned end )
+{
+    const UpscaleJob* job = (const UpscaleJob*)data;
+
+    for (unsigned y = begin; y < end; ++y)
+    {
+        int sy = 0;
+        const unsigned wy = upscaleWeight( ((float)y + 0.5f) * job->yScale - 0.5f, &sy, job->srcHeight - 1 );
+        const int* top = (const int*)((const Uint8*)job->src + sy * job->srcPitch);
+        const int* bottom = (const int*)((const Uint8*)job->src + (sy + 1) * job->srcPitch);
+        int* row = (int*)((Uint8*)job->dst + y * job->dstPitch);
+        int x = 0;
+
+#ifdef ARCH_X64
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i topWeight = _mm_set1_epi16( (short)(256 - wy) );
+        const __m128i bottomWeight = _mm_set1_epi16( (short)wy );
+
+        for (; x + 4 <= job->dstWidth; x += 4)
+        {
+            const int* c = &job->columns[ x ];
+            const __m128i topLeft = _mm_setr_epi32( top[ c[ 0 ] ], top[ c[ 1 ] ], top[ c[ 2 ] ], top[ c[ 3 ] ] );
+            const __m128i topRight = _mm_setr_epi32( top[ c[ 0 ] + 1 ], top[ c[ 1 ] + 1 ], top[ c[ 2 ] + 1 ], top[ c[ 3 ] + 1 ] );
+            const __m128i bottomLeft = _mm_setr_epi32( bottom[ c[ 0 ] ], bottom[ c[ 1 ] ], bottom[ c[ 2 ] ], bottom[ c[ 3 ] ] );
+            const __m128i bottomRight = _mm_setr_epi32( bottom[ c[ 0 ] + 1 ], bottom[ c[ 1 ] + 1 ], bottom[ c[ 2 ] + 1 ], bottom[ c[ 3 ] + 1 ] );
+
+            // Two pixels of 4 channels per register.
+            __m128i halves[ 2 ];
+
+            for (int h = 0; h < 2; ++h)
+            {
+                const __m128i rightWeight = _mm_loadu_si128( (const __m128i*)&job->columnWeights[ (x + h * 2) * 4 ] );
+                const __m128i leftWeight = _mm_sub_epi16( _mm_set1_epi16( 256 ), rightWeight );
+                const __m128i tl = h ? _mm_unpackhi_epi8( topLeft, zero ) : _mm_unpacklo_epi8( topLeft, zero );
+                const __m128i tr = h ? _mm_unpackhi_epi8( topRight, zero ) : _mm_unpacklo_epi8( topRight, zero );
+                const __m128i bl = h ? _mm_unpackhi_epi8( bottomLeft, zero ) : _mm_unpacklo_epi8( bottomLeft, zero );
+                const __m128i br = h ? _mm_unpackhi_epi8( bottomRight, zero ) : _mm_unpacklo_epi8( bottomRight, zero );
+
+                const __m128i t = _mm_srli_epi16( _mm_add_epi16( _mm_mullo_epi16( tl, leftWeight ), _mm_mullo_epi16( tr, rightWeight ) ), 8 );
+                const __m128i b = _mm_srli_epi16( _mm_add_epi16( _mm_mullo_epi16( bl, leftWeight ), _mm_mullo_epi16( br, rightWeight ) ), 8 );
+                halves[ h ] = _mm_srli_epi16( _mm_add_epi16( _mm_mullo_epi16( t, topWeight ), _mm_mullo_epi16( b, bottomWeight ) ), 8 );
+            }
+
+            _mm_storeu_si128( (__m128i*)&row[ x ], _mm_packus_epi16( halves[ 0 ], halves[ 1 ] ) );
+        }
+#endif
+        for (; x < job->dstWidth; ++x)
+        {
+            const int sx = job->columns[ x ];
+            const int sx1 = sx + 1;
+            const unsigned wx = job->columnWeights[ x * 4 ];
+            unsigned result = 0;
+
+            for (int shift = 0; shift < 32; shift += 8)
+            {
+                const unsigned t = ((((unsigned)top[ sx ] >> shift) & 0xFF) * (256 - wx) + (((unsigned)top[ sx1 ] >> shift) & 0xFF) * wx) >> 8;
+                const unsigned b = ((((unsigned)bottom[ sx ] >> shift) & 0xFF) * (256 - wx) + (((unsigned)bottom[ sx1 ] >> shift) & 0xFF) * wx) >> 8;
+                result |= ((t * (256 - wy) + b * wy) >> 8) << shift;
+            }
+
+            row[ x ] = (int)result;
+        }
+    }
+}
+
+// Stretches src over dst with bilinear filtering, in the stored 8-bit encoding like the MSAA resolve.
+// src must be at least 2 x 2 pixels. Pitches are in bytes. The column tables are allocated from arena, which the caller resets.
+void upscaleBilinear( const int* src, int srcWidth, int srcHeight, int srcPitch, int* dst, int dstWidth, int dstHeight, int dstPitch,
+                      JobSystem* jobs, Arena* arena )
+{
+    UpscaleJob job;
+    job.src = src;
+    job.srcWidth = srcWidth;
+    job.srcHeight = srcHeight;
+    job.srcPitch = srcPitch;
+    job.dst = dst;
+    job.dstWidth = dstWidth;
+    job.dstPitch = dstPitch;
+    job.yScale = (float)srcHeight / (float)dstHeight;
+
+    int* columns = arenaAlloc( arena, dstWidth * sizeof( int ) );
+    Uint16* columnWeights = arenaAlloc( arena, dstWidth * 4 * sizeof( Uint16 ) );
+    const float xScale = (float)srcWidth / (float)dstWidth;
+
+    for (int x = 0; x < dstWidth; ++x)
+    {
+        const unsigned wx = upscaleWeight( ((float)x + 0.5f) * xScale - 0.5f, &columns[ x ], srcWidth - 1 );
+
+        for (int c = 0; c < 4; ++c)
+        {
+            columnWeights[ x * 4 + c ] = (Uint16)wx;
+        }
+    }
+
+    job.columns = columns;
+    job.columnWeights = columnWeights;
+    jobsParallelFor( jobs, "upscale", dstHeight, UPSCALE_GRAIN, upscaleRowsJob, &job );
+}
@@ -0,0 +1,308 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+// Scene objects. Transforms are stored as structure of arrays, so sceneUpdateTransforms() builds the matrices of
+// SCENE_LANES objects at once. An object's local-to-world matrix and world bounds are cached and only rebuilt after
+// its transform changes. Local-to-clip matrices are the culling pass's job, they change whenever the camera moves.
+#define SCENE_LANES 4 // Objects per SIMD batch. Arrays are padded to a multiple of it.
+#define SCENE_UPDATE_GRAIN 64 // Batches per sceneUpdateTransforms() job.
+
+typedef struct
+{
+    // Transforms, applied as scale, then rotation like makeRotationXYZ() and then translation.
+    float* positionX;
+    float* positionY;
+    float* positionZ;
+    float* rotationX; // Degrees.
+    float* rotationY;
+    float* rotationZ;
+    float* scaleX;
+    float* scaleY;
+    float* scaleZ;
+
+    const Asset** meshes; // An object is skipped until its mesh asset is ready. Every submesh is drawn.
+    float* opacities; // Below 1 renders in the transparent pass.
+    bool* occluders; // Drawn into the occlusion buffer before the scene is tested against it. Must be opaque.
+    bool* dirty; // The cached matrix and bounds are stale. Dirty objects aren't drawn.
+
+    // Cached by sceneUpdateTransforms().
+    Matrix44* localToWorld;
+    Vec3* worldAabbMin;
+    Vec3* worldAabbMax;
+
+    unsigned objectCount;
+    unsigned capacity; // Multiple of SCENE_LANES.
+    void* memory; // All the arrays above.
+} Scene;
+
+void sceneInit( Scene* scene )
+{
+    memset( scene, 0, sizeof( Scene ) );
+}
+
+void sceneFree( Scene* scene )
+{
+    alignedFree( scene->memory );
+    memset( scene, 0, sizeof( Scene ) );
+}
+
+// Grows the arrays to hold at least capacity objects. Existing objects keep their indices.
+void sceneReserve( Scene* scene, unsigned capacity )
+{
+    capacity = (capacity + SCENE_LANES - 1) & ~(SCENE_LANES - 1);
+
+    if (capacity <= scene->capacity)
+    {
+        return;
+    }
+
+    // Matrices first, then 4-byte types, the bools last. Every array stays 16-byte aligned.
+    const size_t size = capacity * (sizeof( Matrix44 ) + 2 * sizeof( Vec3 ) + sizeof( const Asset* ) + 10 * sizeof( float ) + 2 * sizeof( bool ));
+    char* memory = alignedMalloc( size, 64 );
+    memset( memory, 0, size );
+
+    Scene grown = *scene;
+    grown.capacity = capacity;
+    grown.memory = memory;
+    grown.localToWorld = (Matrix44*)memory;   memory += capacity * sizeof( Matrix44 );
+    grown.meshes = (const Asset**)memory;     memory += capacity * sizeof( const Asset* );
+    grown.worldAabbMin = (Vec3*)memory;       memory += capacity * sizeof( Vec3 );
+    grown.worldAabbMax = (Vec3*)memory;       memory += capacity * sizeof( Vec3 );
+    float** floatArrays[ 10 ] = { &grown.positionX, &grown.positionY, &grown.positionZ, &grown.rotationX, &grown.rotationY, &grown.rotationZ,
+                                  &grown.scaleX, &grown.scaleY, &grown.scaleZ, &grown.opacities };
+
+    for (int i = 0; i < 10; ++i)
+    {
+        *floatArrays[ i ] = (float*)memory;
+        memory += capacity * sizeof( float );
+    }
+
+    grown.occluders = (bool*)memory;          memory += capacity * sizeof( bool );
+    grown.dirty = (bool*)memory;
+
+    const unsigned count = scene->objectCount;
+
+    if (count > 0)
+    {
+        memcpy( grown.localToWorld, scene->localToWorld, count * sizeof( Matrix44 ) );
+        memcpy( grown.meshes, scene->meshes, count * sizeof( const Asset* ) );
+        memcpy( grown.worldAabbMin, scene->worldAabbMin, count * sizeof( Vec3 ) );
+        memcpy( grown.worldAabbMax, scene->worldAabbMax, count * sizeof( Vec3 ) );
+        float* oldFloatArrays[ 10 ] = { scene->positionX, scene->positionY, scene->positionZ, scene->rotationX, scene->rotationY, scene->rotationZ,
+                                        scene->scaleX, scene->scaleY, scene->scaleZ, scene->opacities };
+
+        for (int i = 0; i < 10; ++i)
+        {
+            memcpy( *floatArrays[ i ], oldFloatArrays[ i ], count * sizeof( float ) );
+        }
+
+        memcpy( grown.occluders, scene->occluders, count * sizeof( bool ) );
+        memcpy( grown.dirty, scene->dirty, count * sizeof( bool ) );
+    }
+
+    alignedFree( scene->memory );
+    *scene = grown;
+}
+
+// Adds an opaque, unrotated and unscaled object and returns its index.
+unsigned sceneAddObject( Scene* scene, const Asset* mesh, Vec3 position )
+{
+    if (scene->objectCount == scene->capacity)
+    {
+        sceneReserve( scene, scene->capacity < 16 ? 16 : scene->capacity * 2 );
+    }
+
+    const unsigned i = scene->objectCount++;
+    scene->positionX[ i ] = position.x;
+    scene->positionY[ i ] = position.y;
+    scene->positionZ[ i ] = position.z;
+    scene->rotationX[ i ] = 0;
+    scene->rotationY[ i ] = 0;
+    scene->rotationZ[ i ] = 0;
+    scene->scaleX[ i ] = 1;
+    scene->scaleY[ i ] = 1;
+    scene->scaleZ[ i ] = 1;
+    scene->meshes[ i ] = mesh;
+    scene->opacities[ i ] = 1;
+    scene->occluders[ i ] = false;
+    scene->dirty[ i ] = true;
+
+    return i;
+}
+
+Vec3 scenePosition( const Scene* scene, unsigned object )
+{
+    return (Vec3){ scene->positionX[ object ], scene->positionY[ object ], scene->positionZ[ object ] };
+}
+
+void sceneSetPosition( Scene* scene, unsigned object, Vec3 position )
+{
+    scene->positionX[ object ] = position.x;
+    scene->positionY[ object ] = position.y;
+    scene->positionZ[ object ] = position.z;
+    scene->dirty[ object ] = true;
+}
+
+// degrees are rotations around x, y and z, see makeRotationXYZ().
+void sceneSetRotation( Scene* scene, unsigned object, Vec3 degrees )
+{
+    scene->rotationX[ object ] = degrees.x;
+    scene->rotationY[ object ] = degrees.y;
+    scene->rotationZ[ object ] = degrees.z;
+    scene->dirty[ object ] = true;
+}
+
+// Vertex lighting assumes uniform scale, see transformVertices().
+void sceneSetScale( Scene* scene, unsigned object, Vec3 scale )
+{
+    scene->scaleX[ object ] = scale.x;
+    scene->scaleY[ object ] = scale.y;
+    scene->scaleZ[ object ] = scale.z;
+    scene->dirty[ object ] = true;
+}
+
+// Builds the local-to-world matrices of objects [first, first + SCENE_LANES). The products are the same as
+// makeRotationXYZ() followed by the scale and translation, so results match multiplying the matrices.
+static void sceneBuildMatrices( Scene* scene, unsigned first )
+{
+    const float deg2rad = 3.1415926535f / 180.0f;
+#if _MSC_VER
+    float sines[ 3 ][ SCENE_LANES ];
+    float cosines[ 3 ][ SCENE_LANES ];
+#else
+    alignas( 16 ) float sines[ 3 ][ SCENE_LANES ];
+    alignas( 16 ) float cosines[ 3 ][ SCENE_LANES ];
+#endif
+    const float* rotations[ 3 ] = { &scene->rotationX[ first ], &scene->rotationY[ first ], &scene->rotationZ[ first ] };
+
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        for (int lane = 0; lane < SCENE_LANES; ++lane)
+        {
+            sines[ axis ][ lane ] = sinf( rotations[ axis ][ lane ] * deg2rad );
+            cosines[ axis ][ lane ] = cosf( rotations[ axis ][ lane ] * deg2rad );
+        }
+    }
+
+    Matrix44* out = &scene->localToWorld[ first ];
+
+#ifdef ARCH_X64
+    const __m128 sx = _mm_load_ps( sines[ 0 ] ), sy = _mm_load_ps( sines[ 1 ] ), sz = _mm_load_ps( sines[ 2 ] );
+    const __m128 cx = _mm_load_ps( cosines[ 0 ] ), cy = _mm_load_ps( cosines[ 1 ] ), cz = _mm_load_ps( cosines[ 2 ] );
+    const __m128 scaleX = _mm_load_ps( &scene->scaleX[ first ] );
+    const __m128 scaleY = _mm_load_ps( &scene->scaleY[ first ] );
+    const __m128 scaleZ = _mm_load_ps( &scene->scaleZ[ first ] );
+    const __m128 zero = _mm_setzero_ps();
+
+    // rows[ r ][ c ] holds element (r, c) of all lanes' matrices. Each row of the rotation is scaled by its axis.
+    __m128 rows[ 4 ][ 4 ];
+    rows[ 0 ][ 0 ] = _mm_mul_ps( _mm_mul_ps( cy, cz ), scaleX );
+    rows[ 0 ][ 1 ] = _mm_mul_ps( _mm_sub_ps( _mm_mul_ps( _mm_mul_ps( cz, sx ), sy ), _mm_mul_ps( cx, sz ) ), scaleX );
+    rows[ 0 ][ 2 ] = _mm_mul_ps( _mm_add_ps( _mm_mul_ps( _mm_mul_ps( cx, cz ), sy ), _mm_mul_ps( sx, sz ) ), scaleX );
+    rows[ 0 ][ 3 ] = zero;
+    rows[ 1 ][ 0 ] = _mm_mul_ps( _mm_mul_ps( cy, sz ), scaleY );
+    rows[ 1 ][ 1 ] = _mm_mul_ps( _mm_add_ps( _mm_mul_ps( cx, cz ), _mm_mul_ps( _mm_mul_ps( sx, sy ), sz ) ), scaleY );
+    rows[ 1 ][ 2 ] = _mm_mul_ps( _mm_add_ps( _mm_mul_ps( _mm_sub_ps( zero, cz ), sx ), _mm_mul_ps( _mm_mul_ps( cx, sy ), sz ) ), scaleY );
+    rows[ 1 ][ 3 ] = zero;
+    rows[ 2 ][ 0 ] = _mm_mul_ps( _mm_sub_ps( zero, sy ), scaleZ );
+    rows[ 2 ][ 1 ] = _mm_mul_ps( _mm_mul_ps( cy, sx ), scaleZ );
+    rows[ 2 ][ 2 ] = _mm_mul_ps( _mm_mul_ps( cx, cy ), scaleZ );
+    rows[ 2 ][ 3 ] = zero;
+    rows[ 3 ][ 0 ] = _mm_load_ps( &scene->positionX[ first ] );
+    rows[ 3 ][ 1 ] = _mm_load_ps( &scene->positionY[ first ] );
+    rows[ 3 ][ 2 ] = _mm_load_ps( &scene->positionZ[ first ] );
+    rows[ 3 ][ 3 ] = _mm_set1_ps( 1 );
+
+    // Transposing a row of all lanes gives that row of each lane's matrix.
+    for (int r = 0; r < 4; ++r)
+    {
+        _MM_TRANSPOSE4_PS( rows[ r ][ 0 ], rows[ r ][ 1 ], rows[ r ][ 2 ], rows[ r ][ 3 ] );
+
+        for (int lane = 0; lane < SCENE_LANES; ++lane)
+        {
+            _mm_storeu_ps( &out[ lane ].m[ r * 4 ], rows[ r ][ lane ] );
+        }
+    }
+#else
+    for (int lane = 0; lane < SCENE_LANES; ++lane)
+    {
+        const float sx = sines[ 0 ][ lane ], sy = sines[ 1 ][ lane ], sz = sines[ 2 ][ lane ];
+        const float cx = cosines[ 0 ][ lane ], cy = cosines[ 1 ][ lane ], cz = cosines[ 2 ][ lane ];
+        const float scaleX = scene->scaleX[ first + lane ];
+        const float scaleY = scene->scaleY[ first + lane ];
+        const float scaleZ = scene->scaleZ[ first + lane ];
+        float* m = out[ lane ].m;
+
+        m[ 0 ] = cy * cz * scaleX;
+        m[ 1 ] = (cz * sx * sy - cx * sz) * scaleX;
+        m[ 2 ] = (cx * cz * sy + sx * sz) * scaleX;
+        m[ 3 ] = 0;
+        m[ 4 ] = cy * sz * scaleY;
+        m[ 5 ] = (cx * cz + sx * sy * sz) * scaleY;
+        m[ 6 ] = (-cz * sx + cx * sy * sz) * scaleY;
+        m[ 7 ] = 0;
+        m[ 8 ] = -sy * scaleZ;
+        m[ 9 ] = cy * sx * scaleZ;
+        m[ 10 ] = cx * cy * scaleZ;
+        m[ 11 ] = 0;
+        m[ 12 ] = scene->positionX[ first + lane ];
+        m[ 13 ] = scene->positionY[ first + lane ];
+        m[ 14 ] = scene->positionZ[ first + lane ];
+        m[ 15 ] = 1;
+    }
+#endif
+}
+
+// Rebuilds dirty objects' matrices and bounds in batches [begin, end) of SCENE_LANES objects.
+static void sceneUpdateJob( void* data, unsigned begin, unsigned end )
+{
+    Scene* scene = (Scene*)data;
+
+    for (unsigned batch = begin; batch < end; ++batch)
+    {
+        const unsigned first = batch * SCENE_LANES;
+        bool anyDirty = false;
+
+        for (unsigned i = first; i < first + SCENE_LANES; ++i)
+        {
+            anyDirty |= scene->dirty[ i ];
+        }
+
+        if (!anyDirty)
+        {
+            continue;
+        }
+
+        // Clean lanes get the matrix they already had.
+        sceneBuildMatrices( scene, first );
+
+        for (unsigned i = first; i < first + SCENE_LANES && i < scene->objectCount; ++i)
+        {
+            const Asset* mesh = scene->meshes[ i ];
+
+            // Bounds need the mesh, objects stay dirty until it has loaded.
+            if (!scene->dirty[ i ] || assetState( mesh ) != AssetReady)
+            {
+                continue;
+            }
+
+            Vec3 corners[ 8 ];
+            getCorners( mesh->aabbMin, mesh->aabbMax, corners );
+
+            for (int c = 0; c < 8; ++c)
+            {
+                transformPoint( corners[ c ], &scene->localToWorld[ i ], &corners[ c ] );
+            }
+
+            getMinMax( corners, 8, &scene->worldAabbMin[ i ], &scene->worldAabbMax[ i ] );
+            scene->dirty[ i ] = false;
+        }
+    }
+}
+
+// Brings the cached matrices and bounds of objects changed since the last call up to date.
+void sceneUpdateTransforms( Scene* scene, JobSystem* jobs )
+{
+    const unsigned batchCount = (scene->objectCount + SCENE_LANES - 1) / SCENE_LANES;
+    jobsParallelFor( jobs, "scene transforms", batchCount, SCENE_UPDATE_GRAIN, sceneUpdateJob, scene );
+}
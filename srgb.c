@@ -0,0 +1,198 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+// Table-based sRGB conversions that are cheap enough for pixel loops.
+// toSRGB() and sRGBToLinear() in mymath.c are the reference and are only used to build the tables.
+//
+// linear -> sRGB8 splits [2^-13, 1) into 13 octaves of 8 buckets each, indexed by the float's
+// exponent and top 3 mantissa bits. Each bucket is a line evaluated with the next 8 mantissa bits.
+// Same idea as https://gist.github.com/rygorous/2203834
+#define SRGB_BUCKET_COUNT 104
+#define SRGB_MIN_BITS 0x39000000u // 2^-13, everything below encodes to 0.
+#define SRGB_ALMOST_ONE_BITS 0x3f7fffffu
+
+// Linear value of each 8-bit sRGB value.
+static float srgbToLinearTable[ 256 ];
+
+// Bucket lines: bias (sRGB * 255 * 2^7, rounding included) in the high 16 bits, slope per mantissa step * 2^16 in the low 16 bits.
+static uint32_t linearToSRGBTable[ SRGB_BUCKET_COUNT ];
+
+FORCE_INLINE float floatFromBits( uint32_t bits )
+{
+    float f;
+    memcpy( &f, &bits, sizeof( f ) );
+    return f;
+}
+
+FORCE_INLINE uint32_t bitsFromFloat( float f )
+{
+    uint32_t bits;
+    memcpy( &bits, &f, sizeof( bits ) );
+    return bits;
+}
+
+// Must be called once before using the conversions.
+void initSRGBTables( void )
+{
+    for (int i = 0; i < 256; ++i)
+    {
+        srgbToLinearTable[ i ] = sRGBToLinear( i / 255.0f );
+    }
+
+    for (int i = 0; i < SRGB_BUCKET_COUNT; ++i)
+    {
+        const float start = floatFromBits( SRGB_MIN_BITS + ((uint32_t)i << 20) );
+        const float end = floatFromBits( SRGB_MIN_BITS + ((uint32_t)(i + 1) << 20) );
+        const float startSRGB = toSRGB( start ) * 255.0f;
+        const float endSRGB = toSRGB( end ) * 255.0f;
+
+        const uint32_t bias = (uint32_t)(startSRGB * 128.0f + 64.0f);
+        const uint32_t scale = (uint32_t)((endSRGB - startSRGB) * 256.0f + 0.5f);
+        assert( bias < 65536 && scale < 32768 && "sRGB table entry doesn't fit into 16 bits" );
+
+        linearToSRGBTable[ i ] = (bias << 16) | scale;
+    }
+}
+
+FORCE_INLINE unsigned linearToSRGB8( float f )
+{
+    // Written so that NaN becomes 0.
+    if (!(f > floatFromBits( SRGB_MIN_BITS )))
+    {
+        f = floatFromBits( SRGB_MIN_BITS );
+    }
+
+    if (f > floatFromBits( SRGB_ALMOST_ONE_BITS ))
+    {
+        f = floatFromBits( SRGB_ALMOST_ONE_BITS );
+    }
+
+    const uint32_t bits = bitsFromFloat( f );
+    const uint32_t entry = linearToSRGBTable[ (bits - SRGB_MIN_BITS) >> 20 ];
+    const uint32_t bias = (entry >> 16) << 9;
+    const uint32_t scale = entry & 0xFFFF;
+    const uint32_t t = (bits >> 12) & 0xFF;
+
+    return (bias + scale * t) >> 16;
+}
+
+#ifdef ARCH_X64
+// linearToSRGB8() for 4 values. Returns 0-255 in each 32-bit lane.
+FORCE_INLINE __m128i linearToSRGB8x4( __m128 f )
+{
+    const __m128 minValue = _mm_castsi128_ps( _mm_set1_epi32( SRGB_MIN_BITS ) );
+    const __m128 almostOne = _mm_castsi128_ps( _mm_set1_epi32( SRGB_ALMOST_ONE_BITS ) );
+
+    // _mm_max_ps returns the second operand for NaN.
+    f = _mm_min_ps( _mm_max_ps( f, minValue ), almostOne );
+
+    const __m128i bits = _mm_castps_si128( f );
+    const __m128i index = _mm_srli_epi32( _mm_sub_epi32( bits, _mm_set1_epi32( SRGB_MIN_BITS ) ), 20 );
+
+    // SSE2 has no gather.
+    uint32_t indices[ 4 ];
+    _mm_storeu_si128( (__m128i*)indices, index );
+    const __m128i entry = _mm_setr_epi32( (int)linearToSRGBTable[ indices[ 0 ] ], (int)linearToSRGBTable[ indices[ 1 ] ],
+                                          (int)linearToSRGBTable[ indices[ 2 ] ], (int)linearToSRGBTable[ indices[ 3 ] ] );
+
+    const __m128i bias = _mm_slli_epi32( _mm_srli_epi32( entry, 16 ), 9 );
+    const __m128i scale = _mm_and_si128( entry, _mm_set1_epi32( 0xFFFF ) );
+    const __m128i t = _mm_and_si128( _mm_srli_epi32( bits, 12 ), _mm_set1_epi32( 0xFF ) );
+
+    // t and scale fit into signed 16 bits and the high halves are zero, so madd is a 32-bit multiply.
+    return _mm_srli_epi32( _mm_add_epi32( bias, _mm_madd_epi16( scale, t ) ), 16 );
+}
+
+// Encodes 4 linear RGBA pixels into 4 ARGB8888 pixels. Alpha stays linear.
+FORCE_INLINE __m128i packLinearToARGB8x4( __m128 p0, __m128 p1, __m128 p2, __m128 p3 )
+{
+    const __m128i alphaMask = _mm_setr_epi32( 0, 0, 0, -1 );
+    const __m128 alphaScale = _mm_set1_ps( 255.0f );
+
+    // RGBA -> BGRA, which is the memory order of ARGB8888 on little-endian.
+    p0 = _mm_shuffle_ps( p0, p0, _MM_SHUFFLE( 3, 0, 1, 2 ) );
+    p1 = _mm_shuffle_ps( p1, p1, _MM_SHUFFLE( 3, 0, 1, 2 ) );
+    p2 = _mm_shuffle_ps( p2, p2, _MM_SHUFFLE( 3, 0, 1, 2 ) );
+    p3 = _mm_shuffle_ps( p3, p3, _MM_SHUFFLE( 3, 0, 1, 2 ) );
+
+    __m128i c0 = linearToSRGB8x4( p0 );
+    __m128i c1 = linearToSRGB8x4( p1 );
+    __m128i c2 = linearToSRGB8x4( p2 );
+    __m128i c3 = linearToSRGB8x4( p3 );
+
+    c0 = _mm_or_si128( _mm_andnot_si128( alphaMask, c0 ), _mm_and_si128( alphaMask, _mm_cvtps_epi32( _mm_mul_ps( p0, alphaScale ) ) ) );
+    c1 = _mm_or_si128( _mm_andnot_si128( alphaMask, c1 ), _mm_and_si128( alphaMask, _mm_cvtps_epi32( _mm_mul_ps( p1, alphaScale ) ) ) );
+    c2 = _mm_or_si128( _mm_andnot_si128( alphaMask, c2 ), _mm_and_si128( alphaMask, _mm_cvtps_epi32( _mm_mul_ps( p2, alphaScale ) ) ) );
+    c3 = _mm_or_si128( _mm_andnot_si128( alphaMask, c3 ), _mm_and_si128( alphaMask, _mm_cvtps_epi32( _mm_mul_ps( p3, alphaScale ) ) ) );
+
+    return _mm_packus_epi16( _mm_packs_epi32( c0, c1 ), _mm_packs_epi32( c2, c3 ) );
+}
+#endif
+
+FORCE_INLINE int packLinearToARGB8( float r, float g, float b, float a )
+{
+    a = a < 0 ? 0 : (a > 1 ? 1 : a);
+
+    return (int)(((unsigned)(a * 255.0f + 0.5f) << 24) | (linearToSRGB8( r ) << 16) | (linearToSRGB8( g ) << 8) | linearToSRGB8( b ));
+}
+
+// Converts a linear RGBA float buffer into ARGB8888 sRGB. Pitches are in bytes.
+void resolveLinearFloatToSRGB( const float* src, int srcPitch, int* dst, int dstPitch, int width, int height )
+{
+    for (int y = 0; y < height; ++y)
+    {
+        const float* srcRow = (const float*)((const Uint8*)src + y * srcPitch);
+        int* dstRow = (int*)((Uint8*)dst + y * dstPitch);
+        int x = 0;
+
+#ifdef ARCH_X64
+        for (; x + 4 <= width; x += 4)
+        {
+            const float* p = &srcRow[ x * 4 ];
+            const __m128i packed = packLinearToARGB8x4( _mm_loadu_ps( p ), _mm_loadu_ps( p + 4 ), _mm_loadu_ps( p + 8 ), _mm_loadu_ps( p + 12 ) );
+            _mm_storeu_si128( (__m128i*)&dstRow[ x ], packed );
+        }
+#endif
+        for (; x < width; ++x)
+        {
+            const float* p = &srcRow[ x * 4 ];
+            dstRow[ x ] = packLinearToARGB8( p[ 0 ], p[ 1 ], p[ 2 ], p[ 3 ] );
+        }
+    }
+}
+
+// Converts a linear RGBA 16-bit unorm buffer into ARGB8888 sRGB. Pitches are in bytes.
+void resolveLinear16ToSRGB( const Uint16* src, int srcPitch, int* dst, int dstPitch, int width, int height )
+{
+    const float toFloat = 1.0f / 65535.0f;
+
+    for (int y = 0; y < height; ++y)
+    {
+        const Uint16* srcRow = (const Uint16*)((const Uint8*)src + y * srcPitch);
+        int* dstRow = (int*)((Uint8*)dst + y * dstPitch);
+        int x = 0;
+
+#ifdef ARCH_X64
+        const __m128i zero = _mm_setzero_si128();
+        const __m128 scale = _mm_set1_ps( toFloat );
+
+        for (; x + 4 <= width; x += 4)
+        {
+            const __m128i p01 = _mm_loadu_si128( (const __m128i*)&srcRow[ x * 4 ] );
+            const __m128i p23 = _mm_loadu_si128( (const __m128i*)&srcRow[ x * 4 + 8 ] );
+
+            const __m128 p0 = _mm_mul_ps( _mm_cvtepi32_ps( _mm_unpacklo_epi16( p01, zero ) ), scale );
+            const __m128 p1 = _mm_mul_ps( _mm_cvtepi32_ps( _mm_unpackhi_epi16( p01, zero ) ), scale );
+            const __m128 p2 = _mm_mul_ps( _mm_cvtepi32_ps( _mm_unpacklo_epi16( p23, zero ) ), scale );
+            const __m128 p3 = _mm_mul_ps( _mm_cvtepi32_ps( _mm_unpackhi_epi16( p23, zero ) ), scale );
+
+            _mm_storeu_si128( (__m128i*)&dstRow[ x ], packLinearToARGB8x4( p0, p1, p2, p3 ) );
+        }
+#endif
+        for (; x < width; ++x)
+        {
+            const Uint16* p = &srcRow[ x * 4 ];
+            dstRow[ x ] = packLinearToARGB8( p[ 0 ] * toFloat, p[ 1 ] * toFloat, p[ 2 ] * toFloat, p[ 3 ] * toFloat );
+        }
+    }
+}
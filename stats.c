@@ -0,0 +1,148 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+// Hot-path counters. STAT_ADD() compiles to nothing unless RENDER_STATS is 1 (make STATS=1).
+// Each thread increments its own counter block without atomics. statsEndFrame() sums the blocks
+// into the frame's totals and must be called while no other thread is rendering.
+#ifndef RENDER_STATS
+#define RENDER_STATS 0
+#endif
+
+#define MAX_STATS_THREADS 64
+
+typedef enum
+{
+    StatTrianglesSubmitted = 0,
+    StatTrianglesCulledBackface,
+    StatTrianglesCulledFrustum, // Mesh bounds outside the frustum, vertices outside the guard band or bounds outside the screen.
+    StatTrianglesCulledZeroArea,
+    StatTrianglesCulledOcclusion, // Mesh bounds hidden behind the occluders, see occlusion.c.
+    StatTrianglesCulledCone, // Whole clusters facing away from the camera, see MeshCluster.
+    StatTrianglesRasterized,
+    StatPixelsTested, // Depth tests. Counts samples with multisampling.
+    StatPixelsPassed,
+    StatTexelsFetched,
+    StatCount
+} StatCounter;
+
+static const char* statNames[ StatCount ] =
+{
+    "trianglesSubmitted",
+    "trianglesCulledBackface",
+    "trianglesCulledFrustum",
+    "trianglesCulledZeroArea",
+    "trianglesCulledOcclusion",
+    "trianglesCulledCone",
+    "trianglesRasterized",
+    "pixelsTested",
+    "pixelsPassed",
+    "texelsFetched"
+};
+
+typedef struct
+{
+    uint64_t counters[ StatCount ];
+} RenderStats;
+
+// Returns the number of set bits in a 4-bit mask, eg. from _mm_movemask_ps().
+FORCE_INLINE int statsPopCount4( int mask )
+{
+    return (int)((0x4332322132212110ull >> ((mask & 0xF) * 4)) & 0xF);
+}
+
+#if RENDER_STATS
+#if _MSC_VER
+#define THREAD_LOCAL __declspec( thread )
+#else
+#define THREAD_LOCAL _Thread_local
+#endif
+
+// Padded so that threads never write to the same cache line.
+typedef union
+{
+    RenderStats stats;
+    char padding[ (sizeof( RenderStats ) + 127) & ~127 ];
+} StatsSlot;
+
+static StatsSlot statsSlots[ MAX_STATS_THREADS ];
+static SDL_atomic_t statsSlotCount;
+static THREAD_LOCAL RenderStats* statsThreadStats;
+
+FORCE_INLINE RenderStats* statsThread( void )
+{
+    if (!statsThreadStats)
+    {
+        const int slot = SDL_AtomicAdd( &statsSlotCount, 1 );
+        assert( slot < MAX_STATS_THREADS && "increase MAX_STATS_THREADS" );
+        statsThreadStats = &statsSlots[ slot ].stats;
+    }
+
+    return statsThreadStats;
+}
+
+#define STAT_ADD( counter, value ) (statsThread()->counters[ counter ] += (uint64_t)(value))
+#else
+#define STAT_ADD( counter, value ) ((void)sizeof( value )) // Keeps variables that only feed stats used, without evaluating them.
+#endif
+
+static RenderStats statsFrame;
+
+// Publishes this frame's counters to statsGetFrame() and starts counting the next frame.
+void statsEndFrame( void )
+{
+#if RENDER_STATS
+    memset( &statsFrame, 0, sizeof( statsFrame ) );
+    const int slotCount = mini( SDL_AtomicGet( &statsSlotCount ), MAX_STATS_THREADS );
+
+    for (int slot = 0; slot < slotCount; ++slot)
+    {
+        for (int i = 0; i < StatCount; ++i)
+        {
+            statsFrame.counters[ i ] += statsSlots[ slot ].stats.counters[ i ];
+        }
+
+        memset( &statsSlots[ slot ].stats, 0, sizeof( RenderStats ) );
+    }
+#endif
+}
+
+// Counters of the last frame passed to statsEndFrame(). All zero when RENDER_STATS is 0.
+const RenderStats* statsGetFrame( void )
+{
+    return &statsFrame;
+}
+
+static double statsRatio( uint64_t numerator, uint64_t denominator )
+{
+    return denominator != 0 ? (double)numerator / (double)denominator : 0.0;
+}
+
+void statsDumpText( const RenderStats* stats, FILE* file )
+{
+    if (!RENDER_STATS)
+    {
+        fprintf( file, "Stats are compiled out, build with RENDER_STATS=1.\n" );
+        return;
+    }
+
+    for (int i = 0; i < StatCount; ++i)
+    {
+        fprintf( file, "%-24s %llu\n", statNames[ i ], (unsigned long long)stats->counters[ i ] );
+    }
+
+    fprintf( file, "%-24s %.3f\n", "rasterizedRatio", statsRatio( stats->counters[ StatTrianglesRasterized ], stats->counters[ StatTrianglesSubmitted ] ) );
+    fprintf( file, "%-24s %.3f\n", "depthPassRatio", statsRatio( stats->counters[ StatPixelsPassed ], stats->counters[ StatPixelsTested ] ) );
+}
+
+void statsDumpJson( const RenderStats* stats, FILE* file )
+{
+    fprintf( file, "{\"enabled\": %s", RENDER_STATS ? "true" : "false" );
+
+    for (int i = 0; i < StatCount; ++i)
+    {
+        fprintf( file, ", \"%s\": %llu", statNames[ i ], (unsigned long long)stats->counters[ i ] );
+    }
+
+    fprintf( file, ", \"rasterizedRatio\": %.3f", statsRatio( stats->counters[ StatTrianglesRasterized ], stats->counters[ StatTrianglesSubmitted ] ) );
+    fprintf( file, ", \"depthPassRatio\": %.3f}\n", statsRatio( stats->counters[ StatPixelsPassed ], stats->counters[ StatPixelsTested ] ) );
+}
@@ -0,0 +1,146 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+// Timeline of frame stages in Chrome's trace event format (chrome://tracing, ui.perfetto.dev).
+// TRACE_BEGIN() and TRACE_END() compile to nothing unless RENDER_TRACE is 1 (make TRACE=1).
+// Each thread writes into its own ring buffer without locks. When a ring is full, its oldest events
+// are overwritten. traceWriteJson() can run on any thread while others keep recording: it copies
+// a ring and then drops the events that were overwritten during the copy.
+#ifndef RENDER_TRACE
+#define RENDER_TRACE 0
+#endif
+
+#define TRACE_RING_SIZE 16384 // Events per thread, power of two.
+#define MAX_TRACE_THREADS 64
+
+typedef struct
+{
+    const char* name; // Must be a string literal or otherwise outlive the trace.
+    uint64_t time;    // SDL_GetPerformanceCounter().
+    char phase;       // 'B' or 'E'.
+} TraceEvent;
+
+typedef struct
+{
+    TraceEvent events[ TRACE_RING_SIZE ];
+    SDL_atomic_t head; // Number of events written, as unsigned. Only the owning thread increments it.
+    const char* threadName;
+} TraceRing;
+
+#if RENDER_TRACE
+#if _MSC_VER
+#define TRACE_THREAD_LOCAL __declspec( thread )
+#else
+#define TRACE_THREAD_LOCAL _Thread_local
+#endif
+
+static TraceRing* traceRings[ MAX_TRACE_THREADS ];
+static SDL_atomic_t traceRingCount;
+static TRACE_THREAD_LOCAL TraceRing* traceThreadRing;
+
+static TraceRing* traceThread( void )
+{
+    if (!traceThreadRing)
+    {
+        TraceRing* ring = calloc( 1, sizeof( TraceRing ) );
+        ring->threadName = "thread";
+
+        const int slot = SDL_AtomicAdd( &traceRingCount, 1 );
+        assert( slot < MAX_TRACE_THREADS && "increase MAX_TRACE_THREADS" );
+        SDL_AtomicSetPtr( (void**)&traceRings[ slot ], ring );
+        traceThreadRing = ring;
+    }
+
+    return traceThreadRing;
+}
+
+FORCE_INLINE void traceEvent( const char* name, char phase )
+{
+    TraceRing* ring = traceThread();
+    const unsigned head = (unsigned)SDL_AtomicGet( &ring->head );
+    TraceEvent* event = &ring->events[ head & (TRACE_RING_SIZE - 1) ];
+    event->name = name;
+    event->time = SDL_GetPerformanceCounter();
+    event->phase = phase;
+    // Publishes the event to traceWriteJson().
+    SDL_AtomicSet( &ring->head, (int)(head + 1) );
+}
+
+#define TRACE_BEGIN( name ) traceEvent( name, 'B' )
+#define TRACE_END( name ) traceEvent( name, 'E' )
+#else
+#define TRACE_BEGIN( name ) ((void)0)
+#define TRACE_END( name ) ((void)0)
+#endif
+
+// Names the calling thread in the timeline. name must outlive the trace.
+void traceSetThreadName( const char* name )
+{
+#if RENDER_TRACE
+    traceThread()->threadName = name;
+#else
+    (void)name;
+#endif
+}
+
+// Writes all threads' recorded events. Returns false if the file couldn't be written or tracing is compiled out.
+bool traceWriteJson( const char* path )
+{
+#if RENDER_TRACE
+    FILE* file = fopen( path, "w" );
+
+    if (!file)
+    {
+        printf( "Could not open %s for writing.\n", path );
+        return false;
+    }
+
+    static TraceEvent copy[ TRACE_RING_SIZE ];
+    const double toMicroseconds = 1000000.0 / (double)SDL_GetPerformanceFrequency();
+    const int ringCount = mini( SDL_AtomicGet( &traceRingCount ), MAX_TRACE_THREADS );
+    bool first = true;
+
+    fprintf( file, "{\"traceEvents\": [\n" );
+
+    for (int r = 0; r < ringCount; ++r)
+    {
+        TraceRing* ring = SDL_AtomicGetPtr( (void**)&traceRings[ r ] );
+
+        if (!ring)
+        {
+            continue;
+        }
+
+        const unsigned head = (unsigned)SDL_AtomicGet( &ring->head );
+        const unsigned begin = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+
+        for (unsigned i = begin; i < head; ++i)
+        {
+            copy[ i & (TRACE_RING_SIZE - 1) ] = ring->events[ i & (TRACE_RING_SIZE - 1) ];
+        }
+
+        // Events the owner wrote over during the copy are unreliable. That includes the slot of event headAfterCopy,
+        // which the owner may be writing before it publishes the new head.
+        const unsigned headAfterCopy = (unsigned)SDL_AtomicGet( &ring->head );
+        const unsigned validBegin = headAfterCopy - begin >= TRACE_RING_SIZE ? headAfterCopy + 1 - TRACE_RING_SIZE : begin;
+
+        fprintf( file, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"%s\"}}", first ? "" : ",\n", r, ring->threadName );
+        first = false;
+
+        for (unsigned i = validBegin; i < head; ++i)
+        {
+            const TraceEvent* event = &copy[ i & (TRACE_RING_SIZE - 1) ];
+            fprintf( file, ",\n{\"name\": \"%s\", \"ph\": \"%c\", \"ts\": %.3f, \"pid\": 1, \"tid\": %d}", event->name, event->phase, (double)event->time * toMicroseconds, r );
+        }
+    }
+
+    fprintf( file, "\n]}\n" );
+    fclose( file );
+
+    return true;
+#else
+    (void)path;
+    printf( "Tracing is compiled out, build with RENDER_TRACE=1.\n" );
+    return false;
+#endif
+}
@@ -0,0 +1,62 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+// Second pass for alpha-blended draws. Opaque draws are rendered immediately, blended ones are
+// queued during the frame and rendered back-to-front after all opaque geometry, testing but not
+// writing depth. Sorting is per draw, not per triangle, so intersecting transparent meshes can be wrong.
+#define MAX_TRANSPARENT_DRAWS 256
+
+typedef struct
+{
+    const Mesh* mesh;
+    Matrix44 localToWorld;
+    Matrix44 localToClip;
+    DrawState state;
+    float viewDepth; // Distance along the camera's forward axis. Larger is farther.
+} TransparentDraw;
+
+typedef struct
+{
+    TransparentDraw draws[ MAX_TRANSPARENT_DRAWS ];
+    int drawCount;
+} TransparentQueue;
+
+void transparentQueueAdd( TransparentQueue* queue, const Mesh* mesh, const Matrix44* localToWorld, const Matrix44* localToClip, const DrawState* state, float viewDepth )
+{
+    if (queue->drawCount == MAX_TRANSPARENT_DRAWS)
+    {
+        printf( "Transparent queue is full, dropping a draw.\n" );
+        return;
+    }
+
+    TransparentDraw* draw = &queue->draws[ queue->drawCount++ ];
+    draw->mesh = mesh;
+    draw->localToWorld = *localToWorld;
+    draw->localToClip = *localToClip;
+    draw->state = *state;
+    draw->state.blend = true;
+    draw->state.depthWrite = false;
+    draw->viewDepth = viewDepth;
+}
+
+static int compareBackToFront( const void* a, const void* b )
+{
+    const float depthA = ((const TransparentDraw*)a)->viewDepth;
+    const float depthB = ((const TransparentDraw*)b)->viewDepth;
+
+    return (depthA < depthB) - (depthA > depthB);
+}
+
+// Must be called after all opaque draws of the frame. Empties the queue.
+void transparentQueueRender( TransparentQueue* queue, Framebuffer* fb )
+{
+    qsort( queue->draws, queue->drawCount, sizeof( TransparentDraw ), compareBackToFront );
+
+    for (int i = 0; i < queue->drawCount; ++i)
+    {
+        TransparentDraw* draw = &queue->draws[ i ];
+        renderMesh( draw->mesh, &draw->localToWorld, &draw->localToClip, &draw->state, fb );
+    }
+
+    queue->drawCount = 0;
+}
@@ -0,0 +1,238 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+// Load-time face and vertex reordering for locality. Faces are ordered with Tipsify (Sander, Nehab & Barczak 2007),
+// which walks the mesh in fans around recently used vertices, then vertices are renumbered in the order the
+// faces first use them. Setup then reads transformed vertices and attributes close to the ones it just read.
+#define VERTEX_CACHE_SIZE 16 // Entries of the simulated FIFO post-transform cache.
+
+// Average cache miss ratio: vertex transforms per face with a VERTEX_CACHE_SIZE entry FIFO cache.
+// 3 is the worst, about 0.5 is the best a large closed mesh can get.
+float meshComputeAcmr( const Mesh* mesh )
+{
+    if (mesh->faceCount == 0)
+    {
+        return 0;
+    }
+
+    // Entry times instead of a FIFO: a vertex is cached if it entered less than VERTEX_CACHE_SIZE misses ago.
+    unsigned* entryTimes = calloc( mesh->vertexCount, sizeof( unsigned ) );
+    unsigned misses = 0;
+
+    for (unsigned f = 0; f < mesh->faceCount; ++f)
+    {
+        const unsigned indices[ 3 ] = { mesh->faces[ f ].a, mesh->faces[ f ].b, mesh->faces[ f ].c };
+
+        for (int k = 0; k < 3; ++k)
+        {
+            if (entryTimes[ indices[ k ] ] == 0 || misses - entryTimes[ indices[ k ] ] + 1 > VERTEX_CACHE_SIZE)
+            {
+                ++misses;
+                entryTimes[ indices[ k ] ] = misses;
+            }
+        }
+    }
+
+    free( entryTimes );
+    return (float)misses / mesh->faceCount;
+}
+
+// Returns the next vertex to fan around: the candidate with live faces that stays cached longest, else
+// a vertex with live faces from the dead-end stack or, last, the input order. -1 when all faces are emitted.
+static int tipsifyNextVertex( const unsigned* candidates, unsigned candidateCount, const unsigned* liveCounts, const unsigned* cacheTimes,
+                              unsigned time, unsigned* deadEnds, unsigned* deadEndCount, unsigned* cursor, unsigned vertexCount )
+{
+    int best = -1;
+    unsigned bestPriority = 0;
+
+    for (unsigned i = 0; i < candidateCount; ++i)
+    {
+        const unsigned v = candidates[ i ];
+
+        if (liveCounts[ v ] > 0)
+        {
+            // Vertices that would drop out of the cache while their fan is emitted are the last choice.
+            const unsigned age = time - cacheTimes[ v ];
+            const unsigned priority = age + 2 * liveCounts[ v ] <= VERTEX_CACHE_SIZE ? age + 1 : 0;
+
+            if (best < 0 || priority > bestPriority)
+            {
+                best = (int)v;
+                bestPriority = priority;
+            }
+        }
+    }
+
+    if (best >= 0)
+    {
+        return best;
+    }
+
+    while (*deadEndCount > 0)
+    {
+        const unsigned v = deadEnds[ --*deadEndCount ];
+
+        if (liveCounts[ v ] > 0)
+        {
+            return (int)v;
+        }
+    }
+
+    for (; *cursor < vertexCount; ++*cursor)
+    {
+        if (liveCounts[ *cursor ] > 0)
+        {
+            return (int)*cursor;
+        }
+    }
+
+    return -1;
+}
+
+// Reorders mesh's faces for the post-transform cache and its vertices into first use order.
+// Temporary memory comes from arena and is released before returning.
+void meshOptimizeVertexCache( Mesh* mesh, Arena* arena )
+{
+    const unsigned vertexCount = mesh->vertexCount;
+    const unsigned faceCount = mesh->faceCount;
+
+    if (faceCount == 0)
+    {
+        return;
+    }
+
+    const ArenaMark mark = arenaMark( arena );
+
+    // Vertex v's faces are adjacentFaces[ adjacencyStarts[ v ] ] .. adjacentFaces[ adjacencyStarts[ v + 1 ] - 1 ].
+    unsigned* adjacencyStarts = arenaAlloc( arena, (vertexCount + 1) * sizeof( unsigned ) );
+    unsigned* adjacentFaces = arenaAlloc( arena, faceCount * 3 * sizeof( unsigned ) );
+    unsigned* liveCounts = arenaAlloc( arena, vertexCount * sizeof( unsigned ) );
+    unsigned* cacheTimes = arenaAlloc( arena, vertexCount * sizeof( unsigned ) );
+    unsigned* candidates = arenaAlloc( arena, faceCount * 3 * sizeof( unsigned ) );
+    unsigned* deadEnds = arenaAlloc( arena, faceCount * 3 * sizeof( unsigned ) );
+    bool* emitted = arenaAlloc( arena, faceCount * sizeof( bool ) );
+    VertexInd* faces = arenaAlloc( arena, faceCount * sizeof( VertexInd ) );
+    memset( liveCounts, 0, vertexCount * sizeof( unsigned ) );
+    memset( cacheTimes, 0, vertexCount * sizeof( unsigned ) );
+    memset( emitted, 0, faceCount * sizeof( bool ) );
+
+    for (unsigned f = 0; f < faceCount; ++f)
+    {
+        ++liveCounts[ mesh->faces[ f ].a ];
+        ++liveCounts[ mesh->faces[ f ].b ];
+        ++liveCounts[ mesh->faces[ f ].c ];
+    }
+
+    adjacencyStarts[ 0 ] = 0;
+
+    for (unsigned v = 0; v < vertexCount; ++v)
+    {
+        adjacencyStarts[ v + 1 ] = adjacencyStarts[ v ] + liveCounts[ v ];
+    }
+
+    // cacheTimes doubles as the fill cursor until the walk starts.
+    for (unsigned f = 0; f < faceCount; ++f)
+    {
+        const unsigned indices[ 3 ] = { mesh->faces[ f ].a, mesh->faces[ f ].b, mesh->faces[ f ].c };
+
+        for (int k = 0; k < 3; ++k)
+        {
+            adjacentFaces[ adjacencyStarts[ indices[ k ] ] + cacheTimes[ indices[ k ] ]++ ] = f;
+        }
+    }
+
+    memset( cacheTimes, 0, vertexCount * sizeof( unsigned ) );
+
+    // Times start past the cache size so that untouched vertices count as not cached.
+    unsigned time = VERTEX_CACHE_SIZE + 1;
+    unsigned deadEndCount = 0;
+    unsigned cursor = 0;
+    unsigned emittedCount = 0;
+    int fanVertex = mesh->faces[ 0 ].a;
+
+    while (fanVertex >= 0)
+    {
+        unsigned candidateCount = 0;
+
+        for (unsigned i = adjacencyStarts[ fanVertex ]; i < adjacencyStarts[ fanVertex + 1 ]; ++i)
+        {
+            const unsigned f = adjacentFaces[ i ];
+
+            if (emitted[ f ])
+            {
+                continue;
+            }
+
+            emitted[ f ] = true;
+            faces[ emittedCount++ ] = mesh->faces[ f ];
+            const unsigned indices[ 3 ] = { mesh->faces[ f ].a, mesh->faces[ f ].b, mesh->faces[ f ].c };
+
+            for (int k = 0; k < 3; ++k)
+            {
+                const unsigned v = indices[ k ];
+                deadEnds[ deadEndCount++ ] = v;
+                candidates[ candidateCount++ ] = v;
+                --liveCounts[ v ];
+
+                if (time - cacheTimes[ v ] > VERTEX_CACHE_SIZE)
+                {
+                    cacheTimes[ v ] = time++;
+                }
+            }
+        }
+
+        fanVertex = tipsifyNextVertex( candidates, candidateCount, liveCounts, cacheTimes, time, deadEnds, &deadEndCount, &cursor, vertexCount );
+    }
+
+    assert( emittedCount == faceCount && "every face is emitted once" );
+
+    // Renumbers vertices in first use order. Vertices no face uses go last.
+    unsigned* newIndices = liveCounts;
+    unsigned newVertexCount = 0;
+
+    for (unsigned v = 0; v < vertexCount; ++v)
+    {
+        newIndices[ v ] = ~0u;
+    }
+
+    for (unsigned f = 0; f < faceCount; ++f)
+    {
+        unsigned short* indices[ 3 ] = { &faces[ f ].a, &faces[ f ].b, &faces[ f ].c };
+
+        for (int k = 0; k < 3; ++k)
+        {
+            if (newIndices[ *indices[ k ] ] == ~0u)
+            {
+                newIndices[ *indices[ k ] ] = newVertexCount++;
+            }
+
+            *indices[ k ] = (unsigned short)newIndices[ *indices[ k ] ];
+        }
+    }
+
+    for (unsigned v = 0; v < vertexCount; ++v)
+    {
+        if (newIndices[ v ] == ~0u)
+        {
+            newIndices[ v ] = newVertexCount++;
+        }
+    }
+
+    Vec3* positions = arenaAlloc( arena, vertexCount * sizeof( Vec3 ) );
+    Vec3* normals = arenaAlloc( arena, vertexCount * sizeof( Vec3 ) );
+    UV* uvs = arenaAlloc( arena, vertexCount * sizeof( UV ) );
+
+    for (unsigned v = 0; v < vertexCount; ++v)
+    {
+        positions[ newIndices[ v ] ] = mesh->positions[ v ];
+        normals[ newIndices[ v ] ] = mesh->normals[ v ];
+        uvs[ newIndices[ v ] ] = mesh->uvs[ v ];
+    }
+
+    memcpy( mesh->positions, positions, vertexCount * sizeof( Vec3 ) );
+    memcpy( mesh->normals, normals, vertexCount * sizeof( Vec3 ) );
+    memcpy( mesh->uvs, uvs, vertexCount * sizeof( UV ) );
+    memcpy( mesh->faces, faces, faceCount * sizeof( VertexInd ) );
+
+    arenaRelease( arena, mark );
+}